@@ -1,6 +1,8 @@
 #ifndef BINS_H
 #define BINS_H
 
+#include "microkernels/kernel_expr.h"
+
 struct pim_vectors {
     uint64_t offset_a;
     uint64_t offset_b;
@@ -8,6 +10,86 @@ struct pim_vectors {
     uint32_t len;
 };
 
+/**
+ * Elementwise operation on vectors that live in the mapped PIM data region.
+ * All offsets are relative to the start of the region and 512 byte aligned.
+ * The last PIM_SCRATCH_BYTES of the region belong to the driver, operands
+ * must end before them.
+ * offset_c is only read by PIM_OP_MAD. len can be any length, elements past
+ * the last whole 256-element block are computed by the host.
+ *
+ * result_offset may equal the offset of an operand to run in place
+ * (a += b, a *= b) or to accumulate into it (c += a * b with PIM_OP_MAD), but
+ * must not overlap an operand partially. Every element of the result is
+ * overwritten, it does not need to be cleared.
+ */
+struct pim_elementwise {
+    uint64_t offset_a;
+    uint64_t offset_b;
+    uint64_t offset_c;
+    uint64_t result_offset;
+    uint32_t len;
+    uint32_t op;
+};
+
+enum pim_elementwise_op {
+    // result = a + b
+    PIM_OP_ADD,
+    // result = a * b
+    PIM_OP_MUL,
+    // result = a - b
+    PIM_OP_SUB,
+    // result = a * b + c
+    PIM_OP_MAD,
+    PIM_OP_COUNT,
+};
+
+/**
+ * Strided 2D view of f16 elements in the PIM data region. Element (r, k)
+ * lies at offset + 2 * (r * row_stride + k * element_stride). A contiguous
+ * vector is a single row with element_stride 1, a column block of a row
+ * major matrix uses row_stride = matrix columns, and row_stride 0 repeats an
+ * input for every row.
+ */
+struct pim_view {
+    uint64_t offset;
+    uint32_t element_stride;
+    uint32_t row_stride;
+};
+
+/**
+ * Elementwise operation over rows x cols elements of views. Views whose
+ * rows are contiguous and start on 512 byte boundaries run on the PIM units
+ * in a single pass, other views are gathered and computed on the host. The
+ * result view may coincide with an operand view but must not overlap one
+ * otherwise. No view may reach into the last PIM_SCRATCH_BYTES of the region.
+ */
+struct pim_elementwise_view {
+    struct pim_view a;
+    struct pim_view b;
+    struct pim_view c;
+    struct pim_view result;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t op;
+};
+
+/**
+ * Elementwise expression over up to four vectors in the PIM data region that
+ * runs as a single kernel, intermediates never leave the PIM units. 'nodes'
+ * is a DAG in which every node only refers to earlier nodes or inputs (see
+ * struct kernel_expr_node), the last node is the result. Offsets and len
+ * follow the rules of struct pim_elementwise.
+ */
+struct pim_expression {
+    uint64_t input_offsets[KERNEL_EXPR_MAX_INPUTS];
+    uint64_t result_offset;
+    uint32_t len;
+    uint32_t num_inputs;
+    uint32_t num_nodes;
+    struct kernel_expr_node nodes[KERNEL_EXPR_MAX_NODES];
+};
+
 struct pim_gemv {
     __u64 input_vector_user_addr;
     __u64 matrix_user_addr;
@@ -17,16 +99,65 @@ struct pim_gemv {
     __u32 matrix_dim2;
 };
 
-void vadd_driver_code(void);
-void vmul_driver_code(void);
+enum pim_gemv_epilogue_flags {
+    // Adds beta * bias[row] (bias only without PIM_EPILOGUE_SCALE)
+    PIM_EPILOGUE_BIAS = 1 << 0,
+    // Scales the product by alpha and the bias by beta
+    PIM_EPILOGUE_SCALE = 1 << 1,
+    // Piecewise linear activation, see struct pim_gemv_epilogue
+    PIM_EPILOGUE_ACTIVATION = 1 << 2,
+};
+
+#define PIM_EPILOGUE_ALL                                                       \
+    (PIM_EPILOGUE_BIAS | PIM_EPILOGUE_SCALE | PIM_EPILOGUE_ACTIVATION)
+
+/**
+ * Epilogue applied to every row of a GEMV result while it is converted to
+ * f16: y = act(alpha * (W x) + beta * bias). The activation multiplies
+ * negative values by negative_slope and clamps the result to [lower, upper],
+ * e.g. ReLU is slope 0 with bounds -inf and +inf, ReLU6 slope 0 with bounds
+ * 0 and 6. All scalars are f16 bit patterns, bias holds one value per result
+ * element, i.e. matrix_dim1 values resp. matrix_dim2 for IOCTL_GEMV_TRANSPOSED.
+ */
+struct pim_gemv_epilogue {
+    __u64 bias_user_addr;
+    __u32 flags;
+    __u16 alpha;
+    __u16 beta;
+    __u16 negative_slope;
+    __u16 lower;
+    __u16 upper;
+    __u16 reserved;
+};
+
+struct pim_gemv_fused {
+    // First member, so the GEMV inputs are read like for IOCTL_GEMV
+    struct pim_gemv gemv;
+    struct pim_gemv_epilogue epilogue;
+};
+
+void elementwise_driver_code(enum pim_elementwise_op op);
 void gemv_driver_code(void);
 
-int vadd_from_userspace(uint16_t *vector_a_address, uint16_t *vector_b_address,
-                        struct pim_vectors *vectors_descriptor);
-int vmul_from_userspace(uint16_t *vector_a_address, uint16_t *vector_b_address,
-                        struct pim_vectors *vectors_descriptor);
+int elementwise_from_userspace(struct pim_elementwise *descriptor);
+int elementwise_view_from_userspace(const struct pim_elementwise_view *desc);
+int expression_from_userspace(const struct pim_expression *descriptor);
+
+/**
+ * Frees the cached elementwise trigger programs.
+ */
+void elementwise_release_programs(void);
+
+/**
+ * Computes the GEMV, or A^T x of the same row major matrix with 'transposed',
+ * and copies the result to user space. 'epilogue' may be NULL, 'bias' holds
+ * one value per result element if the epilogue adds a bias.
+ */
 int gemv_from_userspace(__u64 result_addr, uint16_t *input_vector_data,
                         uint16_t *matrix_data, uint32_t len_input_vector,
-                        uint32_t matrix_rows, uint32_t matrix_cols);
+                        uint32_t matrix_rows, uint32_t matrix_cols,
+                        bool transposed,
+                        const struct pim_gemv_epilogue *epilogue,
+                        const uint16_t *bias);
 
 #endif
\ No newline at end of file
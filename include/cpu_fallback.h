@@ -0,0 +1,70 @@
+#ifndef CPU_FALLBACK_H
+#define CPU_FALLBACK_H
+
+#include "microkernels/kernel_cost.h"
+#include "microkernels/kernel_datastructures.h"
+
+/*
+ * Host implementations of the PIM ops for shapes that are too small to
+ * amortize the kernel load, the bank mode switches and the trigger latency.
+ * On arm64 they use NEON with f32 intermediates, which rounds like the PIM
+ * units for ADD, MUL and MAD.
+ */
+
+/**
+ * Computes result = b op a (or b * scalar + a for scale_bank, b * a + c for
+ * MAD) for 'len' elements that live in the PIM data region.
+ */
+void cpu_elementwise(InstructionType opcode, bool scale_bank, uint16_t scalar,
+                     const uint16_t __iomem *a, const uint16_t __iomem *b,
+                     const uint16_t __iomem *c, uint16_t __iomem *result,
+                     uint32_t len);
+
+/**
+ * Same as cpu_elementwise for operands in kernel memory. 'result' may be one
+ * of the operands.
+ */
+void cpu_elementwise_buffer(InstructionType opcode, bool scale_bank,
+                            uint16_t scalar, const uint16_t *a,
+                            const uint16_t *b, const uint16_t *c,
+                            uint16_t *result, uint32_t len);
+
+/**
+ * Computes result = matrix * vector for a row major f16 matrix.
+ */
+void cpu_gemv(uint16_t *result, const uint16_t *matrix, const uint16_t *vector,
+              uint32_t rows, uint32_t cols);
+
+/**
+ * Computes result = matrix^T * vector for a row major f16 matrix, 'result'
+ * holds 'cols' and 'vector' 'rows' elements.
+ */
+void cpu_gemv_transposed(uint16_t *result, const uint16_t *matrix,
+                         const uint16_t *vector, uint32_t rows,
+                         uint32_t cols);
+
+/**
+ * Sums the 16 f16 lanes of each of 'rows' rows of GEMV partial sums as fixed
+ * point numbers with 'shift' (at most 24) fractional bits. Every lane is
+ * truncated toward zero before it is added, with 24 bits every finite lane
+ * is exact. Infinities saturate to 2^(16 + shift) and NaN counts as 0.
+ */
+void cpu_sum_lanes_fixed(const uint16_t *lanes, uint32_t rows, int shift,
+                         int64_t *sums);
+
+/**
+ * Sums the 16 banks of every lane of 'count' blocks of transposed GEMV
+ * partial sums like cpu_sum_lanes_fixed, lane l of block k goes to
+ * sums[k * 16 + l].
+ */
+void cpu_sum_banks_fixed(const uint16_t *blocks, uint32_t count, int shift,
+                         int64_t *sums);
+
+/**
+ * Returns true if the shape should run on the CPU, given the predicted PIM
+ * time 'pim_ns'. Uses the cpu_crossover module parameter if set and the cost
+ * model otherwise.
+ */
+bool cpu_fallback_preferred(const struct pim_op_shape *shape, uint64_t pim_ns);
+
+#endif
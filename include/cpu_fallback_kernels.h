@@ -0,0 +1,57 @@
+#ifndef CPU_FALLBACK_KERNELS_H
+#define CPU_FALLBACK_KERNELS_H
+
+#include "microkernels/kernel_datastructures.h"
+
+/*
+ * Inner loops of the CPU fallback. With CONFIG_KERNEL_MODE_NEON they come
+ * from cpu_fallback_neon.c, the only object built with FP/SIMD registers
+ * enabled (like arch/arm64/lib/xor-neon.c), and cpu_fallback.c wraps every
+ * call in kernel_neon_begin/end. Otherwise cpu_fallback.c provides integer
+ * only versions that round the same way.
+ */
+
+// Elements staged on the stack per round trip through the data region
+#define CPU_CHUNK_ELEMENTS 256
+
+// Lanes of one row of GEMV partial sums
+#define CPU_LANES 16
+
+/**
+ * Computes 'len' elements of an elementwise op like cpu_elementwise_buffer.
+ */
+void fallback_compute_chunk(InstructionType opcode, bool scale_bank,
+                            uint16_t scalar, const uint16_t *a,
+                            const uint16_t *b, const uint16_t *c,
+                            uint16_t *result, uint32_t len);
+
+/**
+ * Dot product of a matrix row and the vector. The products are exact in f32
+ * and summed in four f32 lanes, which are added pairwise before the
+ * remaining columns; the total is rounded to f16 once.
+ */
+uint16_t fallback_dot_row(const uint16_t *row, const uint16_t *vector,
+                          uint32_t cols);
+
+/**
+ * Column sums of 'n' <= CPU_CHUNK_ELEMENTS columns starting at 'matrix',
+ * accumulated row by row in f32 and rounded to f16 once.
+ */
+void fallback_dot_columns(uint16_t *result, const uint16_t *matrix,
+                          const uint16_t *vector, uint32_t rows,
+                          uint32_t cols, uint32_t n);
+
+/**
+ * Fixed point sum of the CPU_LANES lanes of one row, see
+ * cpu_sum_lanes_fixed.
+ */
+int64_t fallback_sum_lanes_fixed(const uint16_t *lanes, int shift);
+
+/**
+ * Fixed point sums over the CPU_LANES banks of every lane of one block, see
+ * cpu_sum_banks_fixed.
+ */
+void fallback_sum_banks_fixed(const uint16_t *block, int shift,
+                              int64_t *sums);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef KERNEL_ASM_H
+#define KERNEL_ASM_H
+
+#include "kernel_datastructures.h"
+
+/*
+ * Textual assembly for the PIM-VM ISA. One instruction per line, destination
+ * first, ';' or '#' start a comment:
+ *
+ *     .blocks 1
+ *     MOV  GRF_A[0], BANK
+ *     ADD  GRF_B[0], BANK, GRF_A[0]
+ *     MAC  GRF_B[0], BANK, GRF_A[0], GRF_B[0] aam
+ *     JUMP -1, 63
+ *     FILL BANK, GRF_B[0]
+ *     EXIT
+ *
+ * Unused slots are padded with NOP.
+ */
+
+// Size of a single instruction in the binary blob format
+#define PIM_ASM_BLOB_INSTRUCTION_SIZE 8
+// Size of the blob header ("PIMK", version, blocks, instruction count, 0)
+#define PIM_ASM_BLOB_HEADER_SIZE 8
+#define PIM_ASM_BLOB_MAX_SIZE                                                  \
+    (PIM_ASM_BLOB_HEADER_SIZE +                                                \
+     MICROKERNEL_SLOTS * PIM_ASM_BLOB_INSTRUCTION_SIZE)
+
+// Flags returned by pim_asm_parse_config
+#define PIM_CONFIG_HAS_BANK_MODE 0x1
+#define PIM_CONFIG_HAS_KERNEL 0x2
+
+/**
+ * Assembles a source text into a microkernel. Returns the number of
+ * instructions that were written before the NOP padding or -EINVAL with the
+ * offending line reported through pr_err.
+ */
+int pim_asm_assemble(const char *source, Microkernel *kernel);
+
+/**
+ * Prints a single instruction in assembly syntax. Returns the number of
+ * characters written like snprintf or a negative error code.
+ */
+int pim_asm_format_instruction(char *buffer, size_t size,
+                               const Instruction *instr);
+
+/**
+ * Prints a microkernel as assembly, one instruction per line. Trailing NOP
+ * padding is omitted so that the output assembles back to the same kernel.
+ * The .blocks directive is left out if the block count is unknown (0).
+ */
+int pim_asm_disassemble(const Microkernel *kernel, char *buffer, size_t size);
+
+/**
+ * Parses a config string as written by set_bank_mode and set_microkernel.
+ * The bank mode name ("SingleBank", ...) is copied into 'bank_mode' and the
+ * kernel into 'kernel' if present. Returns a combination of the
+ * PIM_CONFIG_HAS_* flags or -EINVAL.
+ */
+int pim_asm_parse_config(const char *json, char *bank_mode,
+                         size_t bank_mode_size, Microkernel *kernel);
+
+/**
+ * Parses the JSON emitted by set_microkernel back into a microkernel.
+ */
+int pim_asm_parse_json(const char *json, Microkernel *kernel);
+
+/**
+ * Encodes a microkernel into the compact binary blob format. Returns the blob
+ * size in bytes.
+ */
+int pim_asm_to_blob(const Microkernel *kernel, uint8_t *blob, size_t size);
+
+/**
+ * Decodes a binary blob produced by pim_asm_to_blob.
+ */
+int pim_asm_from_blob(const uint8_t *blob, size_t size, Microkernel *kernel);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+	Glue that lets the microkernel sources build both inside the kernel module
+	and as a userspace library (see the 'tools' target of the Makefile)
+*/
+
+#ifndef KERNEL_COMPAT_H
+#define KERNEL_COMPAT_H
+
+#ifdef __KERNEL__
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#else
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define pr_err(...) fprintf(stderr, __VA_ARGS__)
+#define pr_warn(...) fprintf(stderr, __VA_ARGS__)
+#define pr_info(...) ((void)0)
+
+#define GFP_KERNEL 0
+#define kmalloc(size, flags) malloc(size)
+#define kfree(ptr) free(ptr)
+#define kvmalloc(size, flags) malloc(size)
+#define kvfree(ptr) free(ptr)
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#endif
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#endif
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef KERNEL_COST_H
+#define KERNEL_COST_H
+
+#include "kernel_datastructures.h"
+#include "kernels.h"
+
+/*
+ * Static cost model for microkernels. The analyzer walks the trigger stream a
+ * kernel consumes per invocation, scales it by the number of invocations an
+ * op shape needs and weights the resulting event counts with per-event
+ * costs. It only predicts, nothing is written to the device.
+ */
+
+/**
+ * Per-event costs in picoseconds. The defaults are rough figures for the gem5
+ * full system setup and can be recalibrated at runtime.
+ */
+struct pim_cost_params {
+    uint32_t trigger_read_ps;
+    uint32_t trigger_write_ps;
+    uint32_t barrier_ps;
+    // Single iowrite8 into the PIM_CONFIG region
+    uint32_t config_byte_ps;
+    // Bulk host copies into the data region (memcpy_toio, memset_io)
+    uint32_t mmio_write_byte_ps;
+    // Host reads from the data region (ioread16 of partial sums)
+    uint32_t mmio_read_byte_ps;
+    // Elementwise f16 operation resp. multiply-accumulate on the CPU
+    uint32_t cpu_element_ps;
+    uint32_t cpu_mac_ps;
+};
+
+enum pim_shape_kind {
+    PIM_SHAPE_ELEMENTWISE,
+    PIM_SHAPE_GEMV,
+};
+
+struct pim_op_shape {
+    enum pim_shape_kind kind;
+    // Elementwise: number of elements
+    uint32_t len;
+    // GEMV: matrix dimensions
+    uint32_t rows;
+    uint32_t cols;
+};
+
+struct pim_cost {
+    // Trigger stream of a single kernel invocation
+    uint32_t launch_reads;
+    uint32_t launch_writes;
+    uint32_t launch_barriers;
+
+    // Totals for the whole op
+    uint64_t launches;
+    uint64_t trigger_reads;
+    uint64_t trigger_writes;
+    uint64_t barriers;
+    uint64_t config_bytes;
+    uint64_t mmio_write_bytes;
+    uint64_t mmio_read_bytes;
+    uint64_t estimated_ns;
+};
+
+extern struct pim_cost_params pim_cost_calibration;
+
+/**
+ * Predicts the cost of running an op of the given shape with 'kernel' under
+ * the given per-event costs. Returns -EINVAL if the kernel does not terminate
+ * with an EXIT or does not fit the shape.
+ */
+int pim_cost_analyze(const Microkernel *kernel,
+                     const struct pim_op_shape *shape,
+                     const struct pim_cost_params *params,
+                     struct pim_cost *cost);
+
+/**
+ * Estimated time in ns of computing the shape on the CPU instead.
+ */
+uint64_t pim_cost_estimate_cpu(const struct pim_op_shape *shape,
+                               const struct pim_cost_params *params);
+
+/**
+ * Picks the elementwise kernel variant of the family (opcode, scale_bank)
+ * with the lowest predicted cost for the vector length. The cost of the
+ * chosen variant is stored in 'cost' if it is not NULL. Returns NULL if no
+ * variant fits.
+ */
+const struct kernel_variant *pim_cost_select_variant(InstructionType opcode,
+                                                     bool scale_bank,
+                                                     uint32_t len,
+                                                     struct pim_cost *cost);
+
+#endif
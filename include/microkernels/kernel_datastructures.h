@@ -5,11 +5,14 @@
 #ifndef PIM_MICROKERNELS_H
 #define PIM_MICROKERNELS_H
 
-#include <linux/types.h>
+#include "kernel_compat.h"
 
 
 /* ------- Register and Bank File ------- */
 
+// Number of GRF_A/GRF_B registers available to every PIM unit
+#define GRF_REGISTERS 8
+
 
 typedef enum {
     GRF_A,
@@ -111,8 +114,11 @@ typedef struct {
 
 
 
+// Number of instruction slots in the CRF of a PIM unit
+#define MICROKERNEL_SLOTS 32
+
 typedef struct {
-    Instruction kernel[32];
+    Instruction kernel[MICROKERNEL_SLOTS];
     int blocks;
 } Microkernel;
 
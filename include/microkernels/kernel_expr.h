@@ -0,0 +1,85 @@
+#ifndef KERNEL_EXPR_H
+#define KERNEL_EXPR_H
+
+#include "kernel_datastructures.h"
+#include "kernel_plan.h"
+
+/*
+ * Compiler for small elementwise expressions over PIM-resident vectors, e.g.
+ * (a + b) * c or a * b + c * d. The whole expression runs as one microkernel:
+ * inputs are read from the banks where an instruction needs them, every
+ * intermediate stays in GRF_A/GRF_B and only the final value is written back.
+ */
+
+#define KERNEL_EXPR_MAX_INPUTS 4
+#define KERNEL_EXPR_MAX_NODES 8
+
+// Trigger streams of an expression kernel besides the inputs 0..3
+#define KERNEL_EXPR_STREAM_RESULT KERNEL_EXPR_MAX_INPUTS
+#define KERNEL_EXPR_STREAM_DUMMY (KERNEL_EXPR_MAX_INPUTS + 1)
+
+enum kernel_expr_op {
+    // Value of input vector 'lhs'
+    KERNEL_EXPR_INPUT,
+    // Sum resp. product of the nodes 'lhs' and 'rhs'
+    KERNEL_EXPR_ADD,
+    KERNEL_EXPR_MUL,
+};
+
+/**
+ * Node of an expression DAG. Nodes only refer to earlier nodes, the last node
+ * is the result.
+ */
+struct kernel_expr_node {
+    uint8_t op;
+    uint8_t lhs;
+    uint8_t rhs;
+    uint8_t reserved;
+};
+
+struct kernel_expr {
+    struct kernel_expr_node nodes[KERNEL_EXPR_MAX_NODES];
+    int num_nodes;
+    int num_inputs;
+};
+
+/**
+ * Compiled expression: the kernel and the trigger sequence of one invocation.
+ * The steps use kernel_plan_step with 'stream' set to the input index,
+ * KERNEL_EXPR_STREAM_RESULT or KERNEL_EXPR_STREAM_DUMMY.
+ */
+struct kernel_expr_program {
+    Microkernel kernel;
+    struct kernel_plan_step steps[KERNEL_PLAN_MAX_TRIGGERS];
+    int count;
+    int blocks;
+    // GRF registers every block needs
+    int registers;
+    // Bank reads and writes of one invocation, dummy triggers excluded
+    int bank_accesses;
+};
+
+/**
+ * Checks the structure of an expression. Returns -EINVAL if a node refers to
+ * a later node or a missing input, or the sizes are out of range.
+ */
+int kernel_expr_validate(const struct kernel_expr *expr);
+
+/**
+ * Largest number of blocks per invocation (8, 4, 2 or 1) whose registers fit
+ * the GRF and whose instructions fit the slots. Returns -E2BIG if not even a
+ * single block fits.
+ */
+int kernel_expr_max_blocks(const struct kernel_expr *expr);
+
+/**
+ * Compiles the expression for 'blocks' blocks per invocation. A MUL whose
+ * product is only added once is fused into a MAD, inputs are loaded into a
+ * register only if an instruction has no other way to read them. Fences are
+ * placed for 'ordering' like kernel_plan_build does.
+ */
+int kernel_expr_compile(const struct kernel_expr *expr, int blocks,
+                        enum pim_ordering ordering,
+                        struct kernel_expr_program *program);
+
+#endif
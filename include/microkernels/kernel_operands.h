@@ -0,0 +1,121 @@
+#ifndef KERNEL_OPERANDS_H
+#define KERNEL_OPERANDS_H
+
+#include "kernel_datastructures.h"
+
+/**
+ * Uniform view on the operands of an instruction, so that passes over a
+ * kernel do not need to switch over every instruction layout. Sources are
+ * listed in encoding order (src0, src1, src2, or src for MOV/FILL).
+ */
+struct instruction_operands {
+    File *dst;
+    File *src[3];
+    int num_src;
+    bool *aam;
+};
+
+static inline void get_instruction_operands(Instruction *instr,
+                                            struct instruction_operands *ops) {
+    ops->dst = NULL;
+    ops->src[0] = ops->src[1] = ops->src[2] = NULL;
+    ops->num_src = 0;
+    ops->aam = NULL;
+
+    switch (instr->type) {
+    case MOV:
+        ops->dst = &instr->mov.dst;
+        ops->src[ops->num_src++] = &instr->mov.src;
+        break;
+    case FILL:
+        ops->dst = &instr->fill.dst;
+        ops->src[ops->num_src++] = &instr->fill.src;
+        break;
+    case ADD:
+        ops->dst = &instr->add.dst;
+        ops->src[ops->num_src++] = &instr->add.src0;
+        ops->src[ops->num_src++] = &instr->add.src1;
+        ops->aam = &instr->add.aam;
+        break;
+    case MUL:
+        ops->dst = &instr->mul.dst;
+        ops->src[ops->num_src++] = &instr->mul.src0;
+        ops->src[ops->num_src++] = &instr->mul.src1;
+        ops->aam = &instr->mul.aam;
+        break;
+    case MAC:
+        ops->dst = &instr->mac.dst;
+        ops->src[ops->num_src++] = &instr->mac.src0;
+        ops->src[ops->num_src++] = &instr->mac.src1;
+        ops->src[ops->num_src++] = &instr->mac.src2;
+        ops->aam = &instr->mac.aam;
+        break;
+    case MAD:
+        ops->dst = &instr->mad.dst;
+        ops->src[ops->num_src++] = &instr->mad.src0;
+        ops->src[ops->num_src++] = &instr->mad.src1;
+        ops->src[ops->num_src++] = &instr->mad.src2;
+        ops->aam = &instr->mad.aam;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Index of a register file operand. BANK has no index and yields 0.
+ */
+static inline uint8_t file_index(const File *file) {
+    switch (file->type) {
+    case GRF_A:
+        return file->grfa.index;
+    case GRF_B:
+        return file->grfb.index;
+    case SRF_M:
+        return file->srfm.index;
+    case SRF_A:
+        return file->srfa.index;
+    default:
+        return 0;
+    }
+}
+
+static inline void set_file_index(File *file, uint8_t index) {
+    switch (file->type) {
+    case GRF_A:
+        file->grfa.index = index;
+        break;
+    case GRF_B:
+        file->grfb.index = index;
+        break;
+    case SRF_M:
+        file->srfm.index = index;
+        break;
+    case SRF_A:
+        file->srfa.index = index;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * True if the instruction consumes a trigger to access the bank, either as a
+ * source or as the destination.
+ */
+static inline bool instruction_uses_bank(Instruction *instr) {
+    struct instruction_operands ops;
+
+    get_instruction_operands(instr, &ops);
+    if (ops.dst && ops.dst->type == BANK) {
+        return true;
+    }
+    for (int i = 0; i < ops.num_src; i++) {
+        if (ops.src[i]->type == BANK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef KERNEL_OPT_H
+#define KERNEL_OPT_H
+
+#include "kernel_datastructures.h"
+
+/*
+ * Peephole optimizer for microkernels. The kernel is unrolled into the
+ * straight line of instructions it executes per invocation (one per trigger),
+ * the selected passes run on that line and the result is rolled back into
+ * JUMP loops, so repeated instructions and repeated sequences end up as loop
+ * bodies. Register contents are reset by EXIT, so nothing is live across
+ * invocations.
+ *
+ * PIM_OPT_REUSE_GRF keeps the trigger stream unchanged. PIM_OPT_DEAD_MOV and
+ * PIM_OPT_FUSE_MAD drop triggers; callers that issue triggers for the
+ * optimized kernel take the addresses from the trigger map.
+ */
+
+// Renames GRF registers to the lowest free index (only for register files
+// that no address aligned instruction touches)
+#define PIM_OPT_REUSE_GRF 0x1
+// Removes MOVs into registers that are overwritten or reset before a read
+#define PIM_OPT_DEAD_MOV 0x2
+// Merges MUL t = a * b followed by ADD d = t + c into MAD d = a * b + c
+#define PIM_OPT_FUSE_MAD 0x4
+
+#define PIM_OPT_ALL (PIM_OPT_REUSE_GRF | PIM_OPT_DEAD_MOV | PIM_OPT_FUSE_MAD)
+
+// Longest unrolled kernel the optimizer works on
+#define PIM_OPT_MAX_TRIGGERS 1024
+
+struct pim_opt_stats {
+    int slots_before;
+    int slots_after;
+    int triggers_before;
+    int triggers_after;
+    int movs_removed;
+    int mads_fused;
+    // GRF_A and GRF_B registers in use
+    int registers_before;
+    int registers_after;
+};
+
+/**
+ * For every trigger of the optimized kernel the index of the trigger of the
+ * original kernel whose address it has to use.
+ */
+struct pim_opt_trigger_map {
+    uint16_t source[PIM_OPT_MAX_TRIGGERS];
+    int count;
+};
+
+/**
+ * Optimizes 'kernel' in place. 'stats' and 'map' are optional. The kernel is
+ * left untouched if an error is returned: -EINVAL if it does not reach an
+ * EXIT, -E2BIG if it runs more than PIM_OPT_MAX_TRIGGERS instructions and
+ * -ENOSPC if the result does not fit the instruction slots. A result that
+ * needs more slots without saving triggers is discarded as well.
+ */
+int pim_opt_optimize(Microkernel *kernel, unsigned int flags,
+                     struct pim_opt_stats *stats,
+                     struct pim_opt_trigger_map *map);
+
+#endif
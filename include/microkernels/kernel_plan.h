@@ -0,0 +1,92 @@
+#ifndef KERNEL_PLAN_H
+#define KERNEL_PLAN_H
+
+#include "kernel_datastructures.h"
+
+/*
+ * Trigger plan of an elementwise kernel: the sequence of triggers a single
+ * invocation consumes, which operand stream each trigger addresses and the
+ * barrier that follows it under a given ordering policy.
+ */
+
+// Longest trigger sequence of a single kernel invocation
+#define KERNEL_PLAN_MAX_TRIGGERS 64
+
+/**
+ * Source or destination of a trigger. The operand and result streams step
+ * through their vectors block by block, the constant and dummy streams always
+ * hit the same address.
+ */
+enum kernel_stream {
+    KERNEL_STREAM_A,
+    KERNEL_STREAM_B,
+    KERNEL_STREAM_C,
+    KERNEL_STREAM_RESULT,
+    KERNEL_STREAM_CONSTANT,
+    KERNEL_STREAM_DUMMY,
+    KERNEL_STREAM_COUNT,
+};
+
+enum trigger_fence {
+    TRIGGER_FENCE_NONE,
+    TRIGGER_FENCE_READ,
+    TRIGGER_FENCE_WRITE,
+    TRIGGER_FENCE_FULL,
+};
+
+/**
+ * How trigger sequences are ordered:
+ * - CONSERVATIVE: ordered MMIO accessors plus a barrier after every run of
+ *   the same opcode (rmb after reads, wmb after FILLs, mb after EXIT)
+ * - PHASE: the same barriers with relaxed accessors
+ * - BATCH: relaxed accessors and a single full barrier per batch
+ * PHASE and BATCH rely on the device mapping keeping accesses to the PIM
+ * region in program order (see tools/pim_order_check.c).
+ */
+enum pim_ordering {
+    PIM_ORDER_CONSERVATIVE,
+    PIM_ORDER_PHASE,
+    PIM_ORDER_BATCH,
+    PIM_ORDER_COUNT,
+};
+
+struct kernel_plan_step {
+    uint8_t stream;
+    // Block within the stream of one kernel invocation
+    uint8_t block;
+    bool is_write;
+    uint8_t fence;
+};
+
+struct kernel_plan {
+    struct kernel_plan_step steps[KERNEL_PLAN_MAX_TRIGGERS];
+    int count;
+    // Blocks every stepping stream advances per invocation
+    int blocks;
+    uint8_t stream_blocks[KERNEL_STREAM_COUNT];
+};
+
+static inline bool kernel_stream_steps(enum kernel_stream stream) {
+    return stream != KERNEL_STREAM_CONSTANT && stream != KERNEL_STREAM_DUMMY;
+}
+
+/**
+ * Sets the barrier after every step of a trigger sequence whose instructions
+ * have the opcodes 'types' (EXIT last) according to the ordering policy.
+ */
+void kernel_plan_place_fences(struct kernel_plan_step *steps,
+                              const InstructionType *types, int count,
+                              enum pim_ordering ordering);
+
+/**
+ * Walks the kernel once and records the trigger of every executed
+ * instruction. MOVs from the bank load the first operand into GRF_A, the
+ * addend into GRF_B and scalars into the SRF; arithmetic with a bank source
+ * reads the second operand and FILL writes the result. Returns -E2BIG if the
+ * kernel needs more than KERNEL_PLAN_MAX_TRIGGERS triggers and -EINVAL if the
+ * stepping streams do not advance by the same number of blocks.
+ */
+int kernel_plan_build(const Microkernel *kernel, enum pim_ordering ordering,
+                      struct kernel_plan *plan);
+
+#endif
@@ -10,4 +10,12 @@
 int parse_instruction_to_string(char *buffer, size_t size,
                                 const Instruction *instr);
 
+/**
+ * Serializes a complete microkernel into the JSON config string that
+ * set_microkernel writes into the PIM_CONFIG region. Returns the length of the
+ * string or a negative error code.
+ */
+int parse_kernel_to_string(char *buffer, size_t size,
+                           const Microkernel *kernel);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef KERNEL_WALK_H
+#define KERNEL_WALK_H
+
+#include "kernel_datastructures.h"
+
+// Upper bound of JUMPs followed in a row before a kernel is considered broken
+#define KERNEL_WALK_MAX_JUMPS (MICROKERNEL_SLOTS * 2)
+
+/**
+ * Follows a kernel the way the PIM-VM executes it: every instruction except
+ * JUMP consumes one trigger. A JUMP loads its count on the first visit, jumps
+ * back while the count is not exhausted and reloads on the next visit after
+ * the loop finished, which makes nested loops work.
+ */
+struct kernel_walker {
+    int pc;
+    unsigned int jump_remaining[MICROKERNEL_SLOTS];
+    bool jump_active[MICROKERNEL_SLOTS];
+};
+
+static inline void kernel_walker_reset(struct kernel_walker *walker) {
+    memset(walker, 0, sizeof(*walker));
+}
+
+/**
+ * Follows JUMPs from the current position until it points to an instruction
+ * that consumes a trigger and returns its slot. The caller advances the
+ * walker past the instruction by incrementing pc. Returns -EINVAL if the
+ * kernel leaves the instruction memory.
+ */
+static inline int kernel_walker_resolve(struct kernel_walker *walker,
+                                        const Microkernel *kernel) {
+    for (int followed = 0; followed < KERNEL_WALK_MAX_JUMPS; followed++) {
+        const Instruction *instr;
+        int pc = walker->pc;
+
+        if (pc < 0 || pc >= MICROKERNEL_SLOTS) {
+            return -EINVAL;
+        }
+        instr = &kernel->kernel[pc];
+        if (instr->type != JUMP) {
+            return pc;
+        }
+
+        if (!walker->jump_active[pc]) {
+            walker->jump_active[pc] = true;
+            walker->jump_remaining[pc] = instr->jump.count;
+        }
+
+        if (walker->jump_remaining[pc] > 0) {
+            walker->jump_remaining[pc]--;
+            walker->pc += instr->jump.offset;
+        } else {
+            // Loop finished, the counter is reloaded on the next visit
+            walker->jump_active[pc] = false;
+            walker->pc++;
+        }
+    }
+    return -EINVAL;
+}
+
+#endif
@@ -3,6 +3,76 @@
 #ifndef KERNEL_H
 #define KERNEL_H
 
+// Number of elements a single trigger covers in all banks (16 x 16 f16)
+#define KERNEL_BLOCK_ELEMENTS 256
+
+// Column chunks a GEMV kernel accumulates per pass, bounded so that the cost
+// model can still walk a pass to its EXIT
+#define KERNEL_GEMV_MAX_CHUNKS 256
+
+/**
+ * A kernel variant that the dispatcher can choose from. An elementwise variant
+ * processes 'blocks' consecutive 256-element blocks per kernel invocation.
+ * With 'scale_bank' set the bank operand is multiplied by a scalar first
+ * (only for ADD, see build_kernel_elementwise_scaled).
+ */
+struct kernel_variant {
+    InstructionType opcode;
+    int blocks;
+    bool scale_bank;
+};
+
+/**
+ * Generates an elementwise microkernel for the given opcode (ADD, MUL, MAD or
+ * MAC) that processes 'blocks' blocks per invocation. The layout is one phase
+ * per operand (MOV, [MOV,] OP, FILL) followed by EXIT. Returns -EINVAL if the
+ * block count does not fit the GRF or the instruction slots.
+ */
+int build_kernel_elementwise(Microkernel *kernel, InstructionType opcode,
+                             int blocks);
+
+/**
+ * Generates a kernel computing a + s * b for 'blocks' blocks: SRF_M[0] is
+ * loaded from lane 0 of a constant block, then MOV a into GRF_A, MAD
+ * GRF_B = BANK * SRF_M[0] + GRF_A over b and FILL. With s = -1 this is SUB.
+ */
+int build_kernel_elementwise_scaled(Microkernel *kernel, int blocks);
+
+/**
+ * Generates a GEMV microkernel that loads 'column_blocks' input vector blocks
+ * into GRF_A, runs row_blocks * column_blocks address aligned MACs in a JUMP
+ * loop and writes 'row_blocks' GRF_B accumulators back. With 'chunks' > 1 an
+ * outer JUMP repeats the loads and MACs for that many column chunks before
+ * the FILLs, so the accumulators sum a whole row stripe in the PIM units.
+ */
+int build_kernel_gemv_variant(Microkernel *kernel, int row_blocks,
+                              int column_blocks, unsigned int chunks);
+
+/**
+ * Largest number of blocks an elementwise kernel for the opcode can hold.
+ */
+int kernel_elementwise_max_blocks(InstructionType opcode);
+
+/**
+ * Returns the variant table and its number of entries.
+ */
+size_t get_kernel_variants(const struct kernel_variant **variants);
+
+/**
+ * Searches the variant table for the kernel that processes the most blocks
+ * per invocation without exceeding the vector length. Returns NULL if the
+ * vector is shorter than a single block or the opcode is unsupported.
+ */
+const struct kernel_variant *find_kernel_variant(InstructionType opcode,
+                                                 bool scale_bank,
+                                                 int vector_length);
+
+/**
+ * Builds the microkernel described by a variant table entry.
+ */
+int build_kernel_variant(Microkernel *kernel,
+                         const struct kernel_variant *variant);
+
 int build_kernel_vadd_X1(Microkernel *kernel_vadd);
 int build_kernel_vadd_X2(Microkernel *kernel_vadd);
 int build_kernel_vadd_X3(Microkernel *kernel_vadd);
@@ -16,4 +86,19 @@ int build_kernel_vmul_X4(Microkernel *kernel_vmul);
 
 int build_kernel_gemv(Microkernel *kernel_gemv);
 
-#endif
\ No newline at end of file
+/**
+ * Full size GEMV kernel that accumulates 'chunks' column chunks per pass.
+ */
+int build_kernel_gemv_chunks(Microkernel *kernel_gemv, unsigned int chunks);
+
+/**
+ * Full size kernel for the transposed GEMV y = A^T x on the tiles of A. The
+ * input vector blocks are loaded into GRF_B and broadcast every element of x
+ * across the lanes of its bank, the MACs accumulate the block columns in
+ * GRF_A. The FILLs write 16 partial sums per column, one per bank, and the
+ * 'chunks' tiles of a pass are consecutive block rows of a column stripe.
+ */
+int build_kernel_gemv_transposed(Microkernel *kernel_gemv,
+                                 unsigned int chunks);
+
+#endif
@@ -5,6 +5,21 @@
 
 extern size_t current_start_free_mem_offset;
 
+// Driver owned blocks at the end of the data region
+#define PIM_SCRATCH_BYTES (64 * 1024)
+
+enum pim_scratch_block {
+    // Target of the dummy triggers, zeroed before every op
+    PIM_SCRATCH_DUMMY,
+    // Scalar operand of the scale_bank kernels
+    PIM_SCRATCH_CONSTANT,
+    PIM_SCRATCH_COUNT,
+};
+
+// Start of the scratch area, the allocator and the offsets accepted from
+// user space stop here
+extern size_t pim_scratch_offset;
+
 /**
  * Custom Allocator that allocates an aligned memory block from the static PIM
  * data region using a bump-pointer scheme. It tracks the next available address
@@ -18,4 +33,21 @@ void __iomem *pim_data_region_alloc(size_t size, size_t alignment);
  */
 void __iomem *init_dummy_memory_region(void);
 
+/**
+ * Reserves the last PIM_SCRATCH_BYTES of the data region for the driver and
+ * clears them. Called once the data region is mapped.
+ */
+int pim_scratch_init(void);
+
+/**
+ * Returns a PIM_VECTOR_ALIGNMENT aligned scratch block. Unlike blocks from
+ * pim_data_region_alloc it never overlaps memory that user space owns.
+ */
+void __iomem *pim_scratch_block(enum pim_scratch_block block);
+
+/**
+ * Returns the scratch dummy block with its first element zeroed.
+ */
+void __iomem *pim_scratch_dummy(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef PIM_F16_H
+#define PIM_F16_H
+
+#include "microkernels/kernel_compat.h"
+
+#define F16_SIGN_MASK 0x8000
+#define F16_INFINITY 0x7C00
+#define F16_QUIET_NAN 0x7E00
+
+/*
+ * Software IEEE 754 half precision arithmetic with round to nearest even.
+ * Only integer instructions are used, so these helpers are safe in kernel
+ * context without kernel_neon_begin().
+ */
+
+/**
+ * Rounds sign * magnitude * 2^exponent to the nearest f16 value.
+ */
+uint16_t f16_round(bool negative, uint64_t magnitude, int exponent);
+
+uint16_t f16_add(uint16_t a, uint16_t b);
+
+uint16_t f16_mul(uint16_t a, uint16_t b);
+
+/**
+ * Computes a * b + c with an intermediate rounding after the multiplication,
+ * like the MAC/MAD pipelines of the PIM units.
+ */
+uint16_t f16_mul_add(uint16_t a, uint16_t b, uint16_t c);
+
+#endif
@@ -25,4 +25,11 @@ int set_bank_mode(pim_bank_mode_t bank_mode);
  */
 int set_kernel(kernel_builder_t builder);
 
+/**
+ * Compiles an already built microkernel into a JSON string and writes it into
+ * the PIM_CONFIG region. Returns the number of blocks the kernel processes per
+ * invocation or a negative error code.
+ */
+int set_microkernel(const Microkernel *kernel);
+
 #endif
\ No newline at end of file
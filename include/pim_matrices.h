@@ -10,20 +10,29 @@ extern const int X16_ROWS;
 extern const int X16_COLUMNS;
 extern const int ELEMENT_COUNT_SUBMATRIX;
 
+// Block mask with all X16_ROWS x X16_COLUMNS blocks of a tile set
+#define MATRIX_TILE_ALL_BLOCKS (~(uint64_t)0)
+
 /**
- * Rearranges a flat, row-major matrix into a tiled layout for efficient PIM
- * access. The resulting 'row-major of blocks' format improves data locality for
- * the SIMD architecture.
+ * Returns the mask of the 16x16 blocks of a tile that hold a nonzero element,
+ * bit i * X16_COLUMNS + c for block row i and block column c. The arguments
+ * are those of init_matrix_tiled. A tile that is zero at all returns 0.
  */
-void transform_matrix(const uint16_t *original_matrix,
-                      uint16_t *transformed_matrix);
+uint64_t matrix_tile_block_mask(const uint16_t *tile_origin, size_t stride,
+                                int valid_rows, int valid_cols);
 
 /**
- * Allocates a PIM memory region and writes the transformed matrix data into it.
- * This function handles the transfer from a standard kernel buffer to the
- * memory-mapped PIM device space.
+ * Allocates a PIM memory region for one MATRIX_ROWS x MATRIX_COLS tile and
+ * writes the tile of a row-major matrix into it in the tiled 'row-major of
+ * blocks' layout the GEMV kernel expects, in a single pass over the source.
+ * 'tile_origin' points to the top left element of the tile and 'stride' is
+ * the row pitch of the matrix. Elements at or past 'valid_rows' resp.
+ * 'valid_cols' are written as zeros, so tiles at ragged edges need no padded
+ * copy of the matrix. Only the blocks in 'block_mask' are written, the others
+ * keep stale data and must not be read.
  */
-void __iomem *init_matrix_flat(uint16_t *flat_data_arr,
-                               size_t matrix_logical_size);
+void __iomem *init_matrix_tiled(const uint16_t *tile_origin, size_t stride,
+                                int valid_rows, int valid_cols,
+                                uint64_t block_mask);
 
 #endif
\ No newline at end of file
@@ -18,4 +18,10 @@
 extern volatile u32 __iomem *pim_data_virt_addr;
 extern volatile u8 __iomem *pim_config_virt_addr;
 
+// Size of the mapped data region, smaller than the device when emulated
+extern size_t pim_data_region_size;
+
+// Reference PIM-VM model that replaces the device, NULL on real hardware
+extern struct pim_vm *pim_emulator;
+
 #endif
\ No newline at end of file
@@ -17,6 +17,12 @@ void __iomem *init_vector(uint16_t *arr, size_t length);
  */
 void __iomem *init_vector_result(size_t length);
 
+/**
+ * Allocates a result vector without clearing it, for kernels that overwrite
+ * every element of the destination.
+ */
+void __iomem *alloc_vector_result(size_t length);
+
 /**
  * Initializes the PIM memory for the input vector with a non-contiguous layout
  * required by the execution kernel. It lays out each logical vector block at a
@@ -26,4 +32,12 @@ void __iomem *init_vector_result(size_t length);
 void __iomem *init_vector_interleaved(uint16_t *logical_elements_data,
                                       size_t num_logical_elements);
 
+/**
+ * Same layout as init_vector_interleaved for the transposed GEMV: every
+ * logical block of 16 elements takes one PIM block, element k is repeated
+ * across all lanes of bank k.
+ */
+void __iomem *init_vector_broadcast(const uint16_t *logical_elements_data,
+                                    size_t num_logical_elements);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef PIM_VM_H
+#define PIM_VM_H
+
+#include "microkernels/kernel_datastructures.h"
+#include "microkernels/kernel_walk.h"
+
+/*
+ * Reference model of the PIM-VM. It consumes the same config strings that
+ * set_bank_mode/set_microkernel write and the same trigger reads and writes
+ * that the *_execute functions issue, and executes them against an emulated
+ * data region. The model builds in the kernel module (emulated backend) and
+ * in the userspace tools library.
+ *
+ * Address model: one trigger covers a 512 byte block, split into 16 banks of
+ * 16 f16 lanes each. Every bank has its own PIM unit. In address aligned mode
+ * the GRF_A index is taken from bits [2:0] and the GRF_B index from bits [5:3]
+ * of the block number of the physical address.
+ */
+
+#define PIM_VM_BANKS 16
+#define PIM_VM_LANES 16
+#define PIM_VM_BLOCK_BYTES (PIM_VM_BANKS * PIM_VM_LANES * sizeof(uint16_t))
+#define PIM_VM_CONFIG_MAX 4096
+
+// Physical base of the data region, PIM_DATA_MEMORY_REGION_BASE for userspace
+#define PIM_VM_DATA_PHYS_BASE 0xC0004000UL
+
+enum pim_vm_bank_mode {
+    PIM_VM_SINGLE_BANK,
+    PIM_VM_ALL_BANK,
+    PIM_VM_PIM_ALL_BANK,
+};
+
+struct pim_vm_unit {
+    uint16_t grf_a[GRF_REGISTERS][PIM_VM_LANES];
+    uint16_t grf_b[GRF_REGISTERS][PIM_VM_LANES];
+    uint16_t srf_m[GRF_REGISTERS];
+    uint16_t srf_a[GRF_REGISTERS];
+};
+
+struct pim_vm_stats {
+    uint64_t config_writes;
+    uint64_t triggers;
+    uint64_t pim_triggers;
+    uint64_t instructions[MAD + 1];
+    uint64_t exits;
+    // Triggers whose direction does not match the instruction they hit
+    uint64_t protocol_errors;
+};
+
+struct pim_vm {
+    uint8_t *data;
+    size_t data_size;
+    uint64_t phys_base;
+
+    enum pim_vm_bank_mode bank_mode;
+    Microkernel kernel;
+    bool kernel_loaded;
+    struct kernel_walker walker;
+
+    struct pim_vm_unit units[PIM_VM_BANKS];
+    struct pim_vm_stats stats;
+
+    // Scratch space for config parsing, kept off the (kernel) stack
+    char config[PIM_VM_CONFIG_MAX];
+    Microkernel staged_kernel;
+};
+
+/**
+ * Initializes the model on top of a caller provided data region. 'phys_base'
+ * is the physical address the region stands in for; it is needed to derive
+ * the register indices in address aligned mode.
+ */
+void pim_vm_init(struct pim_vm *vm, void *data, size_t data_size,
+                 uint64_t phys_base);
+
+/**
+ * Resets the program counter, the loop counters and all registers, like an
+ * EXIT does.
+ */
+void pim_vm_reset(struct pim_vm *vm);
+
+/**
+ * Applies a config string as written into the PIM_CONFIG region.
+ */
+int pim_vm_write_config(struct pim_vm *vm, const char *config, size_t length);
+
+/**
+ * Loads a kernel directly, e.g. one decoded from a binary blob, as if it had
+ * been written through the config region.
+ */
+void pim_vm_load_kernel(struct pim_vm *vm, const Microkernel *kernel);
+
+/**
+ * Processes a memory access at 'offset' into the data region. Outside of
+ * PIM_ALL_BANK mode accesses are plain memory accesses and ignored, otherwise
+ * the access triggers the next instruction of the loaded kernel.
+ */
+int pim_vm_trigger(struct pim_vm *vm, size_t offset, bool is_write);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef TRIGGER_PROGRAM_H
+#define TRIGGER_PROGRAM_H
+
+#include <linux/io.h>
+#include <linux/types.h>
+
+#include "microkernels/kernel_plan.h"
+#include "pim_memory_region.h"
+
+/*
+ * A trigger program is the precompiled trigger stream of an op: every entry
+ * holds the data region offset to hit, the access type and the barrier that
+ * follows it. Building it once moves the address arithmetic out of the hot
+ * path, replaying it is a tight loop of MMIO accesses.
+ */
+
+struct trigger_entry {
+    // Offset into the PIM data region
+    uint32_t offset;
+    uint8_t is_write;
+    uint8_t fence;
+};
+
+struct trigger_program {
+    struct trigger_entry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    // Policy the fences were placed for, decides the accessors on replay
+    enum pim_ordering ordering;
+};
+
+/**
+ * Ordering policy selected through the 'ordering' module parameter.
+ */
+enum pim_ordering pim_ordering_policy(void);
+
+/**
+ * Allocates room for 'capacity' triggers. Returns -ENOMEM on failure.
+ */
+int trigger_program_init(struct trigger_program *program, uint32_t capacity,
+                         enum pim_ordering ordering);
+
+void trigger_program_free(struct trigger_program *program);
+
+/**
+ * Appends a trigger at 'address' inside the data region. Returns -ENOSPC if
+ * the program is full.
+ */
+int trigger_program_append(struct trigger_program *program,
+                           const void __iomem *address, bool is_write,
+                           enum trigger_fence fence);
+
+/**
+ * Replaces the barrier after the last trigger, for sequences that close a
+ * phase after appending it.
+ */
+void trigger_program_fence(struct trigger_program *program,
+                           enum trigger_fence fence);
+
+/**
+ * Replays the program against the reference model.
+ */
+void trigger_program_replay_emulated(const struct trigger_program *program);
+
+static inline void
+trigger_program_replay(const struct trigger_program *program) {
+    u8 __iomem *base = (u8 __iomem *)pim_data_virt_addr;
+    const struct trigger_entry *entry = program->entries;
+    const struct trigger_entry *end = entry + program->count;
+    bool relaxed = program->ordering != PIM_ORDER_CONSERVATIVE;
+
+    if (pim_emulator) {
+        trigger_program_replay_emulated(program);
+        return;
+    }
+
+    for (; entry < end; entry++) {
+        // The ordered accessors carry a barrier of their own
+        if (entry->is_write && relaxed) {
+            writeb_relaxed(0, base + entry->offset);
+        } else if (entry->is_write) {
+            iowrite8(0, base + entry->offset);
+        } else if (relaxed) {
+            (void)readb_relaxed(base + entry->offset);
+        } else {
+            (void)ioread8(base + entry->offset);
+        }
+
+        switch (entry->fence) {
+        case TRIGGER_FENCE_READ:
+            rmb();
+            break;
+        case TRIGGER_FENCE_WRITE:
+            wmb();
+            break;
+        case TRIGGER_FENCE_FULL:
+            mb();
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#endif
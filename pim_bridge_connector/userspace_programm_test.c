@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <fcntl.h>
 #include <math.h>
 #include <stdint.h>
@@ -27,6 +28,50 @@ struct pim_vectors {
     uint32_t len;
 };
 
+struct pim_elementwise {
+    uint64_t offset_a;
+    uint64_t offset_b;
+    uint64_t offset_c;
+    uint64_t result_offset;
+    uint32_t len;
+    uint32_t op;
+};
+
+enum pim_elementwise_op { PIM_OP_ADD, PIM_OP_MUL, PIM_OP_SUB, PIM_OP_MAD };
+
+struct pim_view {
+    uint64_t offset;
+    uint32_t element_stride;
+    uint32_t row_stride;
+};
+
+struct pim_elementwise_view {
+    struct pim_view a;
+    struct pim_view b;
+    struct pim_view c;
+    struct pim_view result;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t op;
+};
+
+// Expression node: op 0 = input 'lhs', 1 = lhs + rhs, 2 = lhs * rhs
+struct pim_expr_node {
+    uint8_t op;
+    uint8_t lhs;
+    uint8_t rhs;
+    uint8_t reserved;
+};
+
+struct pim_expression {
+    uint64_t input_offsets[4];
+    uint64_t result_offset;
+    uint32_t len;
+    uint32_t num_inputs;
+    uint32_t num_nodes;
+    struct pim_expr_node nodes[8];
+};
+
 struct pim_gemv {
     uint64_t input_vector_user_addr;
     uint64_t matrix_user_addr;
@@ -36,11 +81,33 @@ struct pim_gemv {
     uint32_t matrix_dim2;
 };
 
+// Epilogue flags: 1 bias, 2 alpha/beta scaling, 4 activation
+struct pim_gemv_epilogue {
+    uint64_t bias_user_addr;
+    uint32_t flags;
+    uint16_t alpha;
+    uint16_t beta;
+    uint16_t negative_slope;
+    uint16_t lower;
+    uint16_t upper;
+    uint16_t reserved;
+};
+
+struct pim_gemv_fused {
+    struct pim_gemv gemv;
+    struct pim_gemv_epilogue epilogue;
+};
+
 #define MAJOR_NUM 100
 #define DEVICE_PATH "/dev/pim_device"
 #define IOCTL_VADD _IOWR(MAJOR_NUM, 2, struct pim_vectors)
 #define IOCTL_VMUL _IOWR(MAJOR_NUM, 3, struct pim_vectors)
 #define IOCTL_GEMV _IOWR(MAJOR_NUM, 4, struct pim_gemv)
+#define IOCTL_ELEMENTWISE _IOWR(MAJOR_NUM, 5, struct pim_elementwise)
+#define IOCTL_EXPRESSION _IOW(MAJOR_NUM, 6, struct pim_expression)
+#define IOCTL_ELEMENTWISE_VIEW _IOW(MAJOR_NUM, 7, struct pim_elementwise_view)
+#define IOCTL_GEMV_FUSED _IOW(MAJOR_NUM, 8, struct pim_gemv_fused)
+#define IOCTL_GEMV_TRANSPOSED _IOW(MAJOR_NUM, 9, struct pim_gemv_fused)
 
 typedef union {
     float f;
@@ -584,8 +651,8 @@ void gemv_with_pim_evaluation(int fd, int rows, int cols) {
 
     // --- Prepare GEMV data ---
     result_vector_gemv = malloc(rows * sizeof(uint16_t));
-    input_vector_data = malloc(128 * sizeof(uint16_t));
-    matrix_data = calloc(rows * 128, sizeof(uint16_t));
+    input_vector_data = malloc(cols * sizeof(uint16_t));
+    matrix_data = calloc((size_t)rows * cols, sizeof(uint16_t));
 
     if (!result_vector_gemv || !input_vector_data || !matrix_data) {
         perror("malloc/calloc for GEMV data failed");
@@ -595,21 +662,21 @@ void gemv_with_pim_evaluation(int fd, int rows, int cols) {
         return;
     }
 
-    for (int i = 0; i < 128; ++i) {
+    for (int i = 0; i < cols; ++i) {
         input_vector_data[i] = float_to_f16(1);
     }
 
     for (int r = 0; r < rows; ++r) {
-        for (int c = 0; c < 128; ++c) { // Since we are in Evaluation Mode
+        for (int c = 0; c < cols; ++c) {
             if (r >= c) {
-                matrix_data[(size_t)r * 128 + c] = float_to_f16(1);
+                matrix_data[(size_t)r * cols + c] = float_to_f16(1);
             }
         }
     }
 
     pim_gemv_desc.input_vector_user_addr = (uint64_t)input_vector_data;
     pim_gemv_desc.matrix_user_addr = (uint64_t)matrix_data;
-    pim_gemv_desc.input_vector_len = 128;
+    pim_gemv_desc.input_vector_len = cols;
     pim_gemv_desc.result_vector_user_addr = (uint64_t)result_vector_gemv;
     pim_gemv_desc.matrix_dim1 = rows;
     pim_gemv_desc.matrix_dim2 = cols;
@@ -619,8 +686,8 @@ void gemv_with_pim_evaluation(int fd, int rows, int cols) {
         perror("ioctl(IOCTL_GEMV) failed");
     } else {
         system("gem5-bridge --addr=0x10010000 dumpstats");
-        print_gemv_operation("GEMV", input_vector_data, 128, matrix_data, rows,
-                             128, result_vector_gemv, rows);
+        print_gemv_operation("GEMV", input_vector_data, cols, matrix_data, rows,
+                             cols, result_vector_gemv, rows);
     }
 
     free(result_vector_gemv);
@@ -628,6 +695,638 @@ void gemv_with_pim_evaluation(int fd, int rows, int cols) {
     free(matrix_data);
 }
 
+float random_f16_value(float range) {
+    return f16_to_float(float_to_f16(range * (rand() % 2001 - 1000) / 1000));
+}
+
+// Rounds an intermediate result to f16 like the PIM units do after every op
+float round_to_f16(float value) {
+    return f16_to_float(float_to_f16(value));
+}
+
+// Counts the results that differ from the host reference by more than
+// 'tolerance' times 'magnitude' (or the reference itself if it is NULL)
+int check_results(const char *title, const uint16_t *result,
+                  const float *expected, const float *magnitude,
+                  uint32_t len, float tolerance) {
+    int mismatches = 0;
+
+    for (uint32_t i = 0; i < len; i++) {
+        float got = f16_to_float(result[i]);
+        float scale = magnitude ? magnitude[i] : fabsf(expected[i]);
+
+        if (!(fabsf(got - expected[i]) <= tolerance * scale + 1e-3f)) {
+            if (mismatches < 5) {
+                printf(COLOR_RED "  [%u] got %f, expected %f\n" COLOR_RESET,
+                       i, got, expected[i]);
+            }
+            mismatches++;
+        }
+    }
+
+    if (mismatches) {
+        printf(COLOR_RED "%s: %d of %u results wrong\n" COLOR_RESET, title,
+               mismatches, len);
+    } else {
+        printf(COLOR_GREEN "%s: %u results ok\n" COLOR_RESET, title, len);
+    }
+    return mismatches;
+}
+
+struct expression_case {
+    const char *title;
+    uint32_t num_inputs;
+    uint32_t num_nodes;
+    struct pim_expr_node nodes[8];
+};
+
+static const struct expression_case expression_cases[] = {
+    {"(a + b) * c", 3, 5, {{0, 0}, {0, 1}, {1, 0, 1}, {0, 2}, {2, 2, 3}}},
+    {"a * b + c * d",
+     4,
+     7,
+     {{0, 0}, {0, 1}, {2, 0, 1}, {0, 2}, {0, 3}, {2, 3, 4}, {1, 2, 5}}},
+};
+
+static const char *const elementwise_op_names[] = {"add", "mul", "sub",
+                                                   "mad"};
+
+// Rounds every op like the PIM units, MAD rounds the product first
+float elementwise_reference(uint32_t op, float a, float b, float c,
+                            float *magnitude) {
+    switch (op) {
+    case PIM_OP_ADD:
+        *magnitude = fabsf(a) + fabsf(b);
+        return round_to_f16(a + b);
+    case PIM_OP_MUL:
+        *magnitude = fabsf(a * b);
+        return round_to_f16(a * b);
+    case PIM_OP_SUB:
+        *magnitude = fabsf(a) + fabsf(b);
+        return round_to_f16(a - b);
+    default:
+        *magnitude = fabsf(a * b) + fabsf(c);
+        return round_to_f16(round_to_f16(a * b) + c);
+    }
+}
+
+void test_elementwise(int fd, uint32_t len) {
+    size_t stride = ((len * sizeof(uint16_t) + 511) / 512) * 512;
+    size_t map_size = 4 * stride;
+    float *expected = malloc(len * sizeof(float));
+    float *magnitude = malloc(len * sizeof(float));
+    uint16_t *region =
+        mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    uint16_t *vectors[4];
+
+    printf(STYLE_BOLD "\n--- Elementwise Test: %u elements ---\n" COLOR_RESET,
+           len);
+    if (region == MAP_FAILED || !expected || !magnitude) {
+        perror("mmap/malloc for the elementwise test failed");
+        free(expected);
+        free(magnitude);
+        return;
+    }
+
+    // a, b, c and the result, one block aligned vector each
+    for (int v = 0; v < 4; v++) {
+        vectors[v] = (uint16_t *)((char *)region + v * stride);
+    }
+    for (int v = 0; v < 3; v++) {
+        for (uint32_t i = 0; i < len; i++) {
+            vectors[v][i] = float_to_f16(random_f16_value(4.0f));
+        }
+    }
+
+    for (uint32_t op = PIM_OP_ADD; op <= PIM_OP_MAD; op++) {
+        struct pim_elementwise desc = {0};
+
+        desc.offset_a = 0;
+        desc.offset_b = stride;
+        desc.offset_c = 2 * stride;
+        desc.result_offset = 3 * stride;
+        desc.len = len;
+        desc.op = op;
+
+        for (uint32_t i = 0; i < len; i++) {
+            expected[i] = elementwise_reference(
+                op, f16_to_float(vectors[0][i]), f16_to_float(vectors[1][i]),
+                f16_to_float(vectors[2][i]), &magnitude[i]);
+        }
+
+        if (ioctl(fd, IOCTL_ELEMENTWISE, &desc) < 0) {
+            perror("ioctl(IOCTL_ELEMENTWISE) failed");
+            continue;
+        }
+        check_results(elementwise_op_names[op], vectors[3], expected,
+                      magnitude, len, 1e-2f);
+    }
+
+    munmap(region, map_size);
+    free(expected);
+    free(magnitude);
+}
+
+// Runs a += b and c += a * b in place and checks that a result which
+// partially overlaps an operand is rejected
+void test_elementwise_in_place(int fd, uint32_t len) {
+    size_t stride = ((len * sizeof(uint16_t) + 511) / 512) * 512;
+    size_t map_size = 3 * stride;
+    float *expected = malloc(len * sizeof(float));
+    float *magnitude = malloc(len * sizeof(float));
+    uint16_t *region =
+        mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    struct pim_elementwise desc = {0};
+    uint16_t *a = region;
+    uint16_t *b = (uint16_t *)((char *)region + stride);
+    uint16_t *c = (uint16_t *)((char *)region + 2 * stride);
+
+    printf(STYLE_BOLD "\n--- In Place Elementwise Test: %u elements ---\n"
+           COLOR_RESET, len);
+    if (region == MAP_FAILED || !expected || !magnitude) {
+        perror("mmap/malloc for the in place test failed");
+        free(expected);
+        free(magnitude);
+        return;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        a[i] = float_to_f16(random_f16_value(4.0f));
+        b[i] = float_to_f16(random_f16_value(4.0f));
+        c[i] = float_to_f16(random_f16_value(4.0f));
+    }
+    desc.offset_a = 0;
+    desc.offset_b = stride;
+    desc.offset_c = 2 * stride;
+    desc.len = len;
+
+    // a += b
+    for (uint32_t i = 0; i < len; i++) {
+        expected[i] = elementwise_reference(PIM_OP_ADD, f16_to_float(a[i]),
+                                            f16_to_float(b[i]), 0,
+                                            &magnitude[i]);
+    }
+    desc.result_offset = desc.offset_a;
+    desc.op = PIM_OP_ADD;
+    if (ioctl(fd, IOCTL_ELEMENTWISE, &desc) < 0) {
+        perror("ioctl(IOCTL_ELEMENTWISE) failed");
+    } else {
+        check_results("a += b", a, expected, magnitude, len, 1e-2f);
+    }
+
+    // c += a * b
+    for (uint32_t i = 0; i < len; i++) {
+        expected[i] = elementwise_reference(
+            PIM_OP_MAD, f16_to_float(a[i]), f16_to_float(b[i]),
+            f16_to_float(c[i]), &magnitude[i]);
+    }
+    desc.result_offset = desc.offset_c;
+    desc.op = PIM_OP_MAD;
+    if (ioctl(fd, IOCTL_ELEMENTWISE, &desc) < 0) {
+        perror("ioctl(IOCTL_ELEMENTWISE) failed");
+    } else {
+        check_results("c += a * b", c, expected, magnitude, len, 1e-2f);
+    }
+
+    // A result one block behind a overlaps it partially, vectors of a single
+    // block cannot overlap at aligned offsets
+    if (len > 256) {
+        desc.result_offset = desc.offset_a + 512;
+        desc.op = PIM_OP_ADD;
+        if (ioctl(fd, IOCTL_ELEMENTWISE, &desc) == 0 || errno != EINVAL) {
+            printf(COLOR_RED "partially overlapping result was accepted\n"
+                   COLOR_RESET);
+        } else {
+            printf(COLOR_GREEN "partially overlapping result rejected\n"
+                   COLOR_RESET);
+        }
+    }
+
+    munmap(region, map_size);
+    free(expected);
+    free(magnitude);
+}
+
+void test_expression(int fd, uint32_t len) {
+    size_t stride = ((len * sizeof(uint16_t) + 511) / 512) * 512;
+    size_t map_size = 5 * stride;
+    float *expected = malloc(len * sizeof(float));
+    float *magnitude = malloc(len * sizeof(float));
+    uint16_t *region =
+        mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    printf(STYLE_BOLD "\n--- Expression Test: %u elements ---\n" COLOR_RESET,
+           len);
+    if (region == MAP_FAILED || !expected || !magnitude) {
+        perror("mmap/malloc for the expression test failed");
+        free(expected);
+        free(magnitude);
+        return;
+    }
+
+    // Inputs 0..3 and the result, one block aligned vector each
+    for (int v = 0; v < 4; v++) {
+        uint16_t *input = (uint16_t *)((char *)region + v * stride);
+
+        for (uint32_t i = 0; i < len; i++) {
+            input[i] = float_to_f16(random_f16_value(2.0f));
+        }
+    }
+
+    for (int t = 0;
+         t < sizeof(expression_cases) / sizeof(expression_cases[0]); t++) {
+        const struct expression_case *test = &expression_cases[t];
+        uint16_t *result = (uint16_t *)((char *)region + 4 * stride);
+        struct pim_expression desc = {0};
+
+        for (int v = 0; v < 4; v++) {
+            desc.input_offsets[v] = v * stride;
+        }
+        desc.result_offset = 4 * stride;
+        desc.len = len;
+        desc.num_inputs = test->num_inputs;
+        desc.num_nodes = test->num_nodes;
+        memcpy(desc.nodes, test->nodes, sizeof(desc.nodes));
+
+        if (ioctl(fd, IOCTL_EXPRESSION, &desc) < 0) {
+            perror("ioctl(IOCTL_EXPRESSION) failed");
+            continue;
+        }
+
+        // Evaluate the DAG node by node with f16 intermediates, the
+        // magnitudes bound the rounding errors of sums that cancel
+        for (uint32_t i = 0; i < len; i++) {
+            float values[8];
+            float sizes[8];
+
+            for (int n = 0; n < test->num_nodes; n++) {
+                const struct pim_expr_node *node = &test->nodes[n];
+
+                if (node->op == 0) {
+                    values[n] = f16_to_float(
+                        ((uint16_t *)((char *)region +
+                                      node->lhs * stride))[i]);
+                    sizes[n] = fabsf(values[n]);
+                } else if (node->op == 1) {
+                    values[n] =
+                        round_to_f16(values[node->lhs] + values[node->rhs]);
+                    sizes[n] = sizes[node->lhs] + sizes[node->rhs];
+                } else {
+                    values[n] =
+                        round_to_f16(values[node->lhs] * values[node->rhs]);
+                    sizes[n] = sizes[node->lhs] * sizes[node->rhs];
+                }
+            }
+            expected[i] = values[test->num_nodes - 1];
+            magnitude[i] = sizes[test->num_nodes - 1];
+        }
+        check_results(test->title, result, expected, magnitude, len, 1e-2f);
+    }
+
+    munmap(region, map_size);
+    free(expected);
+    free(magnitude);
+}
+
+// Every operand of the view tests gets its own 32 KiB area of the mapping
+#define VIEW_AREA_BYTES (32 * 1024)
+
+static uint16_t *view_element(uint16_t *region, const struct pim_view *view,
+                              uint32_t row, uint32_t col) {
+    return (uint16_t *)((char *)region + view->offset) +
+           (size_t)row * view->row_stride + (size_t)col * view->element_stride;
+}
+
+void test_elementwise_view_case(int fd, uint16_t *region, const char *title,
+                                struct pim_elementwise_view *desc) {
+    uint32_t len = desc->rows * desc->cols;
+    float *expected = malloc(len * sizeof(float));
+    float *magnitude = malloc(len * sizeof(float));
+    uint16_t *result = malloc(len * sizeof(uint16_t));
+
+    if (!expected || !magnitude || !result) {
+        perror("malloc for the view test failed");
+        goto out;
+    }
+
+    memset(region, 0, 4 * VIEW_AREA_BYTES);
+    for (uint32_t r = 0; r < desc->rows; r++) {
+        for (uint32_t k = 0; k < desc->cols; k++) {
+            *view_element(region, &desc->a, r, k) =
+                float_to_f16(random_f16_value(4.0f));
+            *view_element(region, &desc->b, r, k) =
+                float_to_f16(random_f16_value(4.0f));
+            if (desc->op == PIM_OP_MAD) {
+                *view_element(region, &desc->c, r, k) =
+                    float_to_f16(random_f16_value(4.0f));
+            }
+        }
+    }
+
+    for (uint32_t r = 0; r < desc->rows; r++) {
+        for (uint32_t k = 0; k < desc->cols; k++) {
+            float a = f16_to_float(*view_element(region, &desc->a, r, k));
+            float b = f16_to_float(*view_element(region, &desc->b, r, k));
+            float c = f16_to_float(*view_element(region, &desc->c, r, k));
+            uint32_t i = r * desc->cols + k;
+
+            switch (desc->op) {
+            case PIM_OP_ADD:
+                expected[i] = round_to_f16(a + b);
+                magnitude[i] = fabsf(a) + fabsf(b);
+                break;
+            case PIM_OP_SUB:
+                expected[i] = round_to_f16(a - b);
+                magnitude[i] = fabsf(a) + fabsf(b);
+                break;
+            case PIM_OP_MUL:
+                expected[i] = round_to_f16(a * b);
+                magnitude[i] = fabsf(a * b);
+                break;
+            default:
+                expected[i] = round_to_f16(round_to_f16(a * b) + c);
+                magnitude[i] = fabsf(a * b) + fabsf(c);
+                break;
+            }
+        }
+    }
+
+    if (ioctl(fd, IOCTL_ELEMENTWISE_VIEW, desc) < 0) {
+        perror("ioctl(IOCTL_ELEMENTWISE_VIEW) failed");
+        goto out;
+    }
+
+    for (uint32_t r = 0; r < desc->rows; r++) {
+        for (uint32_t k = 0; k < desc->cols; k++) {
+            result[r * desc->cols + k] =
+                *view_element(region, &desc->result, r, k);
+        }
+    }
+    check_results(title, result, expected, magnitude, len, 1e-2f);
+
+out:
+    free(expected);
+    free(magnitude);
+    free(result);
+}
+
+void test_elementwise_view(int fd) {
+    size_t map_size = 4 * VIEW_AREA_BYTES;
+    uint16_t *region =
+        mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    struct pim_elementwise_view desc;
+
+    printf(STYLE_BOLD "\n--- Elementwise View Test ---\n" COLOR_RESET);
+    if (region == MAP_FAILED) {
+        perror("mmap for the view test failed");
+        return;
+    }
+
+    // Every second element of 'a' against a dense 'b', runs on the host
+    memset(&desc, 0, sizeof(desc));
+    desc.a = (struct pim_view){0, 2, 700};
+    desc.b = (struct pim_view){VIEW_AREA_BYTES + 6, 1, 300};
+    desc.result = (struct pim_view){2 * VIEW_AREA_BYTES, 1, 300};
+    desc.rows = 4;
+    desc.cols = 300;
+    desc.op = PIM_OP_SUB;
+    test_elementwise_view_case(fd, region, "strided view", &desc);
+
+    // Rows of 600 elements with a pitch of 3 blocks, runs on the PIM units
+    memset(&desc, 0, sizeof(desc));
+    desc.a = (struct pim_view){0, 1, 768};
+    desc.b = (struct pim_view){VIEW_AREA_BYTES, 1, 768};
+    desc.c = (struct pim_view){2 * VIEW_AREA_BYTES, 1, 768};
+    desc.result = (struct pim_view){3 * VIEW_AREA_BYTES, 1, 768};
+    desc.rows = 8;
+    desc.cols = 600;
+    desc.op = PIM_OP_MAD;
+    test_elementwise_view_case(fd, region, "row pitch view", &desc);
+
+    // Offsets past the region, one of them wraps around with the extent
+    desc.result.offset = UINT64_MAX - 255;
+    if (ioctl(fd, IOCTL_ELEMENTWISE_VIEW, &desc) == 0 || errno != EINVAL) {
+        printf(COLOR_RED "wrapping result offset was accepted\n" COLOR_RESET);
+    } else {
+        printf(COLOR_GREEN "wrapping result offset rejected\n" COLOR_RESET);
+    }
+    desc.result.offset = 3 * VIEW_AREA_BYTES;
+    desc.a.offset = 1ULL << 40;
+    if (ioctl(fd, IOCTL_ELEMENTWISE_VIEW, &desc) == 0 || errno != EINVAL) {
+        printf(COLOR_RED "out of range offset was accepted\n" COLOR_RESET);
+    } else {
+        printf(COLOR_GREEN "out of range offset rejected\n" COLOR_RESET);
+    }
+
+    munmap(region, map_size);
+}
+
+// Applies the epilogue to a product on the host, rounding like the f16 units
+float epilogue_reference(const struct pim_gemv_epilogue *epilogue, float bias,
+                         float value) {
+    float alpha = f16_to_float(epilogue->alpha);
+    float beta = f16_to_float(epilogue->beta);
+
+    value = round_to_f16(value);
+    if (epilogue->flags & 1) {
+        if (epilogue->flags & 2) {
+            value = round_to_f16(alpha * value + round_to_f16(beta * bias));
+        } else {
+            value = round_to_f16(value + bias);
+        }
+    } else if (epilogue->flags & 2) {
+        value = round_to_f16(alpha * value);
+    }
+
+    if (epilogue->flags & 4) {
+        float slope = f16_to_float(epilogue->negative_slope);
+
+        if (value < 0) {
+            value = round_to_f16(value * slope);
+        }
+        value = fmaxf(value, f16_to_float(epilogue->lower));
+        value = fminf(value, f16_to_float(epilogue->upper));
+    }
+    return value;
+}
+
+// Runs IOCTL_GEMV_FUSED, or IOCTL_GEMV_TRANSPOSED with 'transposed', on a
+// row major matrix and compares the result with the epilogue applied to
+// matrix_vector_mul on the host
+void check_gemv_fused(int fd, const char *title, const uint16_t *matrix,
+                      uint32_t rows, uint32_t cols, int transposed,
+                      struct pim_gemv_epilogue *epilogue) {
+    size_t elements = (size_t)rows * cols;
+    uint32_t in_len = transposed ? rows : cols;
+    uint32_t out_len = transposed ? cols : rows;
+    uint16_t *vector = malloc(in_len * sizeof(uint16_t));
+    uint16_t *bias = malloc(out_len * sizeof(uint16_t));
+    uint16_t *result = malloc(out_len * sizeof(uint16_t));
+    float *matrix_f = malloc(elements * sizeof(float));
+    float *matrix_abs = malloc(elements * sizeof(float));
+    float *vector_f = malloc(in_len * sizeof(float));
+    float *vector_abs = malloc(in_len * sizeof(float));
+    float *expected = malloc(out_len * sizeof(float));
+    float *magnitude = malloc(out_len * sizeof(float));
+    struct pim_gemv_fused desc;
+
+    if (!vector || !bias || !result || !matrix_f || !matrix_abs ||
+        !vector_f || !vector_abs || !expected || !magnitude) {
+        perror("malloc for the fused GEMV test failed");
+        goto out;
+    }
+
+    for (uint32_t i = 0; i < in_len; i++) {
+        vector_f[i] = random_f16_value(1.0f);
+        vector_abs[i] = fabsf(vector_f[i]);
+        vector[i] = float_to_f16(vector_f[i]);
+    }
+    for (uint32_t i = 0; i < out_len; i++) {
+        bias[i] = float_to_f16(random_f16_value(4.0f));
+    }
+    // The host reference multiplies an explicitly transposed copy
+    for (uint32_t r = 0; r < rows; r++) {
+        for (uint32_t c = 0; c < cols; c++) {
+            size_t i = transposed ? (size_t)c * rows + r : (size_t)r * cols + c;
+
+            matrix_f[i] = f16_to_float(matrix[(size_t)r * cols + c]);
+            matrix_abs[i] = fabsf(matrix_f[i]);
+        }
+    }
+
+    // The magnitude of every row bounds the f16 rounding of its partial sums
+    matrix_vector_mul(matrix_f, vector_f, expected, out_len, in_len);
+    matrix_vector_mul(matrix_abs, vector_abs, magnitude, out_len, in_len);
+    for (uint32_t i = 0; i < out_len; i++) {
+        float b = f16_to_float(bias[i]);
+
+        expected[i] = epilogue_reference(epilogue, b, expected[i]);
+        if (epilogue->flags & 2) {
+            magnitude[i] = fabsf(f16_to_float(epilogue->alpha)) * magnitude[i] +
+                           fabsf(f16_to_float(epilogue->beta) * b);
+        } else {
+            magnitude[i] += fabsf(b);
+        }
+    }
+
+    epilogue->bias_user_addr = (uint64_t)bias;
+    desc.gemv.input_vector_user_addr = (uint64_t)vector;
+    desc.gemv.matrix_user_addr = (uint64_t)matrix;
+    desc.gemv.result_vector_user_addr = (uint64_t)result;
+    desc.gemv.input_vector_len = in_len;
+    desc.gemv.matrix_dim1 = rows;
+    desc.gemv.matrix_dim2 = cols;
+    desc.epilogue = *epilogue;
+
+    if (ioctl(fd, transposed ? IOCTL_GEMV_TRANSPOSED : IOCTL_GEMV_FUSED,
+              &desc) < 0) {
+        perror(transposed ? "ioctl(IOCTL_GEMV_TRANSPOSED) failed"
+                          : "ioctl(IOCTL_GEMV_FUSED) failed");
+    } else {
+        check_results(title, result, expected, magnitude, out_len, 2e-2f);
+    }
+
+out:
+    free(vector);
+    free(bias);
+    free(result);
+    free(matrix_f);
+    free(matrix_abs);
+    free(vector_f);
+    free(vector_abs);
+    free(expected);
+    free(magnitude);
+}
+
+uint16_t *random_f16_matrix(uint32_t rows, uint32_t cols) {
+    uint16_t *matrix = malloc((size_t)rows * cols * sizeof(uint16_t));
+
+    if (!matrix) {
+        perror("malloc for the GEMV matrix failed");
+        return NULL;
+    }
+    for (size_t i = 0; i < (size_t)rows * cols; i++) {
+        matrix[i] = float_to_f16(random_f16_value(1.0f));
+    }
+    return matrix;
+}
+
+void test_gemv_fused(int fd, uint32_t rows, uint32_t cols) {
+    uint16_t *matrix = random_f16_matrix(rows, cols);
+    struct pim_gemv_epilogue epilogue = {0};
+
+    printf(STYLE_BOLD "\n--- Fused GEMV Test: %u x %u ---\n" COLOR_RESET, rows,
+           cols);
+    if (!matrix) {
+        return;
+    }
+
+    epilogue.flags = 1;
+    check_gemv_fused(fd, "bias", matrix, rows, cols, 0, &epilogue);
+
+    // ReLU, y = max(0.5 * W x - 2 * bias, 0)
+    epilogue.flags = 1 | 2 | 4;
+    epilogue.alpha = float_to_f16(0.5f);
+    epilogue.beta = float_to_f16(-2.0f);
+    epilogue.negative_slope = 0;
+    epilogue.lower = 0xFC00;
+    epilogue.upper = 0x7C00;
+    check_gemv_fused(fd, "bias + alpha/beta + ReLU", matrix, rows, cols, 0,
+                     &epilogue);
+
+    // ReLU6, y = min(max(2 * W x + bias, 0), 6)
+    epilogue.alpha = float_to_f16(2.0f);
+    epilogue.beta = float_to_f16(1.0f);
+    epilogue.lower = 0;
+    epilogue.upper = float_to_f16(6.0f);
+    check_gemv_fused(fd, "bias + alpha/beta + ReLU6", matrix, rows, cols,
+                     0, &epilogue);
+
+    free(matrix);
+}
+
+// Zeroes a random half of the 16 x 16 blocks and the first 128 x 128 tile,
+// so whole tiles and single blocks of the partial sums are skipped
+void make_block_sparse(uint16_t *matrix, uint32_t rows, uint32_t cols) {
+    for (uint32_t r = 0; r < rows; r += 16) {
+        for (uint32_t c = 0; c < cols; c += 16) {
+            int zero = (r < 128 && c < 128) || rand() % 2;
+
+            for (uint32_t i = r; zero && i < r + 16 && i < rows; i++) {
+                for (uint32_t k = c; k < c + 16 && k < cols; k++) {
+                    matrix[(size_t)i * cols + k] = 0;
+                }
+            }
+        }
+    }
+}
+
+void test_gemv_transposed(int fd, uint32_t rows, uint32_t cols, int sparse) {
+    uint16_t *matrix = random_f16_matrix(rows, cols);
+    struct pim_gemv_epilogue epilogue = {0};
+
+    printf(STYLE_BOLD "\n--- Transposed GEMV Test: %u x %u%s ---\n" COLOR_RESET,
+           rows, cols, sparse ? ", block sparse" : "");
+    if (!matrix) {
+        return;
+    }
+    if (sparse) {
+        make_block_sparse(matrix, rows, cols);
+    }
+
+    check_gemv_fused(fd, "A^T x", matrix, rows, cols, 1, &epilogue);
+
+    epilogue.flags = 1 | 2 | 4;
+    epilogue.alpha = float_to_f16(0.5f);
+    epilogue.beta = float_to_f16(-2.0f);
+    epilogue.lower = 0xFC00;
+    epilogue.upper = 0x7C00;
+    check_gemv_fused(fd, "A^T x + bias + alpha/beta + ReLU", matrix, rows,
+                     cols, 1, &epilogue);
+
+    free(matrix);
+}
+
 int main() {
     int fd = -1;
 
@@ -638,6 +1337,24 @@ int main() {
         goto cleanup;
     }
 
+    // Checks against the host reference
+    test_elementwise(fd, 1 << 16);
+    // Leftover blocks run on smaller kernel variants, the tail on the host
+    test_elementwise(fd, 768);
+    test_elementwise(fd, 1500);
+    test_elementwise(fd, 100);
+    test_elementwise(fd, (1 << 16) + 7 * 256 + 3);
+    test_elementwise_in_place(fd, 4096 + 100);
+    test_expression(fd, 4096 + 100);
+    test_elementwise_view(fd);
+    // The GEMV checks need the module loaded without gemv_evaluation
+    test_gemv_fused(fd, 300, 200);
+    test_gemv_fused(fd, 129, 300);
+    test_gemv_transposed(fd, 300, 200, 0);
+    test_gemv_transposed(fd, 129, 300, 0);
+    test_gemv_transposed(fd, 40, 1000, 0);
+    test_gemv_transposed(fd, 384, 300, 1);
+
     vadd_with_pim_evaluation(fd, 1 << 18);
     vadd_with_pim_evaluation(fd, 1 << 19);
     vadd_with_pim_evaluation(fd, 1 << 20);
@@ -658,6 +1375,8 @@ int main() {
     // vmul_userspace_evaluation(1 << 20);
     // vmul_userspace_evaluation(1 << 21);
 
+    // Benchmarks the GEMV, load the module with gemv_evaluation=1 to replay
+    // the first 128 columns instead of computing the full product
     gemv_with_pim_evaluation(fd, 1024, 4096);
     gemv_with_pim_evaluation(fd, 2048, 4096);
     gemv_with_pim_evaluation(fd, 4096, 8192);
@@ -669,8 +1388,8 @@ int main() {
     // gemv_userspace_evaluation(8192, 8192);
 
     // This can be used for normal operation, when no evaluation has to be made
-    // But be careful, the Evaluation Mode has to be unset in gemv.c in the
-    // module, otherwise GEMV not functioning correctly
+    // Load the module without gemv_evaluation (the default), otherwise GEMV
+    // only replays the first 128 columns
 
     // gemv_arbitrary_dims(fd,1024, 4096);
     // test_vadd_negative(fd, vector_len);
@@ -0,0 +1,1067 @@
+#include <linux/err.h>
+#include <linux/mutex.h>
+#include <linux/overflow.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "../../include/bins.h"
+#include "../../include/cpu_fallback.h"
+#include "../../include/microkernels/kernel_cost.h"
+#include "../../include/microkernels/kernel_datastructures.h"
+#include "../../include/microkernels/kernel_expr.h"
+#include "../../include/microkernels/kernel_plan.h"
+#include "../../include/microkernels/kernel_to_string.h"
+#include "../../include/microkernels/kernels.h"
+#include "../../include/pim_configs.h"
+#include "../../include/pim_data_allocator.h"
+#include "../../include/pim_f16.h"
+#include "../../include/pim_init_state.h"
+#include "../../include/pim_memory_region.h"
+#include "../../include/pim_vectors.h"
+#include "../../include/trigger_program.h"
+
+// For Testing => Contains f16-Floats in UINT16-Format
+#include "../../testing_helper/f16_lut.h"
+
+// Bytes covered by a single trigger (16 banks with 16 lanes each)
+#define ELEMENTWISE_BLOCK_BYTES (KERNEL_BLOCK_ELEMENTS * sizeof(uint16_t))
+
+// Compiled programs kept for repeated calls with the same placement
+#define ELEMENTWISE_CACHE_ENTRIES 4
+
+// One segment per kernel variant, 8 + 4 + 2 + 1 blocks at most
+#define ELEMENTWISE_MAX_SEGMENTS 4
+
+// Trigger streams of the elementwise (KERNEL_STREAM_*) and expression
+// (KERNEL_EXPR_STREAM_*) kernels
+#define ELEMENTWISE_MAX_STREAMS 8
+
+// Elements gathered per round trip for views the PIM units cannot address
+#define ELEMENTWISE_VIEW_CHUNK 256
+
+// Room for the JSON config of a full microkernel, as in set_microkernel
+#define ELEMENTWISE_CONFIG_BYTES 2048
+
+// f16 representation of -1.0
+#define F16_MINUS_ONE 0xBC00
+
+/**
+ * Describes how an op maps onto a kernel family. Adding an op only needs a
+ * new entry here as long as its kernel loads the operands the way the trigger
+ * plan expects (see kernel_plan_build).
+ */
+struct elementwise_op_desc {
+    const char *name;
+    InstructionType opcode;
+    // Kernel multiplies the bank operand by a scalar in SRF_M[0]
+    bool scale_bank;
+    int num_inputs;
+    // Scalar placed in the constant block for scale_bank kernels
+    uint16_t constant;
+};
+
+static const struct elementwise_op_desc elementwise_ops[PIM_OP_COUNT] = {
+    [PIM_OP_ADD] = {"add", ADD, false, 2, 0},
+    [PIM_OP_MUL] = {"mul", MUL, false, 2, 0},
+    // a - b = a + (-1.0) * b
+    [PIM_OP_SUB] = {"sub", ADD, true, 2, F16_MINUS_ONE},
+    [PIM_OP_MAD] = {"mad", MAD, false, 3, 0},
+};
+
+/**
+ * Where the blocks of the streams lie. Block j of a stepping stream is at
+ * base + (j / blocks_per_row) * row_pitch + (j % blocks_per_row) * 512, the
+ * other streams always hit their base. A contiguous vector is a single row.
+ */
+struct elementwise_layout {
+    uint32_t stepping;
+    uint32_t blocks_per_row;
+    uint64_t row_pitch[ELEMENTWISE_MAX_STREAMS];
+};
+
+/**
+ * Everything a compiled program depends on. The scratch blocks lie at fixed
+ * offsets of the reserved scratch area. Expressions use op PIM_OP_COUNT and
+ * their nodes, the node fields stay zero for the elementwise ops.
+ */
+struct elementwise_key {
+    uint32_t op;
+    // Elements per row and number of rows
+    uint32_t len;
+    uint32_t rows;
+    uint32_t ordering;
+    uint64_t offsets[ELEMENTWISE_MAX_STREAMS];
+    uint64_t row_pitch[KERNEL_STREAM_COUNT];
+    uint32_t num_inputs;
+    uint32_t num_nodes;
+    struct kernel_expr_node nodes[KERNEL_EXPR_MAX_NODES];
+};
+
+struct elementwise_segment {
+    Microkernel kernel;
+    // JSON config of the kernel, serialized once when the segment is built
+    char *config;
+    int config_len;
+    struct trigger_program triggers;
+};
+
+struct elementwise_program {
+    struct elementwise_key key;
+    bool valid;
+    uint64_t last_used;
+    // Variant the cost model picked for the key and its estimate, the
+    // segments are only compiled once the op runs on the PIM units
+    const struct kernel_variant *variant;
+    uint64_t estimated_ns;
+    bool compiled;
+    int num_segments;
+    struct elementwise_segment segments[ELEMENTWISE_MAX_SEGMENTS];
+};
+
+static struct elementwise_program program_cache[ELEMENTWISE_CACHE_ENTRIES];
+static uint64_t program_cache_clock;
+static DEFINE_MUTEX(program_cache_lock);
+
+/**
+ * Appends 'launches' kernel invocations starting at block 'first_block' of
+ * the streams to the program. Invocation l covers blocks
+ * first_block + l * blocks onwards.
+ */
+static int compile_launches(struct trigger_program *program,
+                            const struct kernel_plan_step *steps, int count,
+                            int blocks, uint8_t __iomem *const *bases,
+                            const struct elementwise_layout *layout,
+                            uint32_t first_block, uint32_t launches) {
+    for (uint32_t l = 0; l < launches; l++) {
+        uint32_t launch_block = first_block + l * blocks;
+
+        for (int i = 0; i < count; i++) {
+            const struct kernel_plan_step *step = &steps[i];
+            uint8_t __iomem *address = bases[step->stream];
+            uint32_t block = launch_block + step->block;
+            int ret;
+
+            if (layout->stepping & (1u << step->stream)) {
+                address += (block / layout->blocks_per_row) *
+                               layout->row_pitch[step->stream] +
+                           (size_t)(block % layout->blocks_per_row) *
+                               ELEMENTWISE_BLOCK_BYTES;
+            }
+
+            ret = trigger_program_append(program, address, step->is_write,
+                                         step->fence);
+            if (ret) {
+                return ret;
+            }
+        }
+    }
+
+    // The batch policy only orders the whole batch against what follows
+    if (program->ordering == PIM_ORDER_BATCH) {
+        trigger_program_fence(program, TRIGGER_FENCE_FULL);
+    }
+    return 0;
+}
+
+/**
+ * Checks that the plan of a kernel addresses exactly the operands of the op.
+ */
+static int check_plan(const struct kernel_plan *plan,
+                      const Microkernel *kernel,
+                      const struct elementwise_op_desc *op) {
+    bool has_c = plan->stream_blocks[KERNEL_STREAM_C];
+    bool has_constant = plan->stream_blocks[KERNEL_STREAM_CONSTANT];
+
+    if (plan->blocks != kernel->blocks || has_c != (op->num_inputs == 3) ||
+        has_constant != op->scale_bank) {
+        pr_err("PIM: kernel does not match the %s operands\n", op->name);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * Serializes the kernel of a segment, so that a replay only writes the
+ * config bytes.
+ */
+static int serialize_segment(struct elementwise_segment *segment) {
+    segment->config = kmalloc(ELEMENTWISE_CONFIG_BYTES, GFP_KERNEL);
+    if (!segment->config) {
+        return -ENOMEM;
+    }
+
+    segment->config_len = parse_kernel_to_string(
+        segment->config, ELEMENTWISE_CONFIG_BYTES, &segment->kernel);
+    if (segment->config_len < 0) {
+        pr_err("PIM: Error at parsing (Code: %d)\n", segment->config_len);
+        return segment->config_len;
+    }
+    return 0;
+}
+
+static void release_program(struct elementwise_program *program) {
+    for (int i = 0; i < program->num_segments; i++) {
+        trigger_program_free(&program->segments[i].triggers);
+        kfree(program->segments[i].config);
+        program->segments[i].config = NULL;
+    }
+    program->num_segments = 0;
+    program->compiled = false;
+    program->valid = false;
+    program->last_used = 0;
+}
+
+/**
+ * Compiles the whole op into kernel segments: the selected variant covers as
+ * many blocks as it can, leftover blocks use the largest variant that still
+ * fits, e.g. 7 blocks after an 8 block variant as 4 + 2 + 1.
+ */
+static int compile_program(struct elementwise_program *program,
+                           const struct elementwise_op_desc *op,
+                           enum pim_ordering ordering,
+                           const struct kernel_variant *variant,
+                           uint8_t __iomem *const *bases,
+                           const struct elementwise_layout *layout,
+                           uint32_t total_blocks) {
+    uint32_t done = 0;
+
+    while (variant && done < total_blocks) {
+        struct elementwise_segment *segment;
+        struct kernel_plan plan;
+        uint32_t launches;
+        int ret;
+
+        if (program->num_segments == ELEMENTWISE_MAX_SEGMENTS) {
+            return -E2BIG;
+        }
+        segment = &program->segments[program->num_segments];
+
+        ret = build_kernel_variant(&segment->kernel, variant);
+        if (ret) {
+            return ret;
+        }
+        ret = kernel_plan_build(&segment->kernel, ordering, &plan);
+        if (!ret) {
+            ret = check_plan(&plan, &segment->kernel, op);
+        }
+        if (ret) {
+            return ret;
+        }
+
+        launches = (total_blocks - done) / plan.blocks;
+        ret = trigger_program_init(&segment->triggers,
+                                   launches * plan.count, ordering);
+        if (ret) {
+            return ret;
+        }
+        program->num_segments++;
+
+        ret = serialize_segment(segment);
+        if (ret) {
+            return ret;
+        }
+
+        ret = compile_launches(&segment->triggers, plan.steps, plan.count,
+                               plan.blocks, bases, layout, done, launches);
+        if (ret) {
+            return ret;
+        }
+        done += launches * plan.blocks;
+
+        variant = find_kernel_variant(op->opcode, op->scale_bank,
+                                      (total_blocks - done) *
+                                          KERNEL_BLOCK_ELEMENTS);
+    }
+
+    if (done != total_blocks) {
+        pr_err("PIM: no kernel variant for %s\n", op->name);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * Returns the cached program for 'key' and sets 'hit'. On a miss the least
+ * recently used slot is released and takes the key. Must be called with
+ * program_cache_lock held.
+ */
+static struct elementwise_program *
+lookup_program(const struct elementwise_key *key, bool *hit) {
+    struct elementwise_program *victim = &program_cache[0];
+
+    program_cache_clock++;
+
+    for (int i = 0; i < ELEMENTWISE_CACHE_ENTRIES; i++) {
+        struct elementwise_program *program = &program_cache[i];
+
+        if (program->valid && !memcmp(&program->key, key, sizeof(*key))) {
+            program->last_used = program_cache_clock;
+            *hit = true;
+            return program;
+        }
+        if (!program->valid || program->last_used < victim->last_used) {
+            victim = program;
+        }
+    }
+
+    release_program(victim);
+    victim->key = *key;
+    victim->valid = true;
+    victim->last_used = program_cache_clock;
+    *hit = false;
+    return victim;
+}
+
+/**
+ * Returns the cached program for 'key'. On a miss the slot takes the kernel
+ * variant the cost model predicts to be fastest, so the selection only runs
+ * once per key. Must be called with program_cache_lock held.
+ */
+static struct elementwise_program *
+get_program(const struct elementwise_key *key,
+            const struct elementwise_op_desc *op, uint32_t total_blocks) {
+    struct elementwise_program *program;
+    struct pim_cost cost;
+    bool hit;
+
+    program = lookup_program(key, &hit);
+    if (!hit) {
+        program->variant = pim_cost_select_variant(
+            op->opcode, op->scale_bank, total_blocks * KERNEL_BLOCK_ELEMENTS,
+            &cost);
+        program->estimated_ns = program->variant ? cost.estimated_ns : 0;
+    }
+    return program;
+}
+
+/**
+ * Compiles the segments of a cached program on its first PIM run. Must be
+ * called with program_cache_lock held.
+ */
+static int compile_cached_program(struct elementwise_program *program,
+                                  const struct elementwise_op_desc *op,
+                                  uint8_t __iomem *const *bases,
+                                  const struct elementwise_layout *layout,
+                                  uint32_t total_blocks) {
+    int ret;
+
+    if (program->compiled) {
+        return 0;
+    }
+
+    ret = compile_program(program, op, program->key.ordering,
+                          program->variant, bases, layout, total_blocks);
+    if (ret) {
+        release_program(program);
+        return ret;
+    }
+    program->compiled = true;
+    return 0;
+}
+
+static int run_program(const struct elementwise_program *program) {
+    for (int i = 0; i < program->num_segments; i++) {
+        const struct elementwise_segment *segment = &program->segments[i];
+        int ret = write_config_bytes(segment->config, segment->config_len);
+
+        if (ret < 0) {
+            return ret;
+        }
+
+        // Guarantee that the operands and the kernel are visible to the
+        // device, the config write above already ends with a dsb
+        if (segment->triggers.ordering == PIM_ORDER_CONSERVATIVE) {
+            dsb(SY);
+        }
+        set_bank_mode(PIM_ALL_BANK);
+        trigger_program_replay(&segment->triggers);
+        set_bank_mode(SINGLE_BANK);
+    }
+    return 0;
+}
+
+void elementwise_release_programs(void) {
+    mutex_lock(&program_cache_lock);
+    for (int i = 0; i < ELEMENTWISE_CACHE_ENTRIES; i++) {
+        release_program(&program_cache[i]);
+    }
+    mutex_unlock(&program_cache_lock);
+}
+
+static uint64_t region_offset(void __iomem *address) {
+    return (uint8_t __iomem *)address - (uint8_t __iomem *)pim_data_virt_addr;
+}
+
+/**
+ * Returns the address of an operand of 'len' elements at 'offset' or NULL if
+ * it is not block aligned or reaches into the scratch area at the end of the
+ * data region.
+ */
+static uint8_t __iomem *operand_address(uint64_t offset, uint32_t len) {
+    size_t bytes = (size_t)len * sizeof(uint16_t);
+
+    if (offset % ELEMENTWISE_BLOCK_BYTES || offset > pim_scratch_offset ||
+        bytes > pim_scratch_offset - offset) {
+        return NULL;
+    }
+    return (uint8_t __iomem *)pim_data_virt_addr + offset;
+}
+
+/**
+ * Checks that the result either is one of the 'count' operands, which makes
+ * the op run in place or accumulate into that operand, or does not overlap
+ * any of them. With a partial overlap a FILL would clobber operand blocks
+ * that a later invocation still reads.
+ */
+static int check_result_placement(const uint64_t *operands, int count,
+                                  uint64_t result, uint32_t len) {
+    uint64_t bytes = (uint64_t)len * sizeof(uint16_t);
+
+    for (int i = 0; i < count; i++) {
+        if (operands[i] != result && operands[i] < result + bytes &&
+            result < operands[i] + bytes) {
+            pr_err("PIM: result at 0x%llx partially overlaps the operand at "
+                   "0x%llx\n",
+                   (unsigned long long)result,
+                   (unsigned long long)operands[i]);
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Computes elements [first, len) on the host. Covers the tail that does not
+ * fill a whole block and shapes that the dispatcher sends to the CPU.
+ */
+static void elementwise_host(const struct elementwise_op_desc *op,
+                             uint8_t __iomem *const *bases, uint32_t first,
+                             uint32_t len) {
+    uint16_t __iomem *c = (uint16_t __iomem *)bases[KERNEL_STREAM_C];
+
+    cpu_elementwise(op->opcode, op->scale_bank, op->constant,
+                    (uint16_t __iomem *)bases[KERNEL_STREAM_A] + first,
+                    (uint16_t __iomem *)bases[KERNEL_STREAM_B] + first,
+                    c ? c + first : NULL,
+                    (uint16_t __iomem *)bases[KERNEL_STREAM_RESULT] + first,
+                    len - first);
+}
+
+/**
+ * Computes columns [first, cols) of every row on the host.
+ */
+static void elementwise_host_rows(const struct elementwise_op_desc *op,
+                                  uint8_t __iomem *const *bases,
+                                  const uint64_t *row_pitch, uint32_t rows,
+                                  uint32_t first, uint32_t cols) {
+    for (uint32_t r = 0; r < rows; r++) {
+        uint8_t __iomem *row_bases[KERNEL_STREAM_COUNT] = {NULL};
+
+        for (int s = KERNEL_STREAM_A; s <= KERNEL_STREAM_RESULT; s++) {
+            if (bases[s]) {
+                row_bases[s] = bases[s] + r * row_pitch[s];
+            }
+        }
+        elementwise_host(op, row_bases, first, cols);
+    }
+}
+
+static void fill_constant_block(uint16_t __iomem *block, uint16_t value) {
+    // Every bank loads the scalar from its own first lane
+    for (int i = 0; i < KERNEL_BLOCK_ELEMENTS; i++) {
+        iowrite16(value, block + i);
+    }
+}
+
+/**
+ * Runs the op over 'rows' rows of 'cols' elements whose addresses are set in
+ * 'bases' (A, B, C if needed and RESULT). Row r of a stream starts
+ * row_pitch[s] bytes behind row r - 1, the pitches of the PIM executed part
+ * are multiples of a block. Whole blocks of every row run on the PIM units,
+ * the rest of the rows on the host.
+ */
+static int elementwise_execute(uint32_t op_index, uint8_t __iomem **bases,
+                               const uint64_t *row_pitch, uint32_t rows,
+                               uint32_t cols) {
+    const struct elementwise_op_desc *op = &elementwise_ops[op_index];
+    struct pim_op_shape shape = {.kind = PIM_SHAPE_ELEMENTWISE};
+    struct elementwise_layout layout = {0};
+    struct elementwise_program *program;
+    struct elementwise_key key;
+    uint32_t blocks_per_row = cols / KERNEL_BLOCK_ELEMENTS;
+    uint32_t total_blocks = rows * blocks_per_row;
+    uint32_t body_cols = blocks_per_row * KERNEL_BLOCK_ELEMENTS;
+    bool on_cpu;
+    int ret;
+
+    if (!total_blocks) {
+        elementwise_host_rows(op, bases, row_pitch, rows, 0, cols);
+        return 0;
+    }
+
+    // The scratch blocks are part of the key, their contents are only
+    // written when the op runs on the PIM units
+    if (op->scale_bank) {
+        bases[KERNEL_STREAM_CONSTANT] = pim_scratch_block(PIM_SCRATCH_CONSTANT);
+    }
+    bases[KERNEL_STREAM_DUMMY] = pim_scratch_block(PIM_SCRATCH_DUMMY);
+
+    layout.blocks_per_row = blocks_per_row;
+    for (int s = 0; s < KERNEL_STREAM_COUNT; s++) {
+        if (kernel_stream_steps(s)) {
+            layout.stepping |= 1u << s;
+            layout.row_pitch[s] = rows > 1 ? row_pitch[s] : 0;
+        }
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.op = op_index;
+    key.len = cols;
+    key.rows = rows;
+    key.ordering = pim_ordering_policy();
+    for (int s = 0; s < KERNEL_STREAM_COUNT; s++) {
+        key.offsets[s] = bases[s] ? region_offset(bases[s]) : 0;
+        key.row_pitch[s] = layout.row_pitch[s];
+    }
+
+    // A cached program already knows its variant and estimate, shapes that
+    // cannot amortize the setup are left to the CPU
+    mutex_lock(&program_cache_lock);
+    program = get_program(&key, op, total_blocks);
+    shape.len = rows * cols;
+    on_cpu = !program->variant ||
+             cpu_fallback_preferred(&shape, program->estimated_ns);
+    if (on_cpu) {
+        mutex_unlock(&program_cache_lock);
+        elementwise_host_rows(op, bases, row_pitch, rows, 0, cols);
+        return 0;
+    }
+
+    if (op->scale_bank) {
+        fill_constant_block((uint16_t __iomem *)bases[KERNEL_STREAM_CONSTANT],
+                            op->constant);
+    }
+    pim_scratch_dummy();
+    ret = compile_cached_program(program, op, bases, &layout, total_blocks);
+    if (!ret) {
+        ret = run_program(program);
+    }
+    mutex_unlock(&program_cache_lock);
+    if (ret) {
+        return ret;
+    }
+
+    elementwise_host_rows(op, bases, row_pitch, rows, body_cols, cols);
+    return 0;
+}
+
+int elementwise_from_userspace(struct pim_elementwise *descriptor) {
+    uint8_t __iomem *bases[KERNEL_STREAM_COUNT] = {NULL};
+    uint64_t row_pitch[KERNEL_STREAM_COUNT] = {0};
+    const struct elementwise_op_desc *op;
+    uint64_t offsets[KERNEL_STREAM_RESULT + 1];
+    int ret;
+
+    if (descriptor->op >= PIM_OP_COUNT) {
+        pr_err("PIM: unknown elementwise op %u\n", descriptor->op);
+        return -EINVAL;
+    }
+    op = &elementwise_ops[descriptor->op];
+
+    if (!descriptor->len) {
+        return -EINVAL;
+    }
+
+    offsets[KERNEL_STREAM_A] = descriptor->offset_a;
+    offsets[KERNEL_STREAM_B] = descriptor->offset_b;
+    offsets[KERNEL_STREAM_C] = descriptor->offset_c;
+    offsets[KERNEL_STREAM_RESULT] = descriptor->result_offset;
+
+    for (int s = KERNEL_STREAM_A; s <= KERNEL_STREAM_RESULT; s++) {
+        if (s == KERNEL_STREAM_C && op->num_inputs < 3) {
+            continue;
+        }
+        bases[s] = operand_address(offsets[s], descriptor->len);
+        if (!bases[s]) {
+            pr_err("PIM: %s operand at 0x%llx is misaligned or out of "
+                   "range\n",
+                   op->name, (unsigned long long)offsets[s]);
+            return -EINVAL;
+        }
+    }
+
+    ret = check_result_placement(offsets, op->num_inputs,
+                                 offsets[KERNEL_STREAM_RESULT],
+                                 descriptor->len);
+    if (ret) {
+        return ret;
+    }
+
+    return elementwise_execute(descriptor->op, bases, row_pitch, 1,
+                               descriptor->len);
+}
+
+/**
+ * Computes the byte offset behind the last element of a view. Returns
+ * -EINVAL if the view is misaligned or reaches into the scratch area at the
+ * end of the data region.
+ */
+static int view_end(const struct pim_view *view, uint32_t rows, uint32_t cols,
+                    uint64_t *end) {
+    // Both products fit into 64 bits, only their sum can wrap
+    uint64_t row_span = (uint64_t)(rows - 1) * view->row_stride;
+    uint64_t col_span = (uint64_t)(cols - 1) * view->element_stride;
+    uint64_t elements;
+    uint64_t bytes;
+
+    if (view->offset % sizeof(uint16_t) || view->offset > pim_scratch_offset ||
+        check_add_overflow(row_span, col_span + 1, &elements) ||
+        check_mul_overflow(elements, (uint64_t)sizeof(uint16_t), &bytes) ||
+        bytes > pim_scratch_offset - view->offset) {
+        return -EINVAL;
+    }
+    *end = view->offset + bytes;
+    return 0;
+}
+
+static bool same_view(const struct pim_view *a, const struct pim_view *b) {
+    return a->offset == b->offset && a->element_stride == b->element_stride &&
+           a->row_stride == b->row_stride;
+}
+
+/**
+ * True if the PIM units can address the view block by block: contiguous rows
+ * that start on a block boundary.
+ */
+static bool view_is_blocked(const struct pim_view *view, uint32_t rows) {
+    return view->element_stride == 1 &&
+           view->offset % ELEMENTWISE_BLOCK_BYTES == 0 &&
+           (rows == 1 ||
+            (view->row_stride * sizeof(uint16_t)) % ELEMENTWISE_BLOCK_BYTES ==
+                0);
+}
+
+static uint16_t __iomem *view_element(const struct pim_view *view, uint32_t row,
+                                      uint32_t col) {
+    return (uint16_t __iomem *)((uint8_t __iomem *)pim_data_virt_addr +
+                                view->offset) +
+           (size_t)row * view->row_stride + (size_t)col * view->element_stride;
+}
+
+/**
+ * Runs the op on the host for views the PIM units cannot address. Every row
+ * is gathered chunk by chunk, computed and scattered back.
+ */
+static int elementwise_view_host(const struct elementwise_op_desc *op,
+                                 const struct pim_view *const *views,
+                                 uint32_t rows, uint32_t cols) {
+    uint16_t *chunks = kmalloc_array(KERNEL_STREAM_RESULT,
+                                     ELEMENTWISE_VIEW_CHUNK * sizeof(uint16_t),
+                                     GFP_KERNEL);
+
+    if (!chunks) {
+        return -ENOMEM;
+    }
+
+    for (uint32_t r = 0; r < rows; r++) {
+        for (uint32_t done = 0; done < cols; done += ELEMENTWISE_VIEW_CHUNK) {
+            uint32_t n = min_t(uint32_t, cols - done, ELEMENTWISE_VIEW_CHUNK);
+            uint16_t *a = chunks;
+            uint16_t *b = a + ELEMENTWISE_VIEW_CHUNK;
+            uint16_t *c = b + ELEMENTWISE_VIEW_CHUNK;
+
+            for (int s = KERNEL_STREAM_A; s < op->num_inputs; s++) {
+                uint16_t *chunk = chunks + s * ELEMENTWISE_VIEW_CHUNK;
+
+                for (uint32_t i = 0; i < n; i++) {
+                    chunk[i] = ioread16(view_element(views[s], r, done + i));
+                }
+            }
+
+            // The result overwrites the first operand in the chunk
+            cpu_elementwise_buffer(op->opcode, op->scale_bank, op->constant,
+                                   a, b, op->num_inputs > 2 ? c : NULL, a, n);
+
+            for (uint32_t i = 0; i < n; i++) {
+                iowrite16(a[i], view_element(views[KERNEL_STREAM_RESULT], r,
+                                             done + i));
+            }
+        }
+    }
+
+    kfree(chunks);
+    return 0;
+}
+
+int elementwise_view_from_userspace(const struct pim_elementwise_view *desc) {
+    const struct pim_view *views[KERNEL_STREAM_RESULT + 1] = {
+        &desc->a, &desc->b, &desc->c, &desc->result};
+    uint8_t __iomem *bases[KERNEL_STREAM_COUNT] = {NULL};
+    uint64_t row_pitch[KERNEL_STREAM_COUNT] = {0};
+    const struct pim_view *result = &desc->result;
+    const struct elementwise_op_desc *op;
+    bool blocked = desc->cols >= KERNEL_BLOCK_ELEMENTS;
+    uint64_t result_end;
+
+    if (desc->op >= PIM_OP_COUNT || !desc->rows || !desc->cols) {
+        pr_err("PIM: malformed elementwise view op\n");
+        return -EINVAL;
+    }
+    op = &elementwise_ops[desc->op];
+
+    // Every element of the result has to be written exactly once
+    if (!result->element_stride ||
+        (desc->rows > 1 &&
+         result->row_stride <
+             (uint64_t)(desc->cols - 1) * result->element_stride + 1)) {
+        pr_err("PIM: result view overlaps itself\n");
+        return -EINVAL;
+    }
+
+    for (int s = KERNEL_STREAM_RESULT; s >= KERNEL_STREAM_A; s--) {
+        const struct pim_view *view = views[s];
+        uint64_t end;
+
+        if (s == KERNEL_STREAM_C && op->num_inputs < 3) {
+            continue;
+        }
+        if (view_end(view, desc->rows, desc->cols, &end)) {
+            pr_err("PIM: %s view at 0x%llx is misaligned or out of range\n",
+                   op->name, (unsigned long long)view->offset);
+            return -EINVAL;
+        }
+        // Inputs may share elements, the result may only coincide with one
+        if (s == KERNEL_STREAM_RESULT) {
+            result_end = end;
+        } else if (!same_view(view, result) && view->offset < result_end &&
+                   result->offset < end) {
+            pr_err("PIM: result view overlaps the %s operand at 0x%llx\n",
+                   op->name, (unsigned long long)view->offset);
+            return -EINVAL;
+        }
+
+        bases[s] = (uint8_t __iomem *)pim_data_virt_addr + view->offset;
+        row_pitch[s] = (uint64_t)view->row_stride * sizeof(uint16_t);
+        blocked &= view_is_blocked(view, desc->rows);
+    }
+
+    if (!blocked) {
+        return elementwise_view_host(op, views, desc->rows, desc->cols);
+    }
+
+    return elementwise_execute(desc->op, bases, row_pitch, desc->rows,
+                               desc->cols);
+}
+
+/**
+ * Computes elements [first, len) of an expression on the host. The PIM units
+ * round after every operation, a fused MAD included, so evaluating node by
+ * node gives the same result.
+ */
+static void expression_host(const struct kernel_expr *expr,
+                            uint8_t __iomem *const *bases, uint32_t first,
+                            uint32_t len) {
+    uint16_t __iomem *result =
+        (uint16_t __iomem *)bases[KERNEL_EXPR_STREAM_RESULT];
+
+    for (uint32_t e = first; e < len; e++) {
+        uint16_t values[KERNEL_EXPR_MAX_NODES];
+
+        for (int i = 0; i < expr->num_nodes; i++) {
+            const struct kernel_expr_node *node = &expr->nodes[i];
+
+            switch (node->op) {
+            case KERNEL_EXPR_INPUT:
+                values[i] =
+                    ioread16((uint16_t __iomem *)bases[node->lhs] + e);
+                break;
+            case KERNEL_EXPR_ADD:
+                values[i] = f16_add(values[node->lhs], values[node->rhs]);
+                break;
+            default:
+                values[i] = f16_mul(values[node->lhs], values[node->rhs]);
+                break;
+            }
+        }
+        iowrite16(values[expr->num_nodes - 1], result + e);
+    }
+}
+
+/**
+ * Compiles the expression into segments of descending block counts, starting
+ * with the largest that fits the GRF and the instruction slots. 'compiled' is
+ * scratch space for the compiler.
+ */
+static int compile_expression(struct elementwise_program *program,
+                              const struct kernel_expr *expr,
+                              struct kernel_expr_program *compiled,
+                              enum pim_ordering ordering, int max_blocks,
+                              uint8_t __iomem *const *bases,
+                              uint32_t total_blocks) {
+    // Inputs and result step, the dummy block stays
+    struct elementwise_layout layout = {
+        .stepping = (1u << KERNEL_EXPR_STREAM_DUMMY) - 1,
+        .blocks_per_row = total_blocks,
+    };
+    uint32_t done = 0;
+
+    for (int blocks = max_blocks; blocks >= 1; blocks /= 2) {
+        struct elementwise_segment *segment;
+        uint32_t launches = (total_blocks - done) / blocks;
+        int ret;
+
+        if (!launches) {
+            continue;
+        }
+        if (program->num_segments == ELEMENTWISE_MAX_SEGMENTS) {
+            return -E2BIG;
+        }
+        segment = &program->segments[program->num_segments];
+
+        ret = kernel_expr_compile(expr, blocks, ordering, compiled);
+        if (ret) {
+            return ret;
+        }
+        segment->kernel = compiled->kernel;
+
+        ret = trigger_program_init(&segment->triggers,
+                                   launches * compiled->count, ordering);
+        if (ret) {
+            return ret;
+        }
+        program->num_segments++;
+
+        ret = serialize_segment(segment);
+        if (ret) {
+            return ret;
+        }
+
+        ret = compile_launches(&segment->triggers, compiled->steps,
+                               compiled->count, blocks, bases, &layout, done,
+                               launches);
+        if (ret) {
+            return ret;
+        }
+        done += launches * blocks;
+    }
+    return 0;
+}
+
+/**
+ * Fills a new cache slot for an expression: the cost model estimates the
+ * kernel with the most blocks per invocation. Must be called with
+ * program_cache_lock held.
+ */
+static int estimate_expression(struct elementwise_program *program,
+                               const struct kernel_expr *expr,
+                               struct kernel_expr_program *compiled,
+                               int max_blocks, uint32_t body_len) {
+    struct pim_op_shape shape = {.kind = PIM_SHAPE_ELEMENTWISE,
+                                 .len = body_len};
+    struct pim_cost cost;
+    int ret;
+
+    ret = kernel_expr_compile(expr, max_blocks, program->key.ordering,
+                              compiled);
+    if (!ret) {
+        ret = pim_cost_analyze(&compiled->kernel, &shape,
+                               &pim_cost_calibration, &cost);
+    }
+    if (ret) {
+        return ret;
+    }
+    program->estimated_ns = cost.estimated_ns;
+    return 0;
+}
+
+int expression_from_userspace(const struct pim_expression *descriptor) {
+    uint8_t __iomem *bases[KERNEL_EXPR_STREAM_DUMMY + 1] = {NULL};
+    struct pim_op_shape shape = {.kind = PIM_SHAPE_ELEMENTWISE};
+    struct kernel_expr_program *compiled = NULL;
+    struct elementwise_program *program;
+    struct elementwise_key key;
+    struct kernel_expr expr;
+    uint32_t total_blocks;
+    uint32_t body_len;
+    int max_blocks;
+    int operations = 0;
+    bool hit;
+    int ret;
+
+    if (!descriptor->len || descriptor->num_nodes > KERNEL_EXPR_MAX_NODES ||
+        descriptor->num_inputs > KERNEL_EXPR_MAX_INPUTS) {
+        pr_err("PIM: malformed expression\n");
+        return -EINVAL;
+    }
+    memcpy(expr.nodes, descriptor->nodes, sizeof(expr.nodes));
+    expr.num_nodes = descriptor->num_nodes;
+    expr.num_inputs = descriptor->num_inputs;
+    if (kernel_expr_validate(&expr)) {
+        pr_err("PIM: malformed expression\n");
+        return -EINVAL;
+    }
+
+    for (int s = 0; s <= KERNEL_EXPR_STREAM_RESULT; s++) {
+        uint64_t offset = s == KERNEL_EXPR_STREAM_RESULT
+                              ? descriptor->result_offset
+                              : descriptor->input_offsets[s];
+
+        if (s >= expr.num_inputs && s != KERNEL_EXPR_STREAM_RESULT) {
+            continue;
+        }
+        bases[s] = operand_address(offset, descriptor->len);
+        if (!bases[s]) {
+            pr_err("PIM: expression operand at 0x%llx is misaligned or out "
+                   "of range\n",
+                   (unsigned long long)offset);
+            return -EINVAL;
+        }
+    }
+
+    ret = check_result_placement(descriptor->input_offsets, expr.num_inputs,
+                                 descriptor->result_offset, descriptor->len);
+    if (ret) {
+        return ret;
+    }
+
+    total_blocks = descriptor->len / KERNEL_BLOCK_ELEMENTS;
+    body_len = total_blocks * KERNEL_BLOCK_ELEMENTS;
+    max_blocks = kernel_expr_max_blocks(&expr);
+    if (max_blocks < 0) {
+        pr_err("PIM: expression does not fit a microkernel\n");
+        return max_blocks;
+    }
+    if (!total_blocks) {
+        expression_host(&expr, bases, 0, descriptor->len);
+        return 0;
+    }
+    bases[KERNEL_EXPR_STREAM_DUMMY] = pim_scratch_block(PIM_SCRATCH_DUMMY);
+
+    // The host evaluates one elementwise op per node
+    for (int i = 0; i < expr.num_nodes; i++) {
+        operations += expr.nodes[i].op != KERNEL_EXPR_INPUT;
+    }
+    shape.len = descriptor->len * max(operations, 1);
+
+    memset(&key, 0, sizeof(key));
+    key.op = PIM_OP_COUNT;
+    key.len = descriptor->len;
+    key.rows = 1;
+    key.ordering = pim_ordering_policy();
+    for (int s = 0; s <= KERNEL_EXPR_STREAM_DUMMY; s++) {
+        key.offsets[s] = bases[s] ? region_offset(bases[s]) : 0;
+    }
+    key.num_inputs = expr.num_inputs;
+    key.num_nodes = expr.num_nodes;
+    memcpy(key.nodes, expr.nodes, expr.num_nodes * sizeof(expr.nodes[0]));
+
+    mutex_lock(&program_cache_lock);
+    program = lookup_program(&key, &hit);
+
+    // A cached expression replays its triggers, the compiler scratch is only
+    // needed for a new key
+    if (!hit) {
+        compiled = kmalloc(sizeof(*compiled), GFP_KERNEL);
+        ret = compiled ? estimate_expression(program, &expr, compiled,
+                                             max_blocks, body_len)
+                       : -ENOMEM;
+        if (ret) {
+            release_program(program);
+            goto unlock;
+        }
+    }
+
+    // Leave shapes that cannot amortize the setup to the CPU
+    if (cpu_fallback_preferred(&shape, program->estimated_ns)) {
+        mutex_unlock(&program_cache_lock);
+        kfree(compiled);
+        expression_host(&expr, bases, 0, descriptor->len);
+        return 0;
+    }
+
+    pim_scratch_dummy();
+    if (!program->compiled) {
+        if (!compiled) {
+            compiled = kmalloc(sizeof(*compiled), GFP_KERNEL);
+        }
+        ret = compiled ? compile_expression(program, &expr, compiled,
+                                            key.ordering, max_blocks, bases,
+                                            total_blocks)
+                       : -ENOMEM;
+        if (ret) {
+            release_program(program);
+            goto unlock;
+        }
+        program->compiled = true;
+    }
+    ret = run_program(program);
+
+unlock:
+    mutex_unlock(&program_cache_lock);
+    kfree(compiled);
+    if (!ret) {
+        expression_host(&expr, bases, body_len, descriptor->len);
+    }
+    return ret;
+}
+
+/**
+ * Executes an elementwise op on predefined kernel-space vectors and prints
+ * the result.
+ */
+void elementwise_driver_code(enum pim_elementwise_op op) {
+    struct pim_elementwise descriptor;
+    uint16_t *vector_arr = NULL;
+    uint16_t __iomem *vector_addresses[3];
+    uint16_t __iomem *vector_result_address;
+    int ret;
+    int i;
+
+    ROWS = 256;
+
+    vector_arr = vmalloc(ROWS * sizeof(uint16_t));
+    if (!vector_arr) {
+        return;
+    }
+
+    // Inputs count up, down and stay constant
+    for (int v = 0; v < 3; v++) {
+        for (i = 0; i < ROWS; i++) {
+            vector_arr[i] = v == 0   ? f16_integer_lookup_table[i]
+                            : v == 1 ? f16_integer_lookup_table[ROWS - i]
+                                     : f16_integer_lookup_table[2];
+        }
+        vector_addresses[v] = init_vector(vector_arr, ROWS);
+        if (!vector_addresses[v]) {
+            goto cleanup;
+        }
+    }
+
+    // The kernel overwrites every element, no need to clear the result
+    vector_result_address = alloc_vector_result(ROWS);
+    if (!vector_result_address) {
+        goto cleanup;
+    }
+
+    descriptor.offset_a = region_offset(vector_addresses[0]);
+    descriptor.offset_b = region_offset(vector_addresses[1]);
+    descriptor.offset_c = region_offset(vector_addresses[2]);
+    descriptor.result_offset = region_offset(vector_result_address);
+    descriptor.len = ROWS;
+    descriptor.op = op;
+
+    ret = elementwise_from_userspace(&descriptor);
+    if (ret) {
+        pr_err("elementwise_driver_code failed with error %d\n", ret);
+        goto cleanup;
+    }
+
+    // Evaluate the result and check, if the PIM-VM executed the op correctly
+    pr_err("--------- RESULT-VECTOR IS ---------:");
+    for (i = 0; i < ROWS; i++) {
+        pr_err("VAL: (hex): 0x%x\n", ioread16(vector_result_address + i));
+    }
+
+cleanup:
+    vfree(vector_arr);
+}
@@ -1,225 +1,276 @@
+#include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/workqueue.h>
 
+#include "../../include/bins.h"
+#include "../../include/cpu_fallback.h"
+#include "../../include/microkernels/kernel_cost.h"
 #include "../../include/microkernels/kernel_datastructures.h"
 #include "../../include/microkernels/kernels.h"
 #include "../../include/pim_configs.h"
 #include "../../include/pim_data_allocator.h"
+#include "../../include/pim_f16.h"
 #include "../../include/pim_init_state.h"
 #include "../../include/pim_matrices.h"
 #include "../../include/pim_memory_region.h"
 #include "../../include/pim_vectors.h"
-#include "../../include/read_write_triggers.h"
+#include "../../include/trigger_program.h"
 
 #define F16_ONE 0x3C00
 
-#define FIX_POINT_SHIFT 10
-#define FIX_POINT_MASK ((1 << FIX_POINT_SHIFT) - 1)
+// Every finite f16 value is a multiple of 2^-24, so no lane loses bits
+#define FIX_POINT_SHIFT 24
 
-#define EVALUATION_MODE 1
+static bool gemv_evaluation;
+module_param(gemv_evaluation, bool, 0644);
+MODULE_PARM_DESC(gemv_evaluation,
+                 "Benchmark GEMV: replay the first 128 columns cols/128 "
+                 "times instead of computing the full product");
+
+static unsigned int gemv_chunks;
+module_param(gemv_chunks, uint, 0644);
+MODULE_PARM_DESC(gemv_chunks,
+                 "Column chunks of 128 the PIM units accumulate in f16 before "
+                 "a row stripe is read back, 0 for as many as fit");
 
 /**
  * Context structure to encapsulate result and state variables for an operation.
  * => Avoids global variables
  */
 struct gemv_context {
-    // Result pointers
-    int32_t *result_integer_part;
-    int32_t *result_fractional_part;
+    // Per row sums in fixed point with FIX_POINT_SHIFT fractional bits
+    int64_t *result_fixed;
     uint16_t *result_in_f16_bin;
 
     int repetitions;
+    // y = A^T x: the results are the columns of the matrix
+    bool transposed;
 };
 
 /**
  * Converts a fixed-point value to a 16-bit IEEE 754 floating-point
- * representation (FP16).
+ * representation (FP16), rounding to nearest even like the CPU reference.
+ * Values below the smallest normal number become denormals.
  */
-static uint16_t fixed_to_f16_engine(uint64_t fixed_val) {
-    int msb_pos;
-    int actual_exponent;
+static uint16_t fixed_to_f16(int64_t fixed_val) {
+    uint16_t sign = fixed_val < 0 ? F16_SIGN_MASK : 0;
+    uint64_t magnitude = fixed_val < 0 ? -(uint64_t)fixed_val : fixed_val;
+    uint64_t mantissa;
+    uint64_t rest;
+    uint64_t half;
     int biased_exponent;
+    int msb_pos;
     int shift;
-    uint16_t mantissa;
-    uint64_t shifted_val;
 
-    if (fixed_val == 0) {
+    if (magnitude == 0) {
         return 0;
     }
 
-    msb_pos = 0;
-    for (int i = 63; i >= 0; i--) {
-        if ((fixed_val >> i) & 1) {
-            msb_pos = i;
-            break;
+    msb_pos = fls64(magnitude) - 1;
+    biased_exponent = msb_pos - FIX_POINT_SHIFT + 15;
+    // Denormals count in steps of 2^-24 and have no implicit leading bit
+    shift = biased_exponent > 0 ? msb_pos - 10 : FIX_POINT_SHIFT - 24;
+
+    if (shift > 0) {
+        mantissa = magnitude >> shift;
+        rest = magnitude & ((1ULL << shift) - 1);
+        half = 1ULL << (shift - 1);
+        if (rest > half || (rest == half && (mantissa & 1))) {
+            mantissa++;
         }
+    } else {
+        mantissa = magnitude << -shift;
     }
 
-    actual_exponent = msb_pos - FIX_POINT_SHIFT;
-    biased_exponent = actual_exponent + 15;
-
-    if (biased_exponent >= 0x1F) {
-        return 0x7C00; // Infinity
+    if (biased_exponent <= 0) {
+        // A denormal that rounds up to 0x400 is the smallest normal number
+        return sign | mantissa;
     }
-
-    if (biased_exponent > 0) { // Normalized
-        shift = msb_pos - 10;
-        mantissa = (shift >= 0) ? (fixed_val >> shift) & 0x3FF
-                                : (fixed_val << -shift) & 0x3FF;
-        return (biased_exponent << 10) | mantissa;
-
-    } else { // Denormalized
-        shift = 1 - biased_exponent;
-
-        if (shift > msb_pos + 1) {
-            return 0; // Underflow
-        }
-
-        shifted_val = fixed_val >> (msb_pos - 10 + shift);
-        return (uint16_t)(shifted_val & 0x3FF);
+    // Rounding carried into the next binade
+    if (mantissa >> 11) {
+        mantissa >>= 1;
+        biased_exponent++;
     }
+    if (biased_exponent >= 0x1F) {
+        return sign | 0x7C00; // Infinity
+    }
+    return sign | (biased_exponent << 10) | (mantissa & 0x3FF);
 }
 
 /**
- * Converts separate integer and fractional parts into a single 16-bit FP16
- * value.
+ * Maps an f16 value to an integer with the same order, NaN excluded.
  */
-static uint16_t kernel_parts_to_f16(int32_t integer_part,
-                                    int32_t fractional_part) {
-    uint16_t sign = 0;
-    uint32_t binary_fractional_part;
-    uint64_t fixed_val;
-    uint16_t magnitude_f16;
-
-    // Get sign
-    if (integer_part < 0) {
-        sign = 0x8000;
-        integer_part = -integer_part;
-    }
-    if (fractional_part < 0) {
-        fractional_part = -fractional_part;
-    }
-
-    binary_fractional_part = ((uint64_t)fractional_part * 64) / 1000;
-
-    // Combining the two parts
-    fixed_val = ((uint64_t)integer_part << FIX_POINT_SHIFT) |
-                (binary_fractional_part & 0x3FF);
-
-    magnitude_f16 = fixed_to_f16_engine(fixed_val);
+static int f16_order_key(uint16_t value) {
+    int magnitude = value & ~F16_SIGN_MASK;
 
-    return sign | magnitude_f16;
+    return (value & F16_SIGN_MASK) ? -magnitude : magnitude;
 }
 
 /**
- * Converts a uint16_t representing an IEEE 754 half-precision float (f16) into
- * its 32-bit signed fixed-point integer equivalent, including handling of
- * special values for zero, denormals, and infinity.
+ * Applies the epilogue to the result 'value' of row 'row'. The bias is scaled
+ * before it is added, so alpha * value + beta * bias rounds like a MAD.
  */
-static inline int32_t f16_to_fixed_point(uint16_t f16_val) {
-    int32_t sign = (f16_val >> 15) & 0x01;
-    int32_t exponent = (f16_val >> 10) & 0x1f;
-    int32_t mantissa = f16_val & 0x3ff;
-    int32_t denorm_val;
-    int32_t value;
-    int32_t shift;
-
-    if (exponent == 0x1f) {  // Infinity or NaN
-        if (mantissa == 0) { // Infinity
-            return sign ? INT_MIN : INT_MAX;
-        }
-        return 0; // NaN -> 0
-    }
+static uint16_t gemv_epilogue_row(const struct pim_gemv_epilogue *epilogue,
+                                  const uint16_t *bias, uint32_t row,
+                                  uint16_t value) {
+    bool scale;
 
-    if (exponent == 0) {     // Zero or Denormalized
-        if (mantissa == 0) { // Zero
-            return 0;
-        }
-        // Denormalized
-        denorm_val = mantissa;
-        denorm_val = denorm_val >> (14 - FIX_POINT_SHIFT);
-        return sign ? -denorm_val : denorm_val;
+    if (!epilogue || !epilogue->flags) {
+        return value;
     }
+    scale = epilogue->flags & PIM_EPILOGUE_SCALE;
 
-    // Normalized
-    value = (1 << FIX_POINT_SHIFT) | mantissa;
+    if (epilogue->flags & PIM_EPILOGUE_BIAS) {
+        uint16_t offset =
+            scale ? f16_mul(epilogue->beta, bias[row]) : bias[row];
 
-    shift = exponent - 15;
+        value = scale ? f16_mul_add(epilogue->alpha, value, offset)
+                      : f16_add(value, offset);
+    } else if (scale) {
+        value = f16_mul(epilogue->alpha, value);
+    }
 
-    if (shift > 0) {
-        if (shift > 20) { // Avoid overflow
-            value = sign ? INT_MIN : INT_MAX;
-        } else {
-            value <<= shift;
+    // NaN passes the activation unchanged
+    if ((epilogue->flags & PIM_EPILOGUE_ACTIVATION) &&
+        (value & ~F16_SIGN_MASK) <= F16_INFINITY) {
+        if (value & F16_SIGN_MASK) {
+            value = f16_mul(value, epilogue->negative_slope);
+        }
+        if (f16_order_key(value) < f16_order_key(epilogue->lower)) {
+            value = epilogue->lower;
+        }
+        if (f16_order_key(value) > f16_order_key(epilogue->upper)) {
+            value = epilogue->upper;
         }
-    } else {
-        value >>= -shift;
     }
+    return value;
+}
 
-    if (sign) {
-        value = -value;
-    }
+/**
+ * Segment of an output stripe, i.e. a row stripe or for the transposed GEMV a
+ * column stripe: up to 'chunks' nonzero tiles of the stripe, taken from the
+ * compact tile index at 'first_tile'. 'partial_sums' is set once the segment
+ * has been uploaded.
+ */
+struct gemv_segment {
+    uint16_t __iomem *partial_sums;
+    int stripe;
+    int first_tile;
+    int tiles;
+    int valid_outputs;
+};
 
-    return value;
+// Partial sums of one segment: 16 lanes per row resp. 16 banks per column of
+// the tile
+#define GEMV_PARTIAL_ELEMENTS (MATRIX_ROWS * ELEMENT_COUNT_SUBMATRIX)
+
+/**
+ * Results of one output stripe.
+ */
+static int gemv_stripe_outputs(const struct gemv_context *ctx) {
+    return ctx->transposed ? MATRIX_COLS : MATRIX_ROWS;
 }
 
 /**
- * This function accumulates a partial sum vector from PIM memory by first
- * converting the f16 values to a fixed-point representation on the CPU. It then
- * either initializes the result for the corresponding rows when processing the
- * first column chunk or adds to the existing sum for all subsequent chunks.
+ * Bytes of the partial sums of a segment that hold valid outputs: the rows of
+ * 16 lanes, resp. whole blocks of 16 columns for the transposed GEMV.
  */
-static void
-accumulate_result_vector(struct gemv_context *ctx,
-                         uint16_t __iomem *output_partial_sum_vector,
-                         int row_ind_chunk, int col_ind_chunk, int total_rows) {
+static size_t gemv_partial_bytes(const struct gemv_context *ctx,
+                                 const struct gemv_segment *segment) {
+    size_t elements =
+        ctx->transposed
+            ? DIV_ROUND_UP(segment->valid_outputs, ELEMENT_COUNT_SUBMATRIX) *
+                  NUM_BANKS * ELEMENT_COUNT_SUBMATRIX
+            : segment->valid_outputs * ELEMENT_COUNT_SUBMATRIX;
+
+    return elements * sizeof(uint16_t);
+}
 
+/**
+ * Partial sums of one session copied out of PIM memory, reduced into the
+ * gemv_context by a work item while the next session uploads and executes.
+ */
+struct gemv_reduction {
+    struct work_struct work;
+    struct gemv_context *ctx;
+    struct gemv_segment *segments;
+    uint32_t count;
+    // GEMV_PARTIAL_ELEMENTS per segment and the row sums of one segment
+    uint16_t *readback;
+    int64_t *row_sums;
+};
+
+/**
+ * This function accumulates the partial sum vector of a segment that has been
+ * copied out of PIM memory. The 16 lanes of every row (the 16 banks of every
+ * column for the transposed GEMV) are converted to fixed point, summed by
+ * cpu_sum_lanes_fixed resp. cpu_sum_banks_fixed and added to the result,
+ * which starts out zeroed since stripes without a nonzero tile have no
+ * segment. Only the first 'valid_outputs' outputs of the tile exist in the
+ * matrix, the zero padded ones behind them are skipped.
+ */
+static void accumulate_result_vector(struct gemv_context *ctx,
+                                     const uint16_t *partial_sum_vector,
+                                     int64_t *row_sums,
+                                     const struct gemv_segment *segment) {
     int index_result_vector;
-    int32_t integer_part;
-    int32_t fractional_part;
-
-    for (int i = 0; i < MATRIX_ROWS; i++) {
-        int64_t accumulated_row = 0;
-        for (int j = 0; j < ELEMENT_COUNT_SUBMATRIX; j++) {
-            int32_t val =
-                f16_to_fixed_point(ioread16(output_partial_sum_vector));
-            accumulated_row += val;
-            output_partial_sum_vector++;
-        }
 
-        index_result_vector = row_ind_chunk * 64 + i;
+    if (ctx->transposed) {
+        cpu_sum_banks_fixed(
+            partial_sum_vector,
+            DIV_ROUND_UP(segment->valid_outputs, ELEMENT_COUNT_SUBMATRIX),
+            FIX_POINT_SHIFT, row_sums);
+    } else {
+        cpu_sum_lanes_fixed(partial_sum_vector, segment->valid_outputs,
+                            FIX_POINT_SHIFT, row_sums);
+    }
 
-        integer_part = (accumulated_row >> FIX_POINT_SHIFT);
-        fractional_part = (((abs(accumulated_row) & FIX_POINT_MASK) * 1000) >>
-                           FIX_POINT_SHIFT);
+    for (int i = 0; i < segment->valid_outputs; i++) {
+        index_result_vector = segment->stripe * gemv_stripe_outputs(ctx) + i;
+        ctx->result_fixed[index_result_vector] += row_sums[i];
+    }
+}
 
-        // Beginning of a new row
-        if (col_ind_chunk == 0) {
-            ctx->result_integer_part[index_result_vector] = integer_part;
-            ctx->result_fractional_part[index_result_vector] = fractional_part;
-        } else {
-            ctx->result_integer_part[index_result_vector] += integer_part;
+static void gemv_reduce_work(struct work_struct *work) {
+    struct gemv_reduction *reduction =
+        container_of(work, struct gemv_reduction, work);
 
-            ctx->result_fractional_part[index_result_vector] += fractional_part;
-            if (ctx->result_fractional_part[index_result_vector] >= 1000) {
-                ctx->result_integer_part[index_result_vector]++;
-                ctx->result_fractional_part[index_result_vector] -= 1000;
-            }
-        }
+    for (uint32_t t = 0; t < reduction->count; t++) {
+        accumulate_result_vector(
+            reduction->ctx, reduction->readback + t * GEMV_PARTIAL_ELEMENTS,
+            reduction->row_sums, &reduction->segments[t]);
     }
 }
 
+// Triggers of one chunk (vector MOVs and MACs) resp. of the FILLs and the
+// EXIT that close a segment, for either orientation
+#define GEMV_CHUNK_TRIGGERS                                                    \
+    (max(X16_ROWS, X16_COLUMNS) + X16_ROWS * X16_COLUMNS)
+#define GEMV_STRIPE_TRIGGERS (max(X16_ROWS, X16_COLUMNS) + 1)
+
 /**
- * Orchestrates a complete matrix-vector multiplication (GEMV) on the PIM units
- * by issuing a sequence of memory-mapped trigger reads and writes. This
- * sequence loads the input vector (MOV), processes the matrix data (MAC),
- * writes back the result vector (FILL), and finally resets the PIM units
- * (EXIT).
+ * Appends a complete matrix-vector multiplication (GEMV) of one row stripe
+ * segment on the PIM units to a trigger program. For each of the 'chunks'
+ * tiles the sequence loads the input vector (MOV) and processes the matrix
+ * data (MAC) into the same accumulators. The MACs of blocks missing from the
+ * tile's 'block_masks' entry read the same block of the zero tile instead,
+ * they were not uploaded. It then writes back the result vector (FILL) once,
+ * and finally resets the PIM units (EXIT), so the next segment can follow
+ * directly.
+ *
+ * The transposed GEMV triggers the same tile blocks in the same order, only
+ * the input vector has a block per block row and the result one per block
+ * column of the tile.
  */
-static void gemv_execute(uint16_t __iomem *matrix_base_addr,
-                         uint16_t __iomem *input_vector_base_addr,
-                         uint16_t __iomem *output_vector_base_addr,
-                         uint16_t __iomem *dummy_region_address) {
+static int gemv_compile(struct trigger_program *program,
+                        uint16_t __iomem *const *matrix_base_addrs,
+                        uint16_t __iomem *const *input_vector_base_addrs,
+                        const uint64_t *block_masks, int chunks,
+                        bool transposed, uint16_t __iomem *zero_tile,
+                        uint16_t __iomem *output_vector_base_addr,
+                        uint16_t __iomem *dummy_region_address) {
     const size_t INPUT_VECTOR_BLOCK_STRIDE =
         NUM_BANKS * ELEMENT_COUNT_SUBMATRIX;
     const size_t BLOCK_IN_STRIPE_STRIDE =
@@ -227,181 +278,424 @@ static void gemv_execute(uint16_t __iomem *matrix_base_addr,
     const size_t NUM_ELEMENTS_IN_COL =
         ELEMENT_COUNT_SUBMATRIX * ELEMENT_COUNT_SUBMATRIX;
     const size_t NUM_ELEMENTS_IN_STRIPE = NUM_ELEMENTS_IN_COL * X16_COLUMNS;
-
-    // === 1. Read input vector ===
-    for (int i = 0; i < X16_COLUMNS; ++i) {
-        trigger_read(input_vector_base_addr + i * INPUT_VECTOR_BLOCK_STRIDE);
-    }
-    mb();
-
-    // === 2. Execute Multiply and Accumulates ===
-    for (int i = 0; i < X16_ROWS; ++i) {
-        for (int j = 0; j < X16_COLUMNS; ++j) {
-            size_t offset =
-                (i * NUM_ELEMENTS_IN_STRIPE) + (j * NUM_ELEMENTS_IN_COL);
-            uint16_t __iomem *block_addr = matrix_base_addr + offset;
-            trigger_read(block_addr);
+    int vector_blocks = transposed ? X16_ROWS : X16_COLUMNS;
+    int output_blocks = transposed ? X16_COLUMNS : X16_ROWS;
+
+    // Closes every phase, the batch policy only closes the whole tile
+    enum trigger_fence phase_fence = program->ordering == PIM_ORDER_BATCH
+                                         ? TRIGGER_FENCE_NONE
+                                         : TRIGGER_FENCE_FULL;
+
+    if (program->count + chunks * GEMV_CHUNK_TRIGGERS + GEMV_STRIPE_TRIGGERS >
+        program->capacity) {
+        return -ENOSPC;
+    }
+
+    for (int c = 0; c < chunks; ++c) {
+        // === 1. Read input vector ===
+        for (int i = 0; i < vector_blocks; ++i) {
+            trigger_program_append(program,
+                                   input_vector_base_addrs[c] +
+                                       i * INPUT_VECTOR_BLOCK_STRIDE,
+                                   false, TRIGGER_FENCE_NONE);
+        }
+        trigger_program_fence(program, phase_fence);
+
+        // === 2. Execute Multiply and Accumulates ===
+        for (int i = 0; i < X16_ROWS; ++i) {
+            for (int j = 0; j < X16_COLUMNS; ++j) {
+                size_t offset =
+                    (i * NUM_ELEMENTS_IN_STRIPE) + (j * NUM_ELEMENTS_IN_COL);
+                uint16_t __iomem *block_addr =
+                    (block_masks[c] & (1ULL << (i * X16_COLUMNS + j)))
+                        ? matrix_base_addrs[c] + offset
+                        : zero_tile + offset;
+                trigger_program_append(program, block_addr, false,
+                                       TRIGGER_FENCE_NONE);
+            }
         }
+        trigger_program_fence(program, phase_fence);
     }
 
-    mb();
-
     // === 3. Execute FILLs for writing the output vector ===
-    for (int i = 0; i < X16_COLUMNS; ++i) {
-        trigger_write(output_vector_base_addr + i * BLOCK_IN_STRIPE_STRIDE);
+    for (int i = 0; i < output_blocks; ++i) {
+        trigger_program_append(program,
+                               output_vector_base_addr +
+                                   i * BLOCK_IN_STRIPE_STRIDE,
+                               true, TRIGGER_FENCE_NONE);
     }
-    mb();
+    trigger_program_fence(program, phase_fence);
 
     // === 4. Trigger EXIT ===
-    trigger_read(dummy_region_address);
-    mb();
+    trigger_program_append(program, dummy_region_address, false,
+                           TRIGGER_FENCE_FULL);
+    return 0;
 }
 
 /**
- * Partitions a large source matrix into multiple, newly allocated 64x128
- * sub-matrices. It returns a dynamically allocated array of pointers to these
- * chunks and writes the total number of chunks into the total_chunks_out
- * parameter.
+ * Number of tiles that fit into the free part of the data region. Every tile
+ * takes a PIM_MATRIX_ALIGNMENT aligned matrix and its partial sums, the first
+ * matrix may additionally need up to one alignment step.
  */
-static uint16_t **divide_matrix_in_64x128_chunks(uint16_t *matrix,
-                                                 uint32_t rows, uint32_t cols,
-                                                 uint32_t *total_chunks_out) {
-
-    uint32_t num_row_chunks;
-    uint32_t num_col_chunks;
-    uint32_t total_chunks;
+static uint32_t gemv_tiles_per_session(void) {
+    size_t tile_bytes =
+        (MATRIX_ROWS * MATRIX_COLS + MATRIX_ROWS * ELEMENT_COUNT_SUBMATRIX) *
+            sizeof(uint16_t) +
+        PIM_VECTOR_ALIGNMENT;
+    size_t footprint = ALIGN(tile_bytes, PIM_MATRIX_ALIGNMENT);
+    size_t free_bytes = pim_scratch_offset - current_start_free_mem_offset;
+
+    if (free_bytes < footprint + PIM_MATRIX_ALIGNMENT) {
+        return 0;
+    }
+    return (free_bytes - PIM_MATRIX_ALIGNMENT) / footprint;
+}
 
-    uint16_t **chunk_pointers;
-    const size_t chunk_size_bytes = 64 * 128 * sizeof(uint16_t);
-    const size_t row_size_bytes = 128 * sizeof(uint16_t);
+/**
+ * Chunks per stripe segment for stripes of up to
+ * 'horizontal_chunks' nonzero tiles if at most 'limit' fit into one segment,
+ * further bounded by the gemv_chunks module parameter. The segments of the
+ * densest stripe are balanced, so at most one chunk per segment has to be
+ * padded.
+ */
+static uint32_t gemv_segment_chunks(uint32_t horizontal_chunks,
+                                    uint32_t limit) {
+    unsigned int requested = READ_ONCE(gemv_chunks);
+    uint32_t segments;
 
-    if (rows % 64 != 0 || cols % 128 != 0) {
-        pr_err("Matrix dimensions must be a multiple of 64x128.\n");
-        return NULL;
+    limit = min_t(uint32_t, limit, KERNEL_GEMV_MAX_CHUNKS);
+    if (requested) {
+        limit = min_t(uint32_t, limit, requested);
     }
+    segments = DIV_ROUND_UP(horizontal_chunks, limit);
+    return DIV_ROUND_UP(horizontal_chunks, segments);
+}
 
-    // ---- Calculate chunk count and allocate pointer array ----
-    num_row_chunks = rows / 64;
-    num_col_chunks = cols / 128;
-    total_chunks = num_row_chunks * num_col_chunks;
+/**
+ * Top left element of the tile at chunk 'chunk' of output stripe 'stripe',
+ * i.e. tile (stripe, chunk) or (chunk, stripe) for the transposed GEMV, and
+ * the number of its rows and columns inside the matrix.
+ */
+static const uint16_t *gemv_tile(const struct gemv_context *ctx,
+                                 const uint16_t *matrix_data, uint32_t rows,
+                                 uint32_t cols, size_t stride, uint32_t stripe,
+                                 uint32_t chunk, int *valid_rows,
+                                 int *valid_cols) {
+    uint32_t i = ctx->transposed ? chunk : stripe;
+    uint32_t j = ctx->transposed ? stripe : chunk;
+
+    *valid_rows = min(rows - i * MATRIX_ROWS, (uint32_t)MATRIX_ROWS);
+    *valid_cols = min(cols - j * MATRIX_COLS, (uint32_t)MATRIX_COLS);
+    return matrix_data + (size_t)i * MATRIX_ROWS * stride + j * MATRIX_COLS;
+}
 
-    chunk_pointers =
-        kmalloc_array(total_chunks, sizeof(uint16_t *), GFP_KERNEL);
-    if (!chunk_pointers) {
-        return NULL;
+/**
+ * Executes the GEMV of a 'rows' x 'cols' matrix with row pitch 'stride'. The
+ * matrix is cut into MATRIX_ROWS x MATRIX_COLS tiles, which are streamed into
+ * PIM memory with rows and columns past the edge of the matrix padded with
+ * zeros on the fly. The kernel keeps its GRF_B accumulators live across all
+ * tiles of a row stripe segment, so every segment is FILLed and read back
+ * once instead of once per tile.
+ *
+ * Tiles without a nonzero element are dropped from a compact index of every
+ * row stripe before anything is uploaded, only the indexed tiles form the
+ * segments. Empty 16x16 blocks of an indexed tile are not uploaded either,
+ * their MACs read the zero tile. Segments that are short of a chunk point the
+ * missing tile and its input vector at the zero tile as well.
+ *
+ * As many segments as the data region holds form a session that runs inside
+ * a single PIM_ALL_BANK window. The partial sums of a session are copied out
+ * into one of two cached buffers and reduced into the shared gemv_context
+ * struct by a work item, while the next session is uploaded and executed.
+ *
+ * With ctx->transposed the result is A^T x and the stripes are column
+ * stripes. Their tiles are uploaded in the same layout and triggered in the
+ * same order, only the kernel swaps its register files and 'input_vectors'
+ * hold the broadcast layout of init_vector_broadcast.
+ */
+static int gemv_run_tiles(struct gemv_context *ctx,
+                          const uint16_t *matrix_data, uint32_t rows,
+                          uint32_t cols, size_t stride,
+                          uint16_t __iomem **input_vectors,
+                          uint16_t __iomem *dummy_region_address) {
+    uint32_t outputs = ctx->transposed ? cols : rows;
+    uint32_t stripe_outputs = gemv_stripe_outputs(ctx);
+    uint32_t stripes = DIV_ROUND_UP(outputs, stripe_outputs);
+    // Tiles along a stripe, each takes one input vector chunk
+    uint32_t stripe_chunks = ctx->transposed ? DIV_ROUND_UP(rows, MATRIX_ROWS)
+                                             : DIV_ROUND_UP(cols, MATRIX_COLS);
+    uint32_t room = gemv_tiles_per_session();
+    uint32_t chunks;
+    uint32_t tiles = 0;
+    uint32_t max_tiles = 0;
+    uint32_t total_segments = 0;
+    uint32_t per_session;
+    bool need_zero_tile = false;
+    // Compact tile index: chunk and block mask of every nonzero tile, the
+    // tiles of stripe i start at stripe_first[i]
+    uint32_t *stripe_first = NULL;
+    uint32_t *tile_chunks = NULL;
+    uint64_t *tile_masks = NULL;
+    struct gemv_segment *plan = NULL;
+    uint16_t __iomem *zero_tile = NULL;
+    uint16_t __iomem **chunk_addrs = NULL;
+    uint64_t *chunk_masks = NULL;
+    struct gemv_reduction *reductions = NULL;
+    struct gemv_reduction *pending = NULL;
+    struct trigger_program program = {0};
+    Microkernel kernel;
+    size_t tile_offset;
+    int ret = 0;
+
+    // At least one tile besides a possible zero tile
+    if (room < 2) {
+        pr_err("PIM_GEMV: No room for a tile in the data region\n");
+        return -ENOMEM;
     }
 
-    // ---- Copy data ----
-    for (uint32_t r_chunk = 0; r_chunk < num_row_chunks; ++r_chunk) {
-        for (uint32_t c_chunk = 0; c_chunk < num_col_chunks; ++c_chunk) {
-            uint32_t chunk_index = r_chunk * num_col_chunks + c_chunk;
+    memset(ctx->result_fixed, 0, outputs * sizeof(int64_t));
 
-            chunk_pointers[chunk_index] = kmalloc(chunk_size_bytes, GFP_KERNEL);
-            if (!chunk_pointers[chunk_index]) {
-                for (uint32_t i = 0; i < chunk_index; ++i)
-                    kfree(chunk_pointers[i]);
-                kfree(chunk_pointers);
-                return NULL;
-            }
+    stripe_first = kmalloc_array(stripes + 1, sizeof(*stripe_first),
+                                 GFP_KERNEL);
+    tile_chunks = kvmalloc_array((size_t)stripes * stripe_chunks,
+                                 sizeof(*tile_chunks), GFP_KERNEL);
+    tile_masks = kvmalloc_array((size_t)stripes * stripe_chunks,
+                                sizeof(*tile_masks), GFP_KERNEL);
+    if (!stripe_first || !tile_chunks || !tile_masks) {
+        ret = -ENOMEM;
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < stripes; i++) {
+        stripe_first[i] = tiles;
+        for (uint32_t j = 0; j < stripe_chunks; j++) {
+            int valid_rows;
+            int valid_cols;
+            const uint16_t *origin =
+                gemv_tile(ctx, matrix_data, rows, cols, stride, i, j,
+                          &valid_rows, &valid_cols);
+            uint64_t mask = matrix_tile_block_mask(origin, stride, valid_rows,
+                                                   valid_cols);
 
-            // Copy the data for the current chunk row by row
-            for (uint32_t row_in_chunk = 0; row_in_chunk < 64; ++row_in_chunk) {
-                uint32_t src_row = r_chunk * 64 + row_in_chunk;
-                uint32_t src_col = c_chunk * 128;
-                uint16_t *src_ptr = matrix + (src_row * cols + src_col);
-                uint16_t *dest_ptr =
-                    chunk_pointers[chunk_index] + (row_in_chunk * 128);
-                memcpy(dest_ptr, src_ptr, row_size_bytes);
+            if (!mask) {
+                continue;
             }
+            need_zero_tile |= mask != MATRIX_TILE_ALL_BLOCKS;
+            tile_chunks[tiles] = j;
+            tile_masks[tiles++] = mask;
         }
+        max_tiles = max(max_tiles, tiles - stripe_first[i]);
     }
+    stripe_first[stripes] = tiles;
 
-    *total_chunks_out = num_row_chunks;
-    return chunk_pointers;
-}
-
-/**
- * Deallocates all memory associated with a matrix previously partitioned by
- * divide_matrix_in_pim_chunks.
- */
-static void free_matrix_chunks(uint16_t **chunks, uint32_t total_chunks) {
-    if (!chunks) {
-        return;
-    }
-    for (uint32_t i = 0; i < total_chunks; ++i) {
-        kfree(chunks[i]);
+    // A zero matrix, the zeroed result is complete
+    if (!tiles) {
+        goto cleanup;
     }
-    kfree(chunks);
-}
 
-/**
- * Executes a GEMV Operation for a 64x128 Matrix by initializing the matrix and
- * the partial output vector and then calling gemv_execute to trigger the
- * PIM-VM. It then reads the partial result from the hardware and accumulates it
- * into the shared gemv_context struct for final processing.
- */
-static int gemv_64x128_chunk(struct gemv_context *ctx, uint16_t *matrix_data,
-                             uint16_t __iomem *input_vector_address,
-                             uint16_t __iomem *dummy_region_address,
-                             int row_ind_chunk, int col_ind_chunk,
-                             int total_rows) {
-    uint16_t *transformed_matrix_data = NULL;
-    uint16_t __iomem *init_matrix_address = NULL;
-    uint16_t __iomem *output_partial_sum_vector = NULL;
-    int ret = 0;
+    chunks = gemv_segment_chunks(max_tiles, room - 1);
+    for (uint32_t i = 0; i < stripes; i++) {
+        uint32_t stripe_tiles = stripe_first[i + 1] - stripe_first[i];
 
-    transformed_matrix_data = kmalloc(64 * 128 * sizeof(uint16_t), GFP_KERNEL);
+        total_segments += DIV_ROUND_UP(stripe_tiles, chunks);
+        need_zero_tile |= stripe_tiles % chunks != 0;
+    }
 
-    // Test if allocation was successful
-    if (!ctx->result_integer_part || !ctx->result_fractional_part ||
-        !transformed_matrix_data || !ctx->result_in_f16_bin) {
-        pr_err("PIM_GEMV: Failed to allocate memory on the heap.\n");
+    plan = kvmalloc_array(total_segments, sizeof(*plan), GFP_KERNEL);
+    if (!plan) {
         ret = -ENOMEM;
         goto cleanup;
     }
+    total_segments = 0;
+    for (uint32_t i = 0; i < stripes; i++) {
+        for (uint32_t k = stripe_first[i]; k < stripe_first[i + 1];
+             k += chunks) {
+            struct gemv_segment *segment = &plan[total_segments++];
+
+            segment->stripe = i;
+            segment->first_tile = k;
+            segment->tiles = min(stripe_first[i + 1] - k, chunks);
+            segment->valid_outputs =
+                min(outputs - i * stripe_outputs, stripe_outputs);
+        }
+    }
 
-    transform_matrix(matrix_data, transformed_matrix_data);
-    init_matrix_address = init_matrix_flat(transformed_matrix_data, 64 * 128);
-    if (!init_matrix_address) {
-        ret = -ENOMEM;
+    if (need_zero_tile) {
+        zero_tile = init_matrix_tiled(matrix_data, stride, 0, 0,
+                                      MATRIX_TILE_ALL_BLOCKS);
+        if (!zero_tile) {
+            ret = -ENOMEM;
+            goto cleanup;
+        }
+        room--;
+    }
+    per_session = min(room / chunks, total_segments);
+    tile_offset = current_start_free_mem_offset;
+
+    ret = ctx->transposed ? build_kernel_gemv_transposed(&kernel, chunks)
+                          : build_kernel_gemv_chunks(&kernel, chunks);
+    if (ret) {
+        goto cleanup;
+    }
+    ret = set_microkernel(&kernel);
+    if (ret < 0) {
         goto cleanup;
     }
+    ret = 0;
 
-    output_partial_sum_vector =
-        init_vector_result(64 * ELEMENT_COUNT_SUBMATRIX);
-    if (!output_partial_sum_vector) {
+    // Matrix addresses of the chunks followed by their input vectors
+    chunk_addrs = kmalloc_array(2 * chunks, sizeof(*chunk_addrs), GFP_KERNEL);
+    chunk_masks = kmalloc_array(chunks, sizeof(*chunk_masks), GFP_KERNEL);
+    reductions = kcalloc(2, sizeof(*reductions), GFP_KERNEL);
+    if (!chunk_addrs || !chunk_masks || !reductions) {
         ret = -ENOMEM;
         goto cleanup;
     }
+    for (int b = 0; b < 2; b++) {
+        struct gemv_reduction *reduction = &reductions[b];
+
+        INIT_WORK(&reduction->work, gemv_reduce_work);
+        reduction->ctx = ctx;
+        reduction->segments = kmalloc_array(
+            per_session, sizeof(*reduction->segments), GFP_KERNEL);
+        reduction->readback =
+            kvmalloc_array((size_t)per_session * GEMV_PARTIAL_ELEMENTS,
+                           sizeof(uint16_t), GFP_KERNEL);
+        reduction->row_sums =
+            kmalloc_array(stripe_outputs, sizeof(int64_t), GFP_KERNEL);
+        if (!reduction->segments || !reduction->readback ||
+            !reduction->row_sums) {
+            ret = -ENOMEM;
+            goto cleanup;
+        }
+    }
+    ret = trigger_program_init(
+        &program,
+        per_session * (chunks * GEMV_CHUNK_TRIGGERS + GEMV_STRIPE_TRIGGERS),
+        pim_ordering_policy());
+    if (ret) {
+        goto cleanup;
+    }
 
-    dsb(SY);
-    set_bank_mode(PIM_ALL_BANK);
+    for (uint32_t first = 0; first < total_segments; first += per_session) {
+        uint32_t count = min(total_segments - first, per_session);
+        // The buffer of the session before the previous one, already reduced
+        struct gemv_reduction *reduction =
+            &reductions[(first / per_session) % 2];
+        struct gemv_segment *segments = reduction->segments;
+
+        // The partial sums of the previous session have been copied out,
+        // reuse their room
+        current_start_free_mem_offset = tile_offset;
+        program.count = 0;
+
+        for (uint32_t t = 0; t < count; t++) {
+            struct gemv_segment *segment = &segments[t];
+
+            *segment = plan[first + t];
+
+            for (uint32_t c = 0; c < chunks; c++) {
+                uint32_t k = segment->first_tile + c;
+                const uint16_t *origin;
+                int valid_rows;
+                int valid_cols;
+                uint32_t j;
+
+                if (c >= segment->tiles) {
+                    chunk_addrs[c] = zero_tile;
+                    chunk_addrs[chunks + c] = zero_tile;
+                    chunk_masks[c] = MATRIX_TILE_ALL_BLOCKS;
+                    continue;
+                }
+
+                j = tile_chunks[k];
+                origin = gemv_tile(ctx, matrix_data, rows, cols, stride,
+                                   segment->stripe, j, &valid_rows,
+                                   &valid_cols);
+                chunk_addrs[c] = init_matrix_tiled(origin, stride, valid_rows,
+                                                   valid_cols, tile_masks[k]);
+                if (!chunk_addrs[c]) {
+                    ret = -ENOMEM;
+                    goto cleanup;
+                }
+                chunk_addrs[chunks + c] = input_vectors[j];
+                chunk_masks[c] = tile_masks[k];
+            }
 
-    for (int i = 0; i < ctx->repetitions; i++) {
-        gemv_execute(init_matrix_address, input_vector_address,
-                     output_partial_sum_vector, dummy_region_address);
-    }
+            // FILL overwrites every block, the partial sums need no zeroing
+            segment->partial_sums = alloc_vector_result(GEMV_PARTIAL_ELEMENTS);
+            if (!segment->partial_sums) {
+                ret = -ENOMEM;
+                goto cleanup;
+            }
+
+            ret = gemv_compile(&program, chunk_addrs, chunk_addrs + chunks,
+                               chunk_masks, chunks, ctx->transposed, zero_tile,
+                               segment->partial_sums, dummy_region_address);
+            if (ret) {
+                goto cleanup;
+            }
+        }
+
+        dsb(SY);
+        set_bank_mode(PIM_ALL_BANK);
+
+        for (int r = 0; r < ctx->repetitions; r++) {
+            trigger_program_replay(&program);
+        }
+
+        dsb(sy);
 
-    dsb(sy);
+        set_bank_mode(SINGLE_BANK);
 
-    set_bank_mode(SINGLE_BANK);
+        for (uint32_t t = 0; t < count; t++) {
+            memcpy_fromio(reduction->readback + t * GEMV_PARTIAL_ELEMENTS,
+                          segments[t].partial_sums,
+                          gemv_partial_bytes(ctx, &segments[t]));
+        }
 
-    accumulate_result_vector(ctx, output_partial_sum_vector, row_ind_chunk,
-                             col_ind_chunk, total_rows);
+        // Reductions touch the same outputs, they must not run concurrently
+        if (pending) {
+            flush_work(&pending->work);
+        }
+        reduction->count = count;
+        queue_work(system_unbound_wq, &reduction->work);
+        pending = reduction;
+    }
 
 cleanup:
-    kfree(transformed_matrix_data);
+    if (pending) {
+        flush_work(&pending->work);
+    }
+    trigger_program_free(&program);
+    if (reductions) {
+        for (int b = 0; b < 2; b++) {
+            kfree(reductions[b].segments);
+            kvfree(reductions[b].readback);
+            kfree(reductions[b].row_sums);
+        }
+    }
+    kfree(reductions);
+    kfree(chunk_masks);
+    kfree(chunk_addrs);
+    kvfree(plan);
+    kvfree(tile_masks);
+    kvfree(tile_chunks);
+    kfree(stripe_first);
     return ret;
 }
 
 /**
  * Splits a flat source vector into 128-element chunks and creates an
- * interleaved vector for each chunk. Returns a newly allocated array of
- * pointers to these new vectors.
+ * interleaved vector (a broadcast vector for the transposed GEMV) for each
+ * chunk. The last chunk is padded with zeros if 'cols' is not a multiple of
+ * 128. Returns a newly allocated array of pointers to these new vectors.
  */
 static uint16_t __iomem **init_input_vector(int cols,
-                                            uint16_t *input_vector_data) {
-    int num_input_vectors = cols / 128;
+                                            uint16_t *input_vector_data,
+                                            bool transposed) {
+    int num_input_vectors = DIV_ROUND_UP(cols, 128);
+    uint16_t padded_chunk[128];
 
     uint16_t __iomem **new_vectors =
         kmalloc_array(num_input_vectors, sizeof(uint16_t *), GFP_KERNEL);
@@ -410,8 +704,18 @@ static uint16_t __iomem **init_input_vector(int cols,
     }
 
     for (int i = 0; i < num_input_vectors; i++) {
-        new_vectors[i] =
-            init_vector_interleaved(input_vector_data + i * 128, 8);
+        uint16_t *chunk = input_vector_data + i * 128;
+        int valid = min(cols - i * 128, 128);
+
+        if (valid < 128) {
+            memcpy(padded_chunk, chunk, valid * sizeof(uint16_t));
+            memset(padded_chunk + valid, 0,
+                   (128 - valid) * sizeof(uint16_t));
+            chunk = padded_chunk;
+        }
+
+        new_vectors[i] = transposed ? init_vector_broadcast(chunk, 8)
+                                    : init_vector_interleaved(chunk, 8);
         if (!new_vectors[i]) {
             kfree(new_vectors);
             return NULL;
@@ -428,8 +732,6 @@ void gemv_driver_code(void) {
     uint16_t *input_vector_data = NULL;
     uint16_t *matrix_data = NULL;
     uint16_t __iomem *dummy_region_address = NULL;
-    uint16_t **all_chunks_data = NULL;
-    uint32_t num_chunks_data = 0;
 
     uint16_t __iomem **input_vectors = NULL;
     int ret = 0;
@@ -478,25 +780,14 @@ void gemv_driver_code(void) {
 
     ctx.repetitions = 4096 / 128;
 
-    all_chunks_data = divide_matrix_in_64x128_chunks(matrix_data, rows, cols,
-                                                     &num_chunks_data);
-    if (!all_chunks_data) {
-        ret = -ENOMEM;
-        goto cleanup;
-    }
-
-    ctx.result_integer_part = kmalloc(rows * sizeof(int32_t), GFP_KERNEL);
-    ctx.result_fractional_part = kmalloc(rows * sizeof(int32_t), GFP_KERNEL);
+    ctx.result_fixed = kmalloc(rows * sizeof(int64_t), GFP_KERNEL);
     ctx.result_in_f16_bin = kmalloc(rows * sizeof(uint16_t), GFP_KERNEL);
-    if (!ctx.result_integer_part || !ctx.result_fractional_part ||
-        !ctx.result_in_f16_bin) {
+    if (!ctx.result_fixed || !ctx.result_in_f16_bin) {
         ret = -ENOMEM;
         goto cleanup;
     }
 
-    set_kernel(build_kernel_gemv);
-
-    input_vectors = init_input_vector(cols, input_vector_data);
+    input_vectors = init_input_vector(cols, input_vector_data, false);
     if (!input_vectors) {
         ret = -ENOMEM;
         goto cleanup;
@@ -507,37 +798,93 @@ void gemv_driver_code(void) {
         ret = -ENOMEM;
         goto cleanup;
     }
-    for (int i = 0; i < rows / 64; ++i) {
-        for (int j = 0; j < cols / 128; ++j) {
-            uint16_t *current_chunk_ptr = all_chunks_data[i * (cols / 128) + j];
-            gemv_64x128_chunk(&ctx, current_chunk_ptr, input_vectors[j],
-                              dummy_region_address, i, j, rows);
-        }
+    ret = gemv_run_tiles(&ctx, matrix_data, rows, cols, cols, input_vectors,
+                         dummy_region_address);
+    if (ret) {
+        goto cleanup;
     }
 
     pr_err("--------- RESULT-VECTOR IS ---------:");
     pr_err("MATRIX ROWS: %d\n", rows);
     for (int i = 0; i < rows; i++) {
-        pr_err("VAL %d: %d.%03u, ", i, ctx.result_integer_part[i],
-               ctx.result_fractional_part[i]);
+        int64_t value = ctx.result_fixed[i];
+        uint64_t magnitude = value < 0 ? -(uint64_t)value : value;
+
+        pr_err("VAL %d: %s%llu.%03llu, ", i, value < 0 ? "-" : "",
+               magnitude >> FIX_POINT_SHIFT,
+               ((magnitude & ((1ULL << FIX_POINT_SHIFT) - 1)) * 1000) >>
+                   FIX_POINT_SHIFT);
     }
     pr_err("Done.");
 
 cleanup:
     // Free all allocated memory
-    kfree(ctx.result_integer_part);
-    kfree(ctx.result_fractional_part);
+    kfree(ctx.result_fixed);
     kfree(ctx.result_in_f16_bin);
     vfree(matrix_data);
     kfree(input_vectors);
     vfree(input_vector_data);
-    free_matrix_chunks(all_chunks_data, num_chunks_data);
 
     if (ret != 0) {
         pr_err("gemv_driver_code failed with error %d\n", ret);
     }
 }
 
+/**
+ * Predicted time of a GEMV of the given shape on the PIM units.
+ */
+static uint64_t gemv_pim_estimate(const struct pim_op_shape *shape) {
+    struct pim_cost cost;
+    Microkernel kernel;
+    uint32_t horizontal_chunks = DIV_ROUND_UP(shape->cols, MATRIX_COLS);
+
+    if (build_kernel_gemv_chunks(
+            &kernel,
+            gemv_segment_chunks(horizontal_chunks, KERNEL_GEMV_MAX_CHUNKS)) ||
+        pim_cost_analyze(&kernel, shape, &pim_cost_calibration, &cost)) {
+        return U64_MAX;
+    }
+    return cost.estimated_ns;
+}
+
+/**
+ * Computes the GEMV on the host and copies the result to user space.
+ */
+static int gemv_on_cpu(__u64 result_addr, uint16_t *input_vector_data,
+                       uint16_t *matrix_data, uint32_t matrix_rows,
+                       uint32_t matrix_cols, bool transposed,
+                       const struct pim_gemv_epilogue *epilogue,
+                       const uint16_t *bias) {
+    uint32_t outputs = transposed ? matrix_cols : matrix_rows;
+    uint16_t *result;
+    int ret = 0;
+
+    result = kvmalloc_array(outputs, sizeof(uint16_t), GFP_KERNEL);
+    if (!result) {
+        return -ENOMEM;
+    }
+
+    if (transposed) {
+        cpu_gemv_transposed(result, matrix_data, input_vector_data,
+                            matrix_rows, matrix_cols);
+    } else {
+        cpu_gemv(result, matrix_data, input_vector_data, matrix_rows,
+                 matrix_cols);
+    }
+    for (uint32_t i = 0; i < outputs; i++) {
+        result[i] = gemv_epilogue_row(epilogue, bias, i, result[i]);
+    }
+
+    if (copy_to_user((void __user *)result_addr, result,
+                     outputs * sizeof(uint16_t))) {
+        pr_err("PIM: Failed to copy result vector to user\n");
+        ret = -EFAULT;
+    }
+
+    kvfree(result);
+    return ret;
+}
+
 /**
  * Executes a general matrix-vector multiplication (GEMV) using input data
  * from user space. Initializes PIM memory regions, performs the GEMV
@@ -545,77 +892,88 @@ cleanup:
  */
 int gemv_from_userspace(__u64 result_addr, uint16_t *input_vector_data,
                         uint16_t *matrix_data, uint32_t len_input_vector,
-                        uint32_t matrix_rows, uint32_t matrix_cols) {
+                        uint32_t matrix_rows, uint32_t matrix_cols,
+                        bool transposed,
+                        const struct pim_gemv_epilogue *epilogue,
+                        const uint16_t *bias) {
     uint16_t __iomem *dummy_region_address = NULL;
-    uint16_t **all_chunks_data = NULL;
-    uint32_t num_chunks_data = 0;
     uint16_t __iomem **input_vectors = NULL;
     int ret = 0;
 
-    uint32_t processing_cols;
-    uint32_t horizontal_chunks;
+    // The input vector runs along the columns, or the rows for A^T x
+    uint32_t reduction_len = transposed ? matrix_rows : matrix_cols;
+    uint32_t outputs = transposed ? matrix_cols : matrix_rows;
+    uint32_t processing_len;
 
     struct gemv_context ctx;
+    // A^T x triggers the same tiles as a GEMV with the dimensions swapped
+    const struct pim_op_shape shape = {
+        .kind = PIM_SHAPE_GEMV,
+        .rows = outputs,
+        .cols = reduction_len,
+    };
+
+    if (len_input_vector != reduction_len) {
+        pr_err("PIM: GEMV input vector length must match the %s\n",
+               transposed ? "rows" : "columns");
+        return -EINVAL;
+    }
+
+    // Small matrices do not amortize the tile uploads and bank mode switches
+    if (cpu_fallback_preferred(&shape, gemv_pim_estimate(&shape))) {
+        return gemv_on_cpu(result_addr, input_vector_data, matrix_data,
+                           matrix_rows, matrix_cols, transposed, epilogue,
+                           bias);
+    }
+
     memset(&ctx, 0, sizeof(struct gemv_context));
+    ctx.transposed = transposed;
 
-    if (EVALUATION_MODE) {
-        pr_info("gemv_from_userspace called in EVALUATION_MODE ...");
-        processing_cols = 128;
-        ctx.repetitions = matrix_cols / 128;
+    if (READ_ONCE(gemv_evaluation)) {
+        pr_info("gemv_from_userspace called in evaluation mode ...");
+        processing_len = min_t(uint32_t, reduction_len, MATRIX_COLS);
+        ctx.repetitions = DIV_ROUND_UP(reduction_len, MATRIX_COLS);
     } else {
-        processing_cols = matrix_cols;
+        processing_len = reduction_len;
         ctx.repetitions = 1;
     }
-    horizontal_chunks = processing_cols / 128;
 
-    ctx.result_integer_part =
-        kmalloc(matrix_rows * sizeof(int32_t), GFP_KERNEL);
-    ctx.result_fractional_part =
-        kmalloc(matrix_rows * sizeof(int32_t), GFP_KERNEL);
-    ctx.result_in_f16_bin = kmalloc(matrix_rows * sizeof(uint16_t), GFP_KERNEL);
-    if (!ctx.result_integer_part || !ctx.result_fractional_part ||
-        !ctx.result_in_f16_bin) {
+    ctx.result_fixed = kmalloc(outputs * sizeof(int64_t), GFP_KERNEL);
+    ctx.result_in_f16_bin = kmalloc(outputs * sizeof(uint16_t), GFP_KERNEL);
+    if (!ctx.result_fixed || !ctx.result_in_f16_bin) {
         ret = -ENOMEM;
         goto cleanup;
     }
 
-    set_kernel(build_kernel_gemv);
-
     dummy_region_address = init_dummy_memory_region();
     if (!dummy_region_address) {
         ret = -ENOMEM;
         goto cleanup;
     }
 
-    all_chunks_data = divide_matrix_in_64x128_chunks(
-        matrix_data, matrix_rows, processing_cols, &num_chunks_data);
-    if (!all_chunks_data) {
-        ret = -ENOMEM;
-        goto cleanup;
-    }
-
-    input_vectors = init_input_vector(processing_cols, input_vector_data);
+    input_vectors =
+        init_input_vector(processing_len, input_vector_data, transposed);
     if (!input_vectors) {
         ret = -ENOMEM;
         goto cleanup;
     }
 
-    for (int i = 0; i < matrix_rows / 64; ++i) {
-        for (int j = 0; j < horizontal_chunks; ++j) {
-            uint16_t *current_chunk_ptr =
-                all_chunks_data[i * horizontal_chunks + j];
-            gemv_64x128_chunk(&ctx, current_chunk_ptr, input_vectors[j],
-                              dummy_region_address, i, j, matrix_rows);
-        }
+    ret = gemv_run_tiles(&ctx, matrix_data,
+                         transposed ? processing_len : matrix_rows,
+                         transposed ? matrix_cols : processing_len,
+                         matrix_cols, input_vectors, dummy_region_address);
+    if (ret) {
+        goto cleanup;
     }
 
-    for (int i = 0; i < matrix_rows; i++) {
-        ctx.result_in_f16_bin[i] = kernel_parts_to_f16(
-            ctx.result_integer_part[i], ctx.result_fractional_part[i]);
+    // The conversion touches every row anyway, the epilogue rides along
+    for (int i = 0; i < outputs; i++) {
+        ctx.result_in_f16_bin[i] = gemv_epilogue_row(
+            epilogue, bias, i, fixed_to_f16(ctx.result_fixed[i]));
     }
 
     if (copy_to_user((void __user *)result_addr, ctx.result_in_f16_bin,
-                     matrix_rows * sizeof(uint16_t))) {
+                     outputs * sizeof(uint16_t))) {
         pr_err("PIM: Failed to copy result vector to user\n");
         ret = -EFAULT;
     } else {
@@ -624,14 +982,13 @@ int gemv_from_userspace(__u64 result_addr, uint16_t *input_vector_data,
 
 cleanup:
     // Free all allocated memory
-    kfree(ctx.result_integer_part);
-    kfree(ctx.result_fractional_part);
+    kfree(ctx.result_fixed);
     kfree(ctx.result_in_f16_bin);
-    free_matrix_chunks(all_chunks_data, num_chunks_data);
+    kfree(input_vectors);
 
     if (ret != 0) {
-        pr_err("gemv_driver_code failed with error %d\n", ret);
+        pr_err("gemv_from_userspace failed with error %d\n", ret);
     }
 
     return ret;
-}
\ No newline at end of file
+}
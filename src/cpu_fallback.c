@@ -0,0 +1,422 @@
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+
+#include "../include/cpu_fallback.h"
+#include "../include/cpu_fallback_kernels.h"
+#include "../include/pim_f16.h"
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+#include <asm/neon.h>
+#endif
+
+static unsigned int cpu_crossover;
+module_param(cpu_crossover, uint, 0644);
+MODULE_PARM_DESC(cpu_crossover,
+                 "Ops with fewer elements (len resp. rows * cols) run on the "
+                 "CPU, 0 picks the crossover from the cost model");
+
+static uint64_t shape_elements(const struct pim_op_shape *shape) {
+    if (shape->kind == PIM_SHAPE_GEMV) {
+        return (uint64_t)shape->rows * shape->cols;
+    }
+    return shape->len;
+}
+
+bool cpu_fallback_preferred(const struct pim_op_shape *shape, uint64_t pim_ns) {
+    unsigned int crossover = READ_ONCE(cpu_crossover);
+
+    if (crossover) {
+        return shape_elements(shape) < crossover;
+    }
+    return pim_cost_estimate_cpu(shape, &pim_cost_calibration) < pim_ns;
+}
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+
+static inline void simd_begin(void) {
+    kernel_neon_begin();
+}
+
+static inline void simd_end(void) {
+    kernel_neon_end();
+}
+
+#else
+
+#define F32_SIGN_MASK 0x80000000U
+#define F32_INFINITY 0x7F800000U
+#define F32_QUIET_NAN 0x7FC00000U
+
+// Largest shift that keeps the aligned f32 significands of a sum in 63 bits
+#define F32_ALIGN_MAX 38
+
+/*
+ * Integer only f32 arithmetic, so that the GEMV fallback accumulates like
+ * the NEON build: products of two f16 values are exact in f32, every sum is
+ * rounded to nearest even and the total is rounded to f16 once.
+ */
+
+static uint64_t f32_shift_round(uint64_t value, int shift) {
+    uint64_t rest;
+    uint64_t half;
+
+    if (shift <= 0) {
+        return value << -shift;
+    }
+    if (shift >= 64) {
+        return 0;
+    }
+    rest = value & ((1ULL << shift) - 1);
+    half = 1ULL << (shift - 1);
+    value >>= shift;
+    if (rest > half || (rest == half && (value & 1))) {
+        value++;
+    }
+    return value;
+}
+
+/**
+ * Rounds sign * magnitude * 2^exponent to the nearest f32 value.
+ */
+static uint32_t f32_round(bool negative, uint64_t magnitude, int exponent) {
+    uint32_t sign = negative ? F32_SIGN_MASK : 0;
+    uint64_t significand;
+    int value_exponent;
+    int msb;
+
+    if (magnitude == 0) {
+        return sign;
+    }
+
+    msb = fls64(magnitude) - 1;
+    value_exponent = msb + exponent;
+
+    if (value_exponent < -126) {
+        // Denormals are multiples of 2^-149, rounding up to 2^23 gives the
+        // smallest normal number
+        return sign | (uint32_t)f32_shift_round(magnitude, -149 - exponent);
+    }
+
+    significand = f32_shift_round(magnitude, msb - 23);
+    if (significand >> 24) {
+        significand >>= 1;
+        value_exponent++;
+    }
+    if (value_exponent > 127) {
+        return sign | F32_INFINITY;
+    }
+    return sign | (uint32_t)(value_exponent + 127) << 23 |
+           (uint32_t)(significand & 0x7FFFFF);
+}
+
+static uint64_t f32_unpack(uint32_t value, int *exponent) {
+    int biased = (value >> 23) & 0xFF;
+
+    *exponent = biased ? biased - 150 : -149;
+    return biased ? (value & 0x7FFFFF) | 0x800000 : value & 0x7FFFFF;
+}
+
+static uint64_t f16_unpack(uint16_t value, int *exponent) {
+    int biased = (value >> 10) & 0x1F;
+
+    *exponent = biased ? biased - 25 : -24;
+    return biased ? (value & 0x3FF) | 0x400 : value & 0x3FF;
+}
+
+static bool f16_is_special(uint16_t value) {
+    return (value & F16_INFINITY) == F16_INFINITY;
+}
+
+static uint32_t f32_mul_f16(uint16_t a, uint16_t b) {
+    bool negative = (a ^ b) & F16_SIGN_MASK;
+    uint64_t magnitude_a;
+    uint64_t magnitude_b;
+    int exponent_a;
+    int exponent_b;
+
+    magnitude_a = f16_unpack(a, &exponent_a);
+    magnitude_b = f16_unpack(b, &exponent_b);
+
+    if (f16_is_special(a) || f16_is_special(b)) {
+        // NaN, or infinity times zero
+        if ((f16_is_special(a) && (a & 0x3FF)) ||
+            (f16_is_special(b) && (b & 0x3FF)) || !magnitude_a ||
+            !magnitude_b) {
+            return F32_QUIET_NAN;
+        }
+        return (negative ? F32_SIGN_MASK : 0) | F32_INFINITY;
+    }
+    return f32_round(negative, magnitude_a * magnitude_b,
+                     exponent_a + exponent_b);
+}
+
+static uint32_t f32_add(uint32_t a, uint32_t b) {
+    bool negative_a = a & F32_SIGN_MASK;
+    bool negative_b = b & F32_SIGN_MASK;
+    uint64_t magnitude_a;
+    uint64_t magnitude_b;
+    int exponent_a;
+    int exponent_b;
+    int shift;
+    int drop;
+
+    if ((a & F32_INFINITY) == F32_INFINITY ||
+        (b & F32_INFINITY) == F32_INFINITY) {
+        if ((a & ~F32_SIGN_MASK) > F32_INFINITY ||
+            (b & ~F32_SIGN_MASK) > F32_INFINITY ||
+            ((a & F32_INFINITY) == F32_INFINITY &&
+             (b & F32_INFINITY) == F32_INFINITY && negative_a != negative_b)) {
+            return F32_QUIET_NAN;
+        }
+        return (a & F32_INFINITY) == F32_INFINITY ? a : b;
+    }
+
+    magnitude_a = f32_unpack(a, &exponent_a);
+    magnitude_b = f32_unpack(b, &exponent_b);
+    if (!magnitude_a || !magnitude_b) {
+        // -0 + -0 is the only sum with a negative zero
+        return magnitude_a ? a : magnitude_b ? b : a & b;
+    }
+
+    if (exponent_a < exponent_b) {
+        swap(magnitude_a, magnitude_b);
+        swap(exponent_a, exponent_b);
+        swap(negative_a, negative_b);
+    }
+
+    // Exact up to F32_ALIGN_MAX, further away b only acts as a sticky bit
+    // far below the rounding position of a
+    shift = min(exponent_a - exponent_b, F32_ALIGN_MAX);
+    drop = exponent_a - exponent_b - shift;
+    magnitude_a <<= shift;
+    if (drop >= 64) {
+        magnitude_b = 1;
+    } else if (drop) {
+        magnitude_b = (magnitude_b >> drop) |
+                      !!(magnitude_b & ((1ULL << drop) - 1));
+    }
+
+    if (negative_a == negative_b) {
+        return f32_round(negative_a, magnitude_a + magnitude_b,
+                         exponent_a - shift);
+    }
+    if (magnitude_a == magnitude_b) {
+        return 0;
+    }
+    if (magnitude_a < magnitude_b) {
+        return f32_round(negative_b, magnitude_b - magnitude_a,
+                         exponent_a - shift);
+    }
+    return f32_round(negative_a, magnitude_a - magnitude_b,
+                     exponent_a - shift);
+}
+
+static uint16_t f32_to_f16(uint32_t value) {
+    bool negative = value & F32_SIGN_MASK;
+    uint64_t magnitude;
+    int exponent;
+
+    if ((value & F32_INFINITY) == F32_INFINITY) {
+        if (value & 0x7FFFFF) {
+            return F16_QUIET_NAN;
+        }
+        return (negative ? F16_SIGN_MASK : 0) | F16_INFINITY;
+    }
+    magnitude = f32_unpack(value, &exponent);
+    return f16_round(negative, magnitude, exponent);
+}
+
+static uint16_t scalar_elementwise(InstructionType opcode, bool scale_bank,
+                                   uint16_t scalar, uint16_t a, uint16_t b,
+                                   uint16_t c) {
+    switch (opcode) {
+    case ADD:
+        return scale_bank ? f16_mul_add(b, scalar, a) : f16_add(b, a);
+    case MUL:
+        return f16_mul(b, a);
+    default:
+        return f16_mul_add(b, a, c);
+    }
+}
+
+void fallback_compute_chunk(InstructionType opcode, bool scale_bank,
+                            uint16_t scalar, const uint16_t *a,
+                            const uint16_t *b, const uint16_t *c,
+                            uint16_t *result, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        result[i] = scalar_elementwise(opcode, scale_bank, scalar, a[i], b[i],
+                                       c ? c[i] : 0);
+    }
+}
+
+uint16_t fallback_dot_row(const uint16_t *row, const uint16_t *vector,
+                          uint32_t cols) {
+    uint32_t lanes[4] = {0};
+    uint32_t total;
+    uint32_t i = 0;
+
+    // Same summation order as the four NEON lanes
+    for (; i + 4 <= cols; i += 4) {
+        for (int l = 0; l < 4; l++) {
+            lanes[l] =
+                f32_add(lanes[l], f32_mul_f16(row[i + l], vector[i + l]));
+        }
+    }
+    total = f32_add(f32_add(lanes[0], lanes[1]), f32_add(lanes[2], lanes[3]));
+
+    for (; i < cols; i++) {
+        total = f32_add(total, f32_mul_f16(row[i], vector[i]));
+    }
+    return f32_to_f16(total);
+}
+
+void fallback_dot_columns(uint16_t *result, const uint16_t *matrix,
+                          const uint16_t *vector, uint32_t rows,
+                          uint32_t cols, uint32_t n) {
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t total = 0;
+
+        for (uint32_t r = 0; r < rows; r++) {
+            total = f32_add(total, f32_mul_f16(matrix[(size_t)r * cols + k],
+                                               vector[r]));
+        }
+        result[k] = f32_to_f16(total);
+    }
+}
+
+/**
+ * Truncates an f16 value times 2^shift toward zero, for shift <= 24.
+ * Infinities saturate to 2^(16 + shift), NaN becomes 0.
+ */
+static int64_t f16_to_fixed(uint16_t value, int shift) {
+    int exponent = (value >> 10) & 0x1F;
+    int64_t magnitude = value & 0x3FF;
+
+    if (exponent == 0x1F) {
+        if (magnitude) {
+            return 0;
+        }
+        magnitude = 1LL << (16 + shift);
+    } else if (exponent == 0) {
+        // Denormals are magnitude * 2^-24
+        magnitude >>= 24 - shift;
+    } else {
+        int scale = exponent - 25 + shift;
+
+        magnitude |= 0x400;
+        magnitude = scale >= 0 ? magnitude << scale : magnitude >> -scale;
+    }
+    return (value & F16_SIGN_MASK) ? -magnitude : magnitude;
+}
+
+int64_t fallback_sum_lanes_fixed(const uint16_t *lanes, int shift) {
+    int64_t sum = 0;
+
+    for (int i = 0; i < CPU_LANES; i++) {
+        sum += f16_to_fixed(lanes[i], shift);
+    }
+    return sum;
+}
+
+void fallback_sum_banks_fixed(const uint16_t *block, int shift,
+                              int64_t *sums) {
+    for (int l = 0; l < CPU_LANES; l++) {
+        sums[l] = 0;
+        for (int b = 0; b < CPU_LANES; b++) {
+            sums[l] += f16_to_fixed(block[b * CPU_LANES + l], shift);
+        }
+    }
+}
+
+static inline void simd_begin(void) {}
+static inline void simd_end(void) {}
+
+#endif
+
+void cpu_elementwise(InstructionType opcode, bool scale_bank, uint16_t scalar,
+                     const uint16_t __iomem *a, const uint16_t __iomem *b,
+                     const uint16_t __iomem *c, uint16_t __iomem *result,
+                     uint32_t len) {
+    uint16_t chunk_a[CPU_CHUNK_ELEMENTS];
+    uint16_t chunk_b[CPU_CHUNK_ELEMENTS];
+    uint16_t chunk_c[CPU_CHUNK_ELEMENTS];
+    bool ternary = opcode == MAD || opcode == MAC;
+
+    for (uint32_t done = 0; done < len; done += CPU_CHUNK_ELEMENTS) {
+        uint32_t n = min_t(uint32_t, len - done, CPU_CHUNK_ELEMENTS);
+        size_t bytes = n * sizeof(uint16_t);
+
+        memcpy_fromio(chunk_a, a + done, bytes);
+        memcpy_fromio(chunk_b, b + done, bytes);
+        if (ternary) {
+            memcpy_fromio(chunk_c, c + done, bytes);
+        }
+
+        // The result overwrites chunk_a, in place operands stay correct
+        simd_begin();
+        fallback_compute_chunk(opcode, scale_bank, scalar, chunk_a, chunk_b,
+                               ternary ? chunk_c : NULL, chunk_a, n);
+        simd_end();
+
+        memcpy_toio(result + done, chunk_a, bytes);
+    }
+}
+
+void cpu_elementwise_buffer(InstructionType opcode, bool scale_bank,
+                            uint16_t scalar, const uint16_t *a,
+                            const uint16_t *b, const uint16_t *c,
+                            uint16_t *result, uint32_t len) {
+    for (uint32_t done = 0; done < len; done += CPU_CHUNK_ELEMENTS) {
+        uint32_t n = min_t(uint32_t, len - done, CPU_CHUNK_ELEMENTS);
+
+        // Bounded NEON sections keep preemption latency low
+        simd_begin();
+        fallback_compute_chunk(opcode, scale_bank, scalar, a + done,
+                               b + done, c ? c + done : NULL, result + done,
+                               n);
+        simd_end();
+    }
+}
+
+void cpu_gemv(uint16_t *result, const uint16_t *matrix, const uint16_t *vector,
+              uint32_t rows, uint32_t cols) {
+    for (uint32_t r = 0; r < rows; r++) {
+        // One row per NEON section keeps preemption latency bounded
+        simd_begin();
+        result[r] = fallback_dot_row(matrix + (size_t)r * cols, vector, cols);
+        simd_end();
+    }
+}
+
+void cpu_gemv_transposed(uint16_t *result, const uint16_t *matrix,
+                         const uint16_t *vector, uint32_t rows,
+                         uint32_t cols) {
+    for (uint32_t done = 0; done < cols; done += CPU_CHUNK_ELEMENTS) {
+        uint32_t n = min_t(uint32_t, cols - done, CPU_CHUNK_ELEMENTS);
+
+        // One column chunk per NEON section, its sums stay on the stack
+        simd_begin();
+        fallback_dot_columns(result + done, matrix + done, vector, rows, cols,
+                             n);
+        simd_end();
+    }
+}
+
+void cpu_sum_lanes_fixed(const uint16_t *lanes, uint32_t rows, int shift,
+                         int64_t *sums) {
+    simd_begin();
+    for (uint32_t r = 0; r < rows; r++) {
+        sums[r] = fallback_sum_lanes_fixed(lanes + r * CPU_LANES, shift);
+    }
+    simd_end();
+}
+
+void cpu_sum_banks_fixed(const uint16_t *blocks, uint32_t count, int shift,
+                         int64_t *sums) {
+    simd_begin();
+    for (uint32_t k = 0; k < count; k++) {
+        fallback_sum_banks_fixed(blocks + k * CPU_LANES * CPU_LANES, shift,
+                                 sums + k * CPU_LANES);
+    }
+    simd_end();
+}
@@ -0,0 +1,177 @@
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#include <asm/neon-intrinsics.h>
+
+#include "../include/cpu_fallback_kernels.h"
+
+/*
+ * f32 keeps 24 bits of precision, enough to round a sum or product of two
+ * f16 values exactly once when converting back. MAD rounds the product to
+ * f16 first like the PIM pipeline.
+ */
+
+static float32x4_t load_f16x4(const uint16_t *src) {
+    return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src)));
+}
+
+static float f16_to_f32(uint16_t value) {
+    float16x4_t lanes = vreinterpret_f16_u16(vdup_n_u16(value));
+
+    return vgetq_lane_f32(vcvt_f32_f16(lanes), 0);
+}
+
+static uint16_t f32_to_f16(float value) {
+    return vget_lane_u16(
+        vreinterpret_u16_f16(vcvt_f16_f32(vdupq_n_f32(value))), 0);
+}
+
+static float32x4_t round_f16x4(float32x4_t value) {
+    return vcvt_f32_f16(vcvt_f16_f32(value));
+}
+
+static void compute_f16x4(InstructionType opcode, bool scale_bank,
+                          float32x4_t scale, const uint16_t *a,
+                          const uint16_t *b, const uint16_t *c,
+                          uint16_t *result) {
+    float32x4_t va = load_f16x4(a);
+    float32x4_t vb = load_f16x4(b);
+    float32x4_t value;
+
+    switch (opcode) {
+    case ADD:
+        value = scale_bank ? vaddq_f32(round_f16x4(vmulq_f32(vb, scale)), va)
+                           : vaddq_f32(vb, va);
+        break;
+    case MUL:
+        value = vmulq_f32(vb, va);
+        break;
+    default:
+        value = vaddq_f32(round_f16x4(vmulq_f32(vb, va)), load_f16x4(c));
+        break;
+    }
+    vst1_u16(result, vreinterpret_u16_f16(vcvt_f16_f32(value)));
+}
+
+void fallback_compute_chunk(InstructionType opcode, bool scale_bank,
+                            uint16_t scalar, const uint16_t *a,
+                            const uint16_t *b, const uint16_t *c,
+                            uint16_t *result, uint32_t len) {
+    float32x4_t scale = vdupq_n_f32(f16_to_f32(scalar));
+    uint16_t tail[4][4] = {{0}};
+    uint32_t i = 0;
+
+    for (; i + 4 <= len; i += 4) {
+        compute_f16x4(opcode, scale_bank, scale, a + i, b + i,
+                      c ? c + i : NULL, result + i);
+    }
+    if (i == len) {
+        return;
+    }
+
+    // The last elements go through zero padded lanes
+    memcpy(tail[0], a + i, (len - i) * sizeof(uint16_t));
+    memcpy(tail[1], b + i, (len - i) * sizeof(uint16_t));
+    if (c) {
+        memcpy(tail[2], c + i, (len - i) * sizeof(uint16_t));
+    }
+    compute_f16x4(opcode, scale_bank, scale, tail[0], tail[1], tail[2],
+                  tail[3]);
+    memcpy(result + i, tail[3], (len - i) * sizeof(uint16_t));
+}
+
+uint16_t fallback_dot_row(const uint16_t *row, const uint16_t *vector,
+                          uint32_t cols) {
+    float32x4_t sum = vdupq_n_f32(0);
+    float total;
+    uint32_t i = 0;
+
+    for (; i + 4 <= cols; i += 4) {
+        sum = vaddq_f32(sum, vmulq_f32(load_f16x4(row + i),
+                                       load_f16x4(vector + i)));
+    }
+    // FADDP adds lanes 0 + 1 and 2 + 3 first
+    total = vaddvq_f32(sum);
+
+    for (; i < cols; i++) {
+        total += f16_to_f32(row[i]) * f16_to_f32(vector[i]);
+    }
+    return f32_to_f16(total);
+}
+
+void fallback_dot_columns(uint16_t *result, const uint16_t *matrix,
+                          const uint16_t *vector, uint32_t rows,
+                          uint32_t cols, uint32_t n) {
+    float sums[CPU_CHUNK_ELEMENTS] = {0};
+    uint32_t k;
+
+    for (uint32_t r = 0; r < rows; r++) {
+        const uint16_t *row = matrix + (size_t)r * cols;
+        float x = f16_to_f32(vector[r]);
+        float32x4_t vx = vdupq_n_f32(x);
+
+        for (k = 0; k + 4 <= n; k += 4) {
+            vst1q_f32(sums + k, vaddq_f32(vld1q_f32(sums + k),
+                                          vmulq_f32(load_f16x4(row + k), vx)));
+        }
+        for (; k < n; k++) {
+            sums[k] += f16_to_f32(row[k]) * x;
+        }
+    }
+
+    for (k = 0; k < n; k++) {
+        result[k] = f32_to_f16(sums[k]);
+    }
+}
+
+/*
+ * Scaling by a power of two is exact in f32. With 24 fractional bits every
+ * finite lane becomes an integer below 2^40, which FCVTZS converts exactly
+ * through f64. Infinities are clamped to 2^(16 + shift), which converts back
+ * to infinity, and NaN turns into 0 like in the scalar decoder.
+ */
+static int64x2_t fixed_f32x2(float32x2_t value) {
+    return vcvtq_s64_f64(vcvt_f64_f32(value));
+}
+
+static float32x4_t scale_f16x4(const uint16_t *src, float32x4_t scale,
+                               float32x4_t limit) {
+    float32x4_t value = vmulq_f32(load_f16x4(src), scale);
+
+    return vmaxq_f32(vminq_f32(value, limit), vnegq_f32(limit));
+}
+
+int64_t fallback_sum_lanes_fixed(const uint16_t *lanes, int shift) {
+    float32x4_t scale = vdupq_n_f32((float)(1 << shift));
+    float32x4_t limit = vmulq_n_f32(scale, 65536.0f);
+    int64x2_t sum = vdupq_n_s64(0);
+
+    for (int i = 0; i < CPU_LANES; i += 4) {
+        float32x4_t value = scale_f16x4(lanes + i, scale, limit);
+
+        sum = vaddq_s64(sum, fixed_f32x2(vget_low_f32(value)));
+        sum = vaddq_s64(sum, fixed_f32x2(vget_high_f32(value)));
+    }
+    return vaddvq_s64(sum);
+}
+
+void fallback_sum_banks_fixed(const uint16_t *block, int shift,
+                              int64_t *sums) {
+    float32x4_t scale = vdupq_n_f32((float)(1 << shift));
+    float32x4_t limit = vmulq_n_f32(scale, 65536.0f);
+
+    for (int l = 0; l < CPU_LANES; l += 4) {
+        int64x2_t low = vdupq_n_s64(0);
+        int64x2_t high = vdupq_n_s64(0);
+
+        for (int b = 0; b < CPU_LANES; b++) {
+            float32x4_t value =
+                scale_f16x4(block + b * CPU_LANES + l, scale, limit);
+
+            low = vaddq_s64(low, fixed_f32x2(vget_low_f32(value)));
+            high = vaddq_s64(high, fixed_f32x2(vget_high_f32(value)));
+        }
+        vst1q_s64(sums + l, low);
+        vst1q_s64(sums + l + 2, high);
+    }
+}
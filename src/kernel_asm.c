@@ -0,0 +1,779 @@
+#include "../include/microkernels/kernel_asm.h"
+#include "../include/microkernels/kernel_operands.h"
+
+#define ASM_MAX_LINE 128
+#define ASM_MAX_TOKEN 32
+
+#define BLOB_VERSION 1
+
+struct mnemonic {
+    const char *name;
+    InstructionType type;
+    int num_operands;
+};
+
+// Operands are listed destination first
+static const struct mnemonic mnemonics[] = {
+    {"NOP", NOP, 0},  {"EXIT", EXIT, 0}, {"JUMP", JUMP, 2},
+    {"MOV", MOV, 2},  {"FILL", FILL, 2}, {"ADD", ADD, 3},
+    {"MUL", MUL, 3},  {"MAC", MAC, 4},   {"MAD", MAD, 4},
+};
+
+struct file_name {
+    const char *asm_name;
+    const char *json_name;
+    FileType type;
+};
+
+static const struct file_name file_names[] = {
+    {"GRF_A", "GrfA", GRF_A}, {"GRF_B", "GrfB", GRF_B},
+    {"SRF_M", "SrfM", SRF_M}, {"SRF_A", "SrfA", SRF_A},
+    {"BANK", "Bank", BANK},
+};
+
+/* ------- Shared helpers ------- */
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_word_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+static char to_upper(char c) {
+    return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+static bool equals_ignore_case(const char *a, const char *b) {
+    while (*a && *b) {
+        if (to_upper(*a++) != to_upper(*b++)) {
+            return false;
+        }
+    }
+    return *a == *b;
+}
+
+static const struct mnemonic *find_mnemonic(const char *name) {
+    for (size_t i = 0; i < ARRAY_SIZE(mnemonics); i++) {
+        if (equals_ignore_case(mnemonics[i].name, name)) {
+            return &mnemonics[i];
+        }
+    }
+    return NULL;
+}
+
+static const struct mnemonic *mnemonic_of(InstructionType type) {
+    for (size_t i = 0; i < ARRAY_SIZE(mnemonics); i++) {
+        if (mnemonics[i].type == type) {
+            return &mnemonics[i];
+        }
+    }
+    return NULL;
+}
+
+static const struct file_name *file_name_of(FileType type) {
+    for (size_t i = 0; i < ARRAY_SIZE(file_names); i++) {
+        if (file_names[i].type == type) {
+            return &file_names[i];
+        }
+    }
+    return NULL;
+}
+
+static void pad_with_nops(Microkernel *kernel, int pc) {
+    while (pc < MICROKERNEL_SLOTS) {
+        memset(&kernel->kernel[pc], 0, sizeof(Instruction));
+        kernel->kernel[pc++].type = NOP;
+    }
+}
+
+/**
+ * Cursor over a NUL terminated string, shared by the assembly and the JSON
+ * parser.
+ */
+struct cursor {
+    const char *pos;
+};
+
+static void skip_spaces(struct cursor *cur) {
+    while (is_space(*cur->pos)) {
+        cur->pos++;
+    }
+}
+
+static bool accept_char(struct cursor *cur, char c) {
+    skip_spaces(cur);
+    if (*cur->pos != c) {
+        return false;
+    }
+    cur->pos++;
+    return true;
+}
+
+static int read_word(struct cursor *cur, char *word, size_t size) {
+    size_t len = 0;
+
+    skip_spaces(cur);
+    while (is_word_char(*cur->pos)) {
+        if (len + 1 >= size) {
+            return -EINVAL;
+        }
+        word[len++] = *cur->pos++;
+    }
+    word[len] = '\0';
+    return len > 0 ? 0 : -EINVAL;
+}
+
+static int read_long(struct cursor *cur, long *value) {
+    bool negative = false;
+    long result = 0;
+    int digits = 0;
+
+    skip_spaces(cur);
+    if (*cur->pos == '-' || *cur->pos == '+') {
+        negative = *cur->pos == '-';
+        cur->pos++;
+    }
+    while (*cur->pos >= '0' && *cur->pos <= '9') {
+        result = result * 10 + (*cur->pos++ - '0');
+        if (result > 0x7FFFFFFFL) {
+            return -ERANGE;
+        }
+        digits++;
+    }
+    if (digits == 0) {
+        return -EINVAL;
+    }
+    *value = negative ? -result : result;
+    return 0;
+}
+
+/* ------- Assembler ------- */
+
+static int assemble_file(struct cursor *cur, File *file) {
+    char word[ASM_MAX_TOKEN];
+    const struct file_name *name = NULL;
+    long index = 0;
+
+    if (read_word(cur, word, sizeof(word))) {
+        return -EINVAL;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(file_names); i++) {
+        if (equals_ignore_case(file_names[i].asm_name, word)) {
+            name = &file_names[i];
+        }
+    }
+    if (!name) {
+        return -EINVAL;
+    }
+
+    file->type = name->type;
+    if (name->type == BANK) {
+        return 0;
+    }
+
+    if (!accept_char(cur, '[') || read_long(cur, &index) ||
+        !accept_char(cur, ']')) {
+        return -EINVAL;
+    }
+    if (index < 0 || index >= GRF_REGISTERS) {
+        return -ERANGE;
+    }
+    set_file_index(file, index);
+    return 0;
+}
+
+static int assemble_instruction(struct cursor *cur, Instruction *instr) {
+    char word[ASM_MAX_TOKEN];
+    const struct mnemonic *mnemonic;
+    struct instruction_operands ops;
+    File *operands[4];
+    long offset;
+    long count;
+
+    if (read_word(cur, word, sizeof(word))) {
+        return -EINVAL;
+    }
+    mnemonic = find_mnemonic(word);
+    if (!mnemonic) {
+        return -EINVAL;
+    }
+
+    memset(instr, 0, sizeof(*instr));
+    instr->type = mnemonic->type;
+
+    if (mnemonic->type == JUMP) {
+        if (read_long(cur, &offset) || !accept_char(cur, ',') ||
+            read_long(cur, &count) || count < 0) {
+            return -EINVAL;
+        }
+        instr->jump.offset = offset;
+        instr->jump.count = count;
+    } else if (mnemonic->num_operands > 0) {
+        get_instruction_operands(instr, &ops);
+        operands[0] = ops.dst;
+        for (int i = 0; i < ops.num_src; i++) {
+            operands[i + 1] = ops.src[i];
+        }
+
+        for (int i = 0; i < mnemonic->num_operands; i++) {
+            if (i > 0 && !accept_char(cur, ',')) {
+                return -EINVAL;
+            }
+            if (assemble_file(cur, operands[i])) {
+                return -EINVAL;
+            }
+        }
+
+        skip_spaces(cur);
+        if (ops.aam && *cur->pos) {
+            if (read_word(cur, word, sizeof(word)) ||
+                !equals_ignore_case(word, "aam")) {
+                return -EINVAL;
+            }
+            *ops.aam = true;
+        }
+    }
+
+    skip_spaces(cur);
+    return *cur->pos ? -EINVAL : 0;
+}
+
+int pim_asm_assemble(const char *source, Microkernel *kernel) {
+    char line[ASM_MAX_LINE];
+    const char *pos = source;
+    int line_number = 0;
+    int pc = 0;
+
+    kernel->blocks = 1;
+
+    while (*pos) {
+        struct cursor cur;
+        size_t len = 0;
+        char *comment;
+        long blocks;
+
+        line_number++;
+        while (*pos && *pos != '\n') {
+            if (len + 1 >= sizeof(line)) {
+                pr_err("PIM asm: line %d is too long\n", line_number);
+                return -EINVAL;
+            }
+            line[len++] = *pos++;
+        }
+        if (*pos == '\n') {
+            pos++;
+        }
+        line[len] = '\0';
+
+        comment = strpbrk(line, ";#");
+        if (comment) {
+            *comment = '\0';
+        }
+
+        cur.pos = line;
+        skip_spaces(&cur);
+        if (!*cur.pos) {
+            continue;
+        }
+
+        if (*cur.pos == '.') {
+            char directive[ASM_MAX_TOKEN];
+
+            cur.pos++;
+            if (read_word(&cur, directive, sizeof(directive)) ||
+                !equals_ignore_case(directive, "blocks") ||
+                read_long(&cur, &blocks) || blocks < 0) {
+                pr_err("PIM asm: invalid directive in line %d\n",
+                       line_number);
+                return -EINVAL;
+            }
+            kernel->blocks = blocks;
+            continue;
+        }
+
+        if (pc >= MICROKERNEL_SLOTS) {
+            pr_err("PIM asm: more than %d instructions (line %d)\n",
+                   MICROKERNEL_SLOTS, line_number);
+            return -EINVAL;
+        }
+        if (assemble_instruction(&cur, &kernel->kernel[pc])) {
+            pr_err("PIM asm: syntax error in line %d: %s\n", line_number,
+                   line);
+            return -EINVAL;
+        }
+        pc++;
+    }
+
+    pad_with_nops(kernel, pc);
+    return pc;
+}
+
+/* ------- Disassembler ------- */
+
+static int format_file(char *buffer, size_t size, const File *file) {
+    const struct file_name *name = file_name_of(file->type);
+
+    if (!name) {
+        return -EINVAL;
+    }
+    if (file->type == BANK) {
+        return snprintf(buffer, size, "%s", name->asm_name);
+    }
+    return snprintf(buffer, size, "%s[%u]", name->asm_name, file_index(file));
+}
+
+int pim_asm_format_instruction(char *buffer, size_t size,
+                               const Instruction *instr) {
+    const struct mnemonic *mnemonic = mnemonic_of(instr->type);
+    struct instruction_operands ops;
+    Instruction copy = *instr;
+    int total_written;
+    int written;
+
+    if (!mnemonic) {
+        pr_err("Undefined InstructionType: %d\n", instr->type);
+        return -EINVAL;
+    }
+
+    if (instr->type == JUMP) {
+        return snprintf(buffer, size, "JUMP %d, %u", instr->jump.offset,
+                        instr->jump.count);
+    }
+
+    total_written = snprintf(buffer, size, "%s", mnemonic->name);
+    if (total_written < 0 || total_written >= size) {
+        return -ENOMEM;
+    }
+
+    get_instruction_operands(&copy, &ops);
+    for (int i = 0; i < mnemonic->num_operands; i++) {
+        const File *file = (i == 0) ? ops.dst : ops.src[i - 1];
+
+        written = snprintf(buffer + total_written, size - total_written, "%s",
+                           i == 0 ? " " : ", ");
+        if (written < 0 || written >= size - total_written) {
+            return -ENOMEM;
+        }
+        total_written += written;
+
+        written = format_file(buffer + total_written, size - total_written,
+                              file);
+        if (written < 0 || written >= size - total_written) {
+            return written < 0 ? written : -ENOMEM;
+        }
+        total_written += written;
+    }
+
+    if (ops.aam && *ops.aam) {
+        written = snprintf(buffer + total_written, size - total_written, " aam");
+        if (written < 0 || written >= size - total_written) {
+            return -ENOMEM;
+        }
+        total_written += written;
+    }
+
+    return total_written;
+}
+
+int pim_asm_disassemble(const Microkernel *kernel, char *buffer, size_t size) {
+    int last = MICROKERNEL_SLOTS - 1;
+    int total_written;
+    int written;
+
+    while (last >= 0 && kernel->kernel[last].type == NOP) {
+        last--;
+    }
+
+    if (size == 0) {
+        return -ENOMEM;
+    }
+    buffer[0] = '\0';
+    total_written = 0;
+
+    // Kernels from a JSON config carry no block count (0), print none
+    if (kernel->blocks) {
+        total_written = snprintf(buffer, size, ".blocks %d\n", kernel->blocks);
+        if (total_written < 0 || total_written >= size) {
+            return -ENOMEM;
+        }
+    }
+
+    for (int pc = 0; pc <= last; pc++) {
+        written = pim_asm_format_instruction(
+            buffer + total_written, size - total_written, &kernel->kernel[pc]);
+        if (written < 0 || written + 1 >= size - total_written) {
+            return written < 0 ? written : -ENOMEM;
+        }
+        total_written += written;
+        buffer[total_written++] = '\n';
+        buffer[total_written] = '\0';
+    }
+
+    return total_written;
+}
+
+/* ------- JSON parser ------- */
+
+static int json_string(struct cursor *cur, char *out, size_t size) {
+    size_t len = 0;
+
+    if (!accept_char(cur, '"')) {
+        return -EINVAL;
+    }
+    while (*cur->pos && *cur->pos != '"') {
+        if (len + 1 >= size) {
+            return -EINVAL;
+        }
+        out[len++] = *cur->pos++;
+    }
+    if (*cur->pos != '"') {
+        return -EINVAL;
+    }
+    cur->pos++;
+    out[len] = '\0';
+    return 0;
+}
+
+static bool json_literal(struct cursor *cur, const char *literal) {
+    size_t len = strlen(literal);
+
+    skip_spaces(cur);
+    if (strncmp(cur->pos, literal, len) != 0) {
+        return false;
+    }
+    cur->pos += len;
+    return true;
+}
+
+static int json_key(struct cursor *cur, char *key, size_t size) {
+    if (json_string(cur, key, size) || !accept_char(cur, ':')) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int json_file(struct cursor *cur, File *file) {
+    char name[ASM_MAX_TOKEN];
+    const struct file_name *match = NULL;
+    long index;
+
+    skip_spaces(cur);
+    if (*cur->pos == '"') {
+        if (json_string(cur, name, sizeof(name)) || strcmp(name, "Bank")) {
+            return -EINVAL;
+        }
+        file->type = BANK;
+        return 0;
+    }
+
+    // {"GrfA":{"index":0}}
+    if (!accept_char(cur, '{') || json_key(cur, name, sizeof(name))) {
+        return -EINVAL;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(file_names); i++) {
+        if (!strcmp(file_names[i].json_name, name)) {
+            match = &file_names[i];
+        }
+    }
+    if (!match || match->type == BANK || !accept_char(cur, '{') ||
+        json_key(cur, name, sizeof(name)) || strcmp(name, "index") ||
+        read_long(cur, &index) || !accept_char(cur, '}') ||
+        !accept_char(cur, '}')) {
+        return -EINVAL;
+    }
+    if (index < 0 || index >= GRF_REGISTERS) {
+        return -ERANGE;
+    }
+
+    file->type = match->type;
+    set_file_index(file, index);
+    return 0;
+}
+
+static int json_instruction(struct cursor *cur, Instruction *instr) {
+    char name[ASM_MAX_TOKEN];
+    const struct mnemonic *mnemonic;
+    struct instruction_operands ops;
+    long value;
+
+    memset(instr, 0, sizeof(*instr));
+
+    skip_spaces(cur);
+    if (*cur->pos == '"') {
+        // "NOP" and "EXIT" carry no payload
+        if (json_string(cur, name, sizeof(name))) {
+            return -EINVAL;
+        }
+        mnemonic = find_mnemonic(name);
+        if (!mnemonic || mnemonic->num_operands) {
+            return -EINVAL;
+        }
+        instr->type = mnemonic->type;
+        return 0;
+    }
+
+    if (!accept_char(cur, '{') || json_key(cur, name, sizeof(name))) {
+        return -EINVAL;
+    }
+    mnemonic = find_mnemonic(name);
+    if (!mnemonic || !accept_char(cur, '{')) {
+        return -EINVAL;
+    }
+    instr->type = mnemonic->type;
+    get_instruction_operands(instr, &ops);
+
+    do {
+        File *file = NULL;
+
+        if (json_key(cur, name, sizeof(name))) {
+            return -EINVAL;
+        }
+
+        if (!strcmp(name, "dst")) {
+            file = ops.dst;
+        } else if (!strcmp(name, "src") || !strcmp(name, "src0")) {
+            file = ops.num_src > 0 ? ops.src[0] : NULL;
+        } else if (!strcmp(name, "src1")) {
+            file = ops.num_src > 1 ? ops.src[1] : NULL;
+        } else if (!strcmp(name, "src2")) {
+            file = ops.num_src > 2 ? ops.src[2] : NULL;
+        } else if (!strcmp(name, "aam") && ops.aam) {
+            if (json_literal(cur, "true")) {
+                *ops.aam = true;
+            } else if (!json_literal(cur, "false")) {
+                return -EINVAL;
+            }
+            continue;
+        } else if (instr->type == JUMP && (!strcmp(name, "offset") ||
+                                           !strcmp(name, "count"))) {
+            if (read_long(cur, &value)) {
+                return -EINVAL;
+            }
+            if (name[0] == 'o') {
+                instr->jump.offset = value;
+            } else {
+                instr->jump.count = value;
+            }
+            continue;
+        } else {
+            return -EINVAL;
+        }
+
+        if (!file || json_file(cur, file)) {
+            return -EINVAL;
+        }
+    } while (accept_char(cur, ','));
+
+    if (!accept_char(cur, '}') || !accept_char(cur, '}')) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int json_kernel(struct cursor *cur, Microkernel *kernel) {
+    int pc = 0;
+
+    if (!accept_char(cur, '[')) {
+        return -EINVAL;
+    }
+    if (!accept_char(cur, ']')) {
+        do {
+            if (pc >= MICROKERNEL_SLOTS ||
+                json_instruction(cur, &kernel->kernel[pc])) {
+                return -EINVAL;
+            }
+            pc++;
+        } while (accept_char(cur, ','));
+
+        if (!accept_char(cur, ']')) {
+            return -EINVAL;
+        }
+    }
+
+    pad_with_nops(kernel, pc);
+    kernel->blocks = 0;
+    return 0;
+}
+
+int pim_asm_parse_config(const char *json, char *bank_mode,
+                         size_t bank_mode_size, Microkernel *kernel) {
+    struct cursor cur = {.pos = json};
+    char key[ASM_MAX_TOKEN];
+    int flags = 0;
+
+    if (!accept_char(&cur, '{')) {
+        goto parse_error;
+    }
+
+    do {
+        if (json_key(&cur, key, sizeof(key))) {
+            goto parse_error;
+        }
+
+        if (json_literal(&cur, "null")) {
+            continue;
+        }
+
+        if (!strcmp(key, "bank_mode")) {
+            if (json_string(&cur, bank_mode, bank_mode_size)) {
+                goto parse_error;
+            }
+            flags |= PIM_CONFIG_HAS_BANK_MODE;
+        } else if (!strcmp(key, "kernel")) {
+            if (json_kernel(&cur, kernel)) {
+                goto parse_error;
+            }
+            flags |= PIM_CONFIG_HAS_KERNEL;
+        } else {
+            goto parse_error;
+        }
+    } while (accept_char(&cur, ','));
+
+    if (!accept_char(&cur, '}')) {
+        goto parse_error;
+    }
+    return flags;
+
+parse_error:
+    pr_err("PIM asm: invalid config JSON at offset %ld\n",
+           (long)(cur.pos - json));
+    return -EINVAL;
+}
+
+int pim_asm_parse_json(const char *json, Microkernel *kernel) {
+    char bank_mode[ASM_MAX_TOKEN];
+    int flags;
+
+    flags = pim_asm_parse_config(json, bank_mode, sizeof(bank_mode), kernel);
+    if (flags < 0) {
+        return flags;
+    }
+    return (flags & PIM_CONFIG_HAS_KERNEL) ? 0 : -EINVAL;
+}
+
+/* ------- Binary blob ------- */
+
+static uint8_t encode_file(const File *file) {
+    return (uint8_t)((file->type << 4) | (file_index(file) & 0x0F));
+}
+
+static int decode_file(uint8_t code, File *file) {
+    FileType type = code >> 4;
+
+    if (type > BANK || (code & 0x0F) >= GRF_REGISTERS) {
+        return -EINVAL;
+    }
+    file->type = type;
+    set_file_index(file, code & 0x0F);
+    return 0;
+}
+
+int pim_asm_to_blob(const Microkernel *kernel, uint8_t *blob, size_t size) {
+    int last = MICROKERNEL_SLOTS - 1;
+    int count;
+
+    while (last >= 0 && kernel->kernel[last].type == NOP) {
+        last--;
+    }
+    count = last + 1;
+
+    if (size < PIM_ASM_BLOB_HEADER_SIZE +
+                   (size_t)count * PIM_ASM_BLOB_INSTRUCTION_SIZE) {
+        return -ENOMEM;
+    }
+
+    memcpy(blob, "PIMK", 4);
+    blob[4] = BLOB_VERSION;
+    blob[5] = (uint8_t)kernel->blocks;
+    blob[6] = (uint8_t)count;
+    blob[7] = 0;
+
+    for (int pc = 0; pc < count; pc++) {
+        uint8_t *out = blob + PIM_ASM_BLOB_HEADER_SIZE +
+                       pc * PIM_ASM_BLOB_INSTRUCTION_SIZE;
+        Instruction copy = kernel->kernel[pc];
+        struct instruction_operands ops;
+
+        memset(out, 0, PIM_ASM_BLOB_INSTRUCTION_SIZE);
+        out[0] = copy.type;
+
+        if (copy.type == JUMP) {
+            uint16_t offset = (uint16_t)(int16_t)copy.jump.offset;
+
+            out[2] = offset & 0xFF;
+            out[3] = offset >> 8;
+            for (int i = 0; i < 4; i++) {
+                out[4 + i] = (copy.jump.count >> (8 * i)) & 0xFF;
+            }
+            continue;
+        }
+
+        get_instruction_operands(&copy, &ops);
+        out[1] = (ops.aam && *ops.aam) ? 1 : 0;
+        if (ops.dst) {
+            out[2] = encode_file(ops.dst);
+        }
+        for (int i = 0; i < ops.num_src; i++) {
+            out[3 + i] = encode_file(ops.src[i]);
+        }
+    }
+
+    return PIM_ASM_BLOB_HEADER_SIZE + count * PIM_ASM_BLOB_INSTRUCTION_SIZE;
+}
+
+int pim_asm_from_blob(const uint8_t *blob, size_t size, Microkernel *kernel) {
+    int count;
+
+    if (size < PIM_ASM_BLOB_HEADER_SIZE || memcmp(blob, "PIMK", 4) ||
+        blob[4] != BLOB_VERSION) {
+        return -EINVAL;
+    }
+
+    count = blob[6];
+    if (count > MICROKERNEL_SLOTS ||
+        size < PIM_ASM_BLOB_HEADER_SIZE +
+                   (size_t)count * PIM_ASM_BLOB_INSTRUCTION_SIZE) {
+        return -EINVAL;
+    }
+    kernel->blocks = blob[5];
+
+    for (int pc = 0; pc < count; pc++) {
+        const uint8_t *in = blob + PIM_ASM_BLOB_HEADER_SIZE +
+                            pc * PIM_ASM_BLOB_INSTRUCTION_SIZE;
+        Instruction *instr = &kernel->kernel[pc];
+        struct instruction_operands ops;
+
+        memset(instr, 0, sizeof(*instr));
+        if (in[0] > MAD) {
+            return -EINVAL;
+        }
+        instr->type = in[0];
+
+        if (instr->type == JUMP) {
+            instr->jump.offset = (int16_t)(in[2] | (in[3] << 8));
+            instr->jump.count = (uint32_t)in[4] | ((uint32_t)in[5] << 8) |
+                                ((uint32_t)in[6] << 16) |
+                                ((uint32_t)in[7] << 24);
+            continue;
+        }
+
+        get_instruction_operands(instr, &ops);
+        if (ops.aam) {
+            *ops.aam = in[1] & 1;
+        }
+        if (ops.dst && decode_file(in[2], ops.dst)) {
+            return -EINVAL;
+        }
+        for (int i = 0; i < ops.num_src; i++) {
+            if (decode_file(in[3 + i], ops.src[i])) {
+                return -EINVAL;
+            }
+        }
+    }
+
+    pad_with_nops(kernel, count);
+    return count;
+}
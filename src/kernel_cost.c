@@ -0,0 +1,260 @@
+#include "../include/microkernels/kernel_cost.h"
+#include "../include/microkernels/kernel_to_string.h"
+#include "../include/microkernels/kernel_walk.h"
+#include "../include/pim_configs.h"
+
+// Upper bound of instructions followed while walking a kernel
+#define PIM_COST_MAX_STEPS 65536
+
+// Length of {"bank_mode":"PimAllBank","kernel":null} plus the terminating NUL
+// that write_config_bytes appends. SingleBank has the same length.
+#define PIM_COST_BANK_MODE_CONFIG_BYTES 42
+
+// Scratch size for a single serialized instruction
+#define PIM_COST_INSTRUCTION_STRING_SIZE 256
+
+/*
+ * Rough figures for the gem5 full system setup (O3 CPU, uncached PIM
+ * regions). They are meant to be recalibrated from measurements.
+ */
+struct pim_cost_params pim_cost_calibration = {
+    .trigger_read_ps = 80000,
+    .trigger_write_ps = 50000,
+    .barrier_ps = 40000,
+    .config_byte_ps = 25000,
+    .mmio_write_byte_ps = 500,
+    .mmio_read_byte_ps = 40000,
+    .cpu_element_ps = 1500,
+    .cpu_mac_ps = 1000,
+};
+
+/**
+ * Trigger stream of one kernel invocation as seen by the *_execute functions:
+ * every executed instruction except JUMP consumes one trigger and the driver
+ * places a barrier after every run of the same opcode.
+ */
+struct launch_profile {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t barriers;
+    // Triggers that load a bank into a register, i.e. input operand blocks
+    uint32_t bank_loads;
+    uint32_t fills;
+};
+
+static int walk_kernel(const Microkernel *kernel,
+                       struct launch_profile *profile) {
+    struct kernel_walker walker;
+    InstructionType previous = NOP;
+
+    memset(profile, 0, sizeof(*profile));
+    kernel_walker_reset(&walker);
+
+    for (int step = 0; step < PIM_COST_MAX_STEPS; step++) {
+        const Instruction *instr;
+        int pc = kernel_walker_resolve(&walker, kernel);
+
+        if (pc < 0) {
+            return pc;
+        }
+        instr = &kernel->kernel[pc];
+
+        if (instr->type == FILL) {
+            profile->writes++;
+            profile->fills++;
+        } else {
+            profile->reads++;
+        }
+        if (instr->type == MOV && instr->mov.src.type == BANK) {
+            profile->bank_loads++;
+        }
+        if (instr->type != previous) {
+            profile->barriers++;
+            previous = instr->type;
+        }
+
+        if (instr->type == EXIT) {
+            return 0;
+        }
+        walker.pc++;
+    }
+    return -EINVAL;
+}
+
+/**
+ * Number of bytes set_microkernel writes into the PIM_CONFIG region.
+ */
+static int kernel_config_bytes(const Microkernel *kernel) {
+    char buffer[PIM_COST_INSTRUCTION_STRING_SIZE];
+    // {"bank_mode":null,"kernel":[ ... ]} with commas and the NUL
+    int total = strlen("{\"bank_mode\":null,\"kernel\":[") +
+                (MICROKERNEL_SLOTS - 1) + strlen("]}") + 1;
+
+    for (int i = 0; i < MICROKERNEL_SLOTS; i++) {
+        int written = parse_instruction_to_string(buffer, sizeof(buffer),
+                                                  &kernel->kernel[i]);
+        if (written < 0) {
+            return written;
+        }
+        total += written;
+    }
+    return total;
+}
+
+static uint64_t div_round_up_u64(uint64_t value, uint64_t divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+static int analyze_elementwise(const Microkernel *kernel,
+                               const struct pim_op_shape *shape,
+                               struct pim_cost *cost) {
+    uint64_t launch_elements =
+        (uint64_t)kernel->blocks * KERNEL_BLOCK_ELEMENTS;
+
+    if (kernel->blocks < 1) {
+        return -EINVAL;
+    }
+
+    cost->launches = div_round_up_u64(shape->len, launch_elements);
+    // FILL overwrites every block of the result, it is not zeroed first
+    cost->config_bytes += 2 * PIM_COST_BANK_MODE_CONFIG_BYTES;
+    return 0;
+}
+
+static int analyze_gemv(const struct launch_profile *profile,
+                        const struct pim_op_shape *shape,
+                        struct pim_cost *cost) {
+    // Every input vector block covers 16 columns, every accumulator 16 rows
+    uint64_t launch_cols = (uint64_t)profile->bank_loads * ELEMENTS_PER_BANK;
+    uint64_t launch_rows = (uint64_t)profile->fills * ELEMENTS_PER_BANK;
+    uint64_t padded_rows;
+    uint64_t padded_cols;
+    uint64_t partial_sum_bytes;
+
+    if (!launch_cols || !launch_rows) {
+        return -EINVAL;
+    }
+
+    padded_rows = div_round_up_u64(shape->rows, launch_rows) * launch_rows;
+    padded_cols = div_round_up_u64(shape->cols, launch_cols) * launch_cols;
+    cost->launches = (padded_rows / launch_rows) * (padded_cols / launch_cols);
+
+    // All tiles run in one PIM_ALL_BANK session as long as the data region
+    // holds them
+    cost->config_bytes += 2 * PIM_COST_BANK_MODE_CONFIG_BYTES;
+
+    // Tiled matrix and input vector replicated for every bank. FILL
+    // overwrites the partial sums (16 lanes per row), they are only read
+    partial_sum_bytes = launch_rows * ELEMENTS_PER_BANK * sizeof(uint16_t);
+    cost->mmio_write_bytes = padded_rows * padded_cols * sizeof(uint16_t) +
+                             padded_cols * NUM_BANKS * sizeof(uint16_t);
+    cost->mmio_read_bytes = cost->launches * partial_sum_bytes;
+    return 0;
+}
+
+int pim_cost_analyze(const Microkernel *kernel,
+                     const struct pim_op_shape *shape,
+                     const struct pim_cost_params *params,
+                     struct pim_cost *cost) {
+    struct launch_profile profile;
+    uint64_t total_ps;
+    int ret;
+
+    memset(cost, 0, sizeof(*cost));
+
+    ret = walk_kernel(kernel, &profile);
+    if (ret) {
+        pr_err("PIM: cost model could not follow the kernel to its EXIT\n");
+        return ret;
+    }
+
+    ret = kernel_config_bytes(kernel);
+    if (ret < 0) {
+        return ret;
+    }
+    cost->config_bytes = ret;
+
+    switch (shape->kind) {
+    case PIM_SHAPE_ELEMENTWISE:
+        ret = analyze_elementwise(kernel, shape, cost);
+        break;
+    case PIM_SHAPE_GEMV:
+        ret = analyze_gemv(&profile, shape, cost);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+    if (ret) {
+        return ret;
+    }
+
+    cost->launch_reads = profile.reads;
+    cost->launch_writes = profile.writes;
+    cost->launch_barriers = profile.barriers;
+    cost->trigger_reads = cost->launches * profile.reads;
+    cost->trigger_writes = cost->launches * profile.writes;
+    cost->barriers = cost->launches * profile.barriers;
+
+    total_ps = cost->trigger_reads * params->trigger_read_ps +
+               cost->trigger_writes * params->trigger_write_ps +
+               cost->barriers * params->barrier_ps +
+               cost->config_bytes * params->config_byte_ps +
+               cost->mmio_write_bytes * params->mmio_write_byte_ps +
+               cost->mmio_read_bytes * params->mmio_read_byte_ps;
+    cost->estimated_ns = total_ps / 1000;
+
+    return 0;
+}
+
+uint64_t pim_cost_estimate_cpu(const struct pim_op_shape *shape,
+                               const struct pim_cost_params *params) {
+    switch (shape->kind) {
+    case PIM_SHAPE_ELEMENTWISE:
+        return (uint64_t)shape->len * params->cpu_element_ps / 1000;
+    case PIM_SHAPE_GEMV:
+        return (uint64_t)shape->rows * shape->cols * params->cpu_mac_ps / 1000;
+    default:
+        return 0;
+    }
+}
+
+const struct kernel_variant *pim_cost_select_variant(InstructionType opcode,
+                                                     bool scale_bank,
+                                                     uint32_t len,
+                                                     struct pim_cost *cost) {
+    const struct pim_op_shape shape = {
+        .kind = PIM_SHAPE_ELEMENTWISE,
+        .len = len,
+    };
+    const struct kernel_variant *variants;
+    const struct kernel_variant *best = NULL;
+    struct pim_cost best_cost = {0};
+    size_t count = get_kernel_variants(&variants);
+
+    for (size_t i = 0; i < count; i++) {
+        struct pim_cost variant_cost;
+        Microkernel kernel;
+
+        if (variants[i].opcode != opcode ||
+            variants[i].scale_bank != scale_bank ||
+            variants[i].blocks * KERNEL_BLOCK_ELEMENTS > len) {
+            continue;
+        }
+        if (build_kernel_variant(&kernel, &variants[i]) ||
+            pim_cost_analyze(&kernel, &shape, &pim_cost_calibration,
+                             &variant_cost)) {
+            continue;
+        }
+
+        if (!best || variant_cost.estimated_ns < best_cost.estimated_ns) {
+            best = &variants[i];
+            best_cost = variant_cost;
+        }
+    }
+
+    if (best && cost) {
+        *cost = best_cost;
+    }
+    return best;
+}
@@ -0,0 +1,396 @@
+#include "../include/microkernels/kernel_expr.h"
+#include "../include/microkernels/kernel_operands.h"
+
+// Registers of one PIM unit, GRF_A and GRF_B together
+#define EXPR_REGISTER_SLOTS (2 * GRF_REGISTERS)
+
+// Operand that the trigger delivers from the bank instead of a register
+#define EXPR_BANK_OPERAND -1
+
+/**
+ * Instruction of the program of a single block. Operands are register slots
+ * of the block, the bank operand is read from 'stream'.
+ */
+struct expr_instruction {
+    InstructionType type;
+    int8_t dst;
+    int8_t src[3];
+    int num_src;
+    uint8_t stream;
+};
+
+struct expr_code {
+    struct expr_instruction code[MICROKERNEL_SLOTS];
+    int count;
+    int registers;
+};
+
+/**
+ * State of the lowering: the operations left after MAD fusion with their
+ * source nodes, and the register slot every node currently lives in.
+ */
+struct expr_lowering {
+    const struct kernel_expr *expr;
+    InstructionType op_type[KERNEL_EXPR_MAX_NODES];
+    uint8_t op_node[KERNEL_EXPR_MAX_NODES];
+    uint8_t op_src[KERNEL_EXPR_MAX_NODES][3];
+    int op_num_src[KERNEL_EXPR_MAX_NODES];
+    int num_ops;
+    // Index of the operation reading the node last, num_ops for the result
+    int last_use[KERNEL_EXPR_MAX_NODES];
+    int8_t slot[KERNEL_EXPR_MAX_NODES];
+    uint32_t busy_slots;
+};
+
+int kernel_expr_validate(const struct kernel_expr *expr) {
+    if (expr->num_nodes < 1 || expr->num_nodes > KERNEL_EXPR_MAX_NODES ||
+        expr->num_inputs < 1 || expr->num_inputs > KERNEL_EXPR_MAX_INPUTS) {
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < expr->num_nodes; i++) {
+        const struct kernel_expr_node *node = &expr->nodes[i];
+
+        switch (node->op) {
+        case KERNEL_EXPR_INPUT:
+            if (node->lhs >= expr->num_inputs) {
+                return -EINVAL;
+            }
+            break;
+        case KERNEL_EXPR_ADD:
+        case KERNEL_EXPR_MUL:
+            if (node->lhs >= i || node->rhs >= i) {
+                return -EINVAL;
+            }
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Turns the nodes the result depends on into operations. An ADD whose operand
+ * is a MUL nobody else reads becomes a MAD over the factors of the MUL, so the
+ * product never needs a register of its own.
+ */
+static void select_operations(struct expr_lowering *lowering) {
+    const struct kernel_expr *expr = lowering->expr;
+    int root = expr->num_nodes - 1;
+    bool needed[KERNEL_EXPR_MAX_NODES] = {false};
+    bool fused[KERNEL_EXPR_MAX_NODES] = {false};
+    int uses[KERNEL_EXPR_MAX_NODES] = {0};
+    int product[KERNEL_EXPR_MAX_NODES];
+
+    needed[root] = true;
+    for (int i = root; i >= 0; i--) {
+        const struct kernel_expr_node *node = &expr->nodes[i];
+
+        if (!needed[i] || node->op == KERNEL_EXPR_INPUT) {
+            continue;
+        }
+        needed[node->lhs] = needed[node->rhs] = true;
+        uses[node->lhs]++;
+        uses[node->rhs]++;
+    }
+
+    // Every MUL is read once at most, so no two ADDs compete for it
+    for (int i = 0; i <= root; i++) {
+        const struct kernel_expr_node *node = &expr->nodes[i];
+
+        product[i] = -1;
+        if (!needed[i] || node->op != KERNEL_EXPR_ADD) {
+            continue;
+        }
+        if (expr->nodes[node->rhs].op == KERNEL_EXPR_MUL &&
+            uses[node->rhs] == 1) {
+            product[i] = node->rhs;
+        } else if (expr->nodes[node->lhs].op == KERNEL_EXPR_MUL &&
+                   uses[node->lhs] == 1) {
+            product[i] = node->lhs;
+        }
+        if (product[i] >= 0) {
+            fused[product[i]] = true;
+        }
+    }
+
+    lowering->num_ops = 0;
+    for (int i = 0; i <= root; i++) {
+        const struct kernel_expr_node *node = &expr->nodes[i];
+        int op = lowering->num_ops;
+
+        if (!needed[i] || node->op == KERNEL_EXPR_INPUT || fused[i]) {
+            continue;
+        }
+
+        lowering->op_node[op] = i;
+        if (product[i] >= 0) {
+            const struct kernel_expr_node *mul = &expr->nodes[product[i]];
+
+            lowering->op_type[op] = MAD;
+            lowering->op_src[op][0] = mul->lhs;
+            lowering->op_src[op][1] = mul->rhs;
+            lowering->op_src[op][2] =
+                product[i] == node->rhs ? node->lhs : node->rhs;
+            lowering->op_num_src[op] = 3;
+        } else {
+            lowering->op_type[op] = node->op == KERNEL_EXPR_ADD ? ADD : MUL;
+            lowering->op_src[op][0] = node->lhs;
+            lowering->op_src[op][1] = node->rhs;
+            lowering->op_num_src[op] = 2;
+        }
+        lowering->num_ops++;
+    }
+
+    for (int i = 0; i <= root; i++) {
+        lowering->last_use[i] = -1;
+    }
+    for (int op = 0; op < lowering->num_ops; op++) {
+        for (int k = 0; k < lowering->op_num_src[op]; k++) {
+            lowering->last_use[lowering->op_src[op][k]] = op;
+        }
+    }
+    lowering->last_use[root] = lowering->num_ops;
+}
+
+static int allocate_slot(struct expr_lowering *lowering,
+                         struct expr_code *code) {
+    for (int s = 0; s < EXPR_REGISTER_SLOTS; s++) {
+        if (!(lowering->busy_slots & (1u << s))) {
+            lowering->busy_slots |= 1u << s;
+            code->registers = max(code->registers, s + 1);
+            return s;
+        }
+    }
+    return -E2BIG;
+}
+
+/**
+ * Appends an instruction without sources. Returns NULL if the block program
+ * leaves no slot for the EXIT.
+ */
+static struct expr_instruction *emit(struct expr_code *code,
+                                     InstructionType type, int dst,
+                                     uint8_t stream) {
+    struct expr_instruction *instr;
+
+    if (code->count == MICROKERNEL_SLOTS - 1) {
+        return NULL;
+    }
+    instr = &code->code[code->count++];
+    instr->type = type;
+    instr->dst = dst;
+    instr->num_src = 0;
+    instr->stream = stream;
+    return instr;
+}
+
+/**
+ * Loads an input node into a fresh register slot. It stays there until its
+ * last use.
+ */
+static int load_input(struct expr_lowering *lowering, struct expr_code *code,
+                      int node) {
+    int slot = allocate_slot(lowering, code);
+    struct expr_instruction *instr;
+
+    if (slot < 0) {
+        return slot;
+    }
+    instr = emit(code, MOV, slot, lowering->expr->nodes[node].lhs);
+    if (!instr) {
+        return -E2BIG;
+    }
+    instr->src[instr->num_src++] = EXPR_BANK_OPERAND;
+    lowering->slot[node] = slot;
+    return 0;
+}
+
+/**
+ * Lowers the expression into the program of a single block with as few
+ * register slots as the operation order allows.
+ */
+static int lower_expression(const struct kernel_expr *expr,
+                            struct expr_code *code) {
+    struct expr_lowering lowering;
+    struct expr_instruction *instr;
+    int root = expr->num_nodes - 1;
+    int ret;
+
+    memset(&lowering, 0, sizeof(lowering));
+    memset(code, 0, sizeof(*code));
+    lowering.expr = expr;
+    memset(lowering.slot, -1, sizeof(lowering.slot));
+    select_operations(&lowering);
+
+    for (int op = 0; op < lowering.num_ops; op++) {
+        const uint8_t *src = lowering.op_src[op];
+        int num_src = lowering.op_num_src[op];
+        int bank_source = -1;
+        int dst;
+
+        // A trigger delivers a single bank operand, further inputs that are
+        // not in a register yet have to be loaded first
+        for (int k = 0; k < num_src; k++) {
+            bool in_bank = expr->nodes[src[k]].op == KERNEL_EXPR_INPUT &&
+                           lowering.slot[src[k]] < 0;
+
+            if (in_bank && bank_source < 0) {
+                bank_source = k;
+            } else if (in_bank) {
+                ret = load_input(&lowering, code, src[k]);
+                if (ret) {
+                    return ret;
+                }
+            }
+        }
+
+        // Sources read for the last time free their slots for the result
+        for (int k = 0; k < num_src; k++) {
+            if (k != bank_source && lowering.last_use[src[k]] == op) {
+                lowering.busy_slots &= ~(1u << lowering.slot[src[k]]);
+            }
+        }
+        dst = allocate_slot(&lowering, code);
+        if (dst < 0) {
+            return dst;
+        }
+
+        instr = emit(code, lowering.op_type[op], dst,
+                     bank_source < 0 ? KERNEL_EXPR_STREAM_DUMMY
+                                     : expr->nodes[src[bank_source]].lhs);
+        if (!instr) {
+            return -E2BIG;
+        }
+        for (int k = 0; k < num_src; k++) {
+            instr->src[instr->num_src++] =
+                k == bank_source ? EXPR_BANK_OPERAND : lowering.slot[src[k]];
+        }
+        lowering.slot[lowering.op_node[op]] = dst;
+    }
+
+    // A bare input as result is copied through a register
+    if (lowering.slot[root] < 0) {
+        ret = load_input(&lowering, code, root);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    instr = emit(code, FILL, EXPR_BANK_OPERAND, KERNEL_EXPR_STREAM_RESULT);
+    if (!instr) {
+        return -E2BIG;
+    }
+    instr->src[instr->num_src++] = lowering.slot[root];
+    return 0;
+}
+
+static bool blocks_fit(const struct expr_code *code, int blocks) {
+    return blocks * code->registers <= EXPR_REGISTER_SLOTS &&
+           blocks * code->count < MICROKERNEL_SLOTS;
+}
+
+int kernel_expr_max_blocks(const struct kernel_expr *expr) {
+    struct expr_code code;
+    int ret = kernel_expr_validate(expr);
+
+    if (!ret) {
+        ret = lower_expression(expr, &code);
+    }
+    if (ret) {
+        return ret;
+    }
+    for (int blocks = GRF_REGISTERS; blocks >= 1; blocks /= 2) {
+        if (blocks_fit(&code, blocks)) {
+            return blocks;
+        }
+    }
+    return -E2BIG;
+}
+
+/**
+ * Register file operand for slot 'slot' of the given block. The blocks take
+ * consecutive ranges of the GRF_A registers followed by GRF_B.
+ */
+static File slot_file(const struct expr_code *code, int block, int slot) {
+    int index = block * code->registers + slot;
+    File file;
+
+    if (slot == EXPR_BANK_OPERAND) {
+        file.type = BANK;
+    } else if (index < GRF_REGISTERS) {
+        file.type = GRF_A;
+        file.grfa.index = index;
+    } else {
+        file.type = GRF_B;
+        file.grfb.index = index - GRF_REGISTERS;
+    }
+    return file;
+}
+
+int kernel_expr_compile(const struct kernel_expr *expr, int blocks,
+                        enum pim_ordering ordering,
+                        struct kernel_expr_program *program) {
+    InstructionType types[KERNEL_PLAN_MAX_TRIGGERS];
+    struct expr_code code;
+    int pc = 0;
+    int ret;
+
+    memset(program, 0, sizeof(*program));
+
+    ret = kernel_expr_validate(expr);
+    if (!ret) {
+        ret = lower_expression(expr, &code);
+    }
+    if (ret) {
+        return ret;
+    }
+    if (blocks < 1 || !blocks_fit(&code, blocks)) {
+        pr_err("PIM: %d blocks do not fit the expression kernel\n", blocks);
+        return -EINVAL;
+    }
+
+    // One phase per instruction of the block program, like the elementwise
+    // kernels, so that runs of the same opcode share a barrier
+    for (int j = 0; j < code.count; j++) {
+        const struct expr_instruction *source = &code.code[j];
+
+        for (int i = 0; i < blocks; i++) {
+            Instruction *instr = &program->kernel.kernel[pc];
+            struct kernel_plan_step *step = &program->steps[pc];
+            struct instruction_operands ops;
+
+            memset(instr, 0, sizeof(*instr));
+            instr->type = source->type;
+            get_instruction_operands(instr, &ops);
+            *ops.dst = slot_file(&code, i, source->dst);
+            for (int k = 0; k < ops.num_src; k++) {
+                *ops.src[k] = slot_file(&code, i, source->src[k]);
+            }
+
+            step->stream = source->stream;
+            step->block = i;
+            step->is_write = source->type == FILL;
+            types[pc] = source->type;
+            if (source->stream != KERNEL_EXPR_STREAM_DUMMY) {
+                program->bank_accesses++;
+            }
+            pc++;
+        }
+    }
+
+    program->kernel.kernel[pc].type = EXIT;
+    program->steps[pc].stream = KERNEL_EXPR_STREAM_DUMMY;
+    types[pc] = EXIT;
+    program->count = pc + 1;
+    while (++pc < MICROKERNEL_SLOTS) {
+        program->kernel.kernel[pc].type = NOP;
+    }
+
+    kernel_plan_place_fences(program->steps, types, program->count, ordering);
+    program->kernel.blocks = blocks;
+    program->blocks = blocks;
+    program->registers = code.registers;
+    return 0;
+}
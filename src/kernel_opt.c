@@ -0,0 +1,575 @@
+#include "../include/microkernels/kernel_opt.h"
+#include "../include/microkernels/kernel_operands.h"
+#include "../include/microkernels/kernel_walk.h"
+
+/*
+ * Registers are tracked as bits of a 32 bit mask: GRF_A[0..7] in bits 0-7,
+ * GRF_B in 8-15, SRF_M in 16-23 and SRF_A in 24-31.
+ */
+#define REGISTER_MASK(type) (0xFFu << ((type) * GRF_REGISTERS))
+#define GRF_MASK (REGISTER_MASK(GRF_A) | REGISTER_MASK(GRF_B))
+
+struct linear_instruction {
+    Instruction instr;
+    // Trigger of the original kernel this instruction consumes
+    uint16_t trigger;
+    bool removed;
+};
+
+struct linear_program {
+    struct linear_instruction code[PIM_OPT_MAX_TRIGGERS];
+    int count;
+    // Scratch space for rolling the program back into loops
+    Instruction rolled[PIM_OPT_MAX_TRIGGERS];
+    Instruction pass[PIM_OPT_MAX_TRIGGERS];
+    // Registers live after every instruction
+    uint32_t live_after[PIM_OPT_MAX_TRIGGERS];
+    // Last read of the value an instruction defines
+    int last_use[PIM_OPT_MAX_TRIGGERS];
+};
+
+/**
+ * Register accesses of an instruction. 'kills' are definite writes, address
+ * aligned instructions may read and write any register of the files they
+ * name, which 'reads' and 'writes' include.
+ */
+struct register_access {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t kills;
+};
+
+static uint32_t register_bit(const File *file) {
+    if (file->type == BANK) {
+        return 0;
+    }
+    return 1u << (file->type * GRF_REGISTERS + file_index(file));
+}
+
+static uint32_t register_file_bits(const File *file) {
+    if (file->type == BANK) {
+        return 0;
+    }
+    return REGISTER_MASK(file->type);
+}
+
+static void get_register_access(const Instruction *instr,
+                                struct register_access *access) {
+    Instruction copy = *instr;
+    struct instruction_operands ops;
+    bool aam;
+
+    memset(access, 0, sizeof(*access));
+    get_instruction_operands(&copy, &ops);
+    aam = ops.aam && *ops.aam;
+
+    for (int i = 0; i < ops.num_src; i++) {
+        if (aam && (ops.src[i]->type == GRF_A || ops.src[i]->type == GRF_B)) {
+            access->reads |= register_file_bits(ops.src[i]);
+        } else {
+            access->reads |= register_bit(ops.src[i]);
+        }
+    }
+
+    if (!ops.dst) {
+        return;
+    }
+    if (aam && (ops.dst->type == GRF_A || ops.dst->type == GRF_B)) {
+        access->writes = register_file_bits(ops.dst);
+    } else {
+        access->writes = register_bit(ops.dst);
+        access->kills = access->writes;
+    }
+}
+
+static bool files_equal(const File *a, const File *b) {
+    return a->type == b->type && file_index(a) == file_index(b);
+}
+
+static bool instructions_equal(const Instruction *a, const Instruction *b) {
+    Instruction copy_a = *a;
+    Instruction copy_b = *b;
+    struct instruction_operands ops_a;
+    struct instruction_operands ops_b;
+
+    if (a->type != b->type) {
+        return false;
+    }
+    if (a->type == JUMP) {
+        return a->jump.offset == b->jump.offset &&
+               a->jump.count == b->jump.count;
+    }
+
+    get_instruction_operands(&copy_a, &ops_a);
+    get_instruction_operands(&copy_b, &ops_b);
+    if (ops_a.aam && *ops_a.aam != *ops_b.aam) {
+        return false;
+    }
+    if (ops_a.dst && !files_equal(ops_a.dst, ops_b.dst)) {
+        return false;
+    }
+    for (int i = 0; i < ops_a.num_src; i++) {
+        if (!files_equal(ops_a.src[i], ops_b.src[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Number of slots up to and including the last instruction that is not a NOP.
+ */
+static int used_slots(const Instruction *code, int count) {
+    while (count > 0 && code[count - 1].type == NOP) {
+        count--;
+    }
+    return count;
+}
+
+static int count_registers(const struct linear_program *prog) {
+    uint32_t used = 0;
+
+    for (int i = 0; i < prog->count; i++) {
+        struct register_access access;
+
+        get_register_access(&prog->code[i].instr, &access);
+        used |= access.reads | access.writes;
+    }
+    return __builtin_popcount(used & GRF_MASK);
+}
+
+static int unroll_kernel(const Microkernel *kernel,
+                         struct linear_program *prog) {
+    struct kernel_walker walker;
+
+    kernel_walker_reset(&walker);
+    prog->count = 0;
+
+    for (;;) {
+        int pc = kernel_walker_resolve(&walker, kernel);
+
+        if (pc < 0) {
+            return pc;
+        }
+        if (prog->count == PIM_OPT_MAX_TRIGGERS) {
+            return -E2BIG;
+        }
+
+        prog->code[prog->count].instr = kernel->kernel[pc];
+        prog->code[prog->count].trigger = prog->count;
+        prog->code[prog->count].removed = false;
+        prog->count++;
+
+        if (kernel->kernel[pc].type == EXIT) {
+            return 0;
+        }
+        walker.pc++;
+    }
+}
+
+static void compact_program(struct linear_program *prog) {
+    int out = 0;
+
+    for (int i = 0; i < prog->count; i++) {
+        if (!prog->code[i].removed) {
+            prog->code[out++] = prog->code[i];
+        }
+    }
+    prog->count = out;
+}
+
+/**
+ * Backward liveness over the straight line program. Nothing is live after
+ * the final EXIT since it resets all registers.
+ */
+static void compute_liveness(struct linear_program *prog) {
+    uint32_t live = 0;
+
+    for (int i = prog->count - 1; i >= 0; i--) {
+        struct register_access access;
+
+        prog->live_after[i] = live;
+        get_register_access(&prog->code[i].instr, &access);
+        live = (live & ~access.kills) | access.reads;
+    }
+}
+
+static int remove_dead_movs(struct linear_program *prog) {
+    int total = 0;
+    int removed;
+
+    // Removing a MOV can make the MOVs feeding it dead as well
+    do {
+        removed = 0;
+        compute_liveness(prog);
+        for (int i = 0; i < prog->count; i++) {
+            const Instruction *instr = &prog->code[i].instr;
+
+            if (instr->type != MOV || instr->mov.dst.type == BANK) {
+                continue;
+            }
+            if (!(register_bit(&instr->mov.dst) & prog->live_after[i])) {
+                prog->code[i].removed = true;
+                removed++;
+            }
+        }
+        compact_program(prog);
+        total += removed;
+    } while (removed);
+
+    return total;
+}
+
+/**
+ * Tries to merge the MUL at 'mul_index' into the next instruction touching
+ * its result. Returns true if the MUL was fused.
+ */
+static bool fuse_mul_add(struct linear_program *prog, int mul_index) {
+    struct linear_instruction *mul = &prog->code[mul_index];
+    uint32_t result = register_bit(&mul->instr.mul.dst);
+    uint32_t sources = register_bit(&mul->instr.mul.src0) |
+                       register_bit(&mul->instr.mul.src1);
+    bool mul_reads_bank = mul->instr.mul.src0.type == BANK ||
+                          mul->instr.mul.src1.type == BANK;
+    struct linear_instruction *add;
+    const File *addend;
+    Instruction mad;
+    int i;
+
+    if (mul->instr.mul.aam || !result) {
+        return false;
+    }
+
+    for (i = mul_index + 1; i < prog->count; i++) {
+        struct register_access access;
+
+        get_register_access(&prog->code[i].instr, &access);
+        if ((access.reads | access.writes) & result) {
+            break;
+        }
+        // The operands of the MUL have to stay the same until the MAD runs
+        if (access.writes & sources) {
+            return false;
+        }
+        if (mul_reads_bank && prog->code[i].instr.type == FILL) {
+            return false;
+        }
+    }
+    if (i == prog->count) {
+        return false;
+    }
+
+    add = &prog->code[i];
+    if (add->instr.type != ADD || add->instr.add.aam) {
+        return false;
+    }
+    if (register_bit(&add->instr.add.src0) == result &&
+        register_bit(&add->instr.add.src1) != result) {
+        addend = &add->instr.add.src1;
+    } else if (register_bit(&add->instr.add.src1) == result &&
+               register_bit(&add->instr.add.src0) != result) {
+        addend = &add->instr.add.src0;
+    } else {
+        return false;
+    }
+
+    // The product must not be needed on its own afterwards
+    if ((prog->live_after[i] & result) &&
+        register_bit(&add->instr.add.dst) != result) {
+        return false;
+    }
+    // A single trigger can only deliver one bank operand
+    if (mul_reads_bank && addend->type == BANK) {
+        return false;
+    }
+
+    mad.type = MAD;
+    mad.mad.src0 = mul->instr.mul.src0;
+    mad.mad.src1 = mul->instr.mul.src1;
+    mad.mad.src2 = *addend;
+    mad.mad.dst = add->instr.add.dst;
+    mad.mad.aam = false;
+    add->instr = mad;
+    if (mul_reads_bank) {
+        add->trigger = mul->trigger;
+    }
+    mul->removed = true;
+    return true;
+}
+
+static int fuse_mads(struct linear_program *prog) {
+    int fused = 0;
+    int i = 0;
+
+    compute_liveness(prog);
+    while (i < prog->count) {
+        if (prog->code[i].instr.type != MUL || !fuse_mul_add(prog, i)) {
+            i++;
+            continue;
+        }
+        // The next instruction moves into slot i
+        compact_program(prog);
+        compute_liveness(prog);
+        fused++;
+    }
+    return fused;
+}
+
+/**
+ * Renames the registers of one GRF so that every value takes the lowest
+ * register that is free when it is defined. Values read before their first
+ * definition keep their register, they rely on the reset by EXIT.
+ */
+static void reuse_registers(struct linear_program *prog, FileType type) {
+    int *last_use = prog->last_use;
+    int current_def[GRF_REGISTERS];
+    int busy_until[GRF_REGISTERS];
+    uint8_t mapping[GRF_REGISTERS];
+
+    for (int r = 0; r < GRF_REGISTERS; r++) {
+        current_def[r] = -1;
+        busy_until[r] = -1;
+        mapping[r] = r;
+    }
+
+    // Address aligned instructions select the register from the address
+    for (int i = 0; i < prog->count; i++) {
+        struct instruction_operands ops;
+
+        get_instruction_operands(&prog->code[i].instr, &ops);
+        if (!ops.aam || !*ops.aam) {
+            continue;
+        }
+        if (ops.dst->type == type) {
+            return;
+        }
+        for (int s = 0; s < ops.num_src; s++) {
+            if (ops.src[s]->type == type) {
+                return;
+            }
+        }
+    }
+
+    // Last read of every value, indexed by its defining instruction
+    for (int i = 0; i < prog->count; i++) {
+        Instruction *instr = &prog->code[i].instr;
+        struct instruction_operands ops;
+
+        get_instruction_operands(instr, &ops);
+        for (int s = 0; s < ops.num_src; s++) {
+            int r = file_index(ops.src[s]);
+
+            if (ops.src[s]->type != type) {
+                continue;
+            }
+            if (current_def[r] >= 0) {
+                last_use[current_def[r]] = i;
+            } else {
+                busy_until[r] = i;
+            }
+        }
+        if (ops.dst && ops.dst->type == type) {
+            current_def[file_index(ops.dst)] = i;
+            last_use[i] = i;
+        }
+    }
+
+    for (int i = 0; i < prog->count; i++) {
+        Instruction *instr = &prog->code[i].instr;
+        struct instruction_operands ops;
+
+        get_instruction_operands(instr, &ops);
+        for (int s = 0; s < ops.num_src; s++) {
+            if (ops.src[s]->type == type) {
+                set_file_index(ops.src[s], mapping[file_index(ops.src[s])]);
+            }
+        }
+        if (ops.dst && ops.dst->type == type) {
+            int r;
+
+            // Sources are read before the destination is written, so a
+            // register whose value dies here can be taken right away
+            for (r = 0; r < GRF_REGISTERS; r++) {
+                if (busy_until[r] <= i) {
+                    break;
+                }
+            }
+            busy_until[r] = last_use[i];
+            mapping[file_index(ops.dst)] = r;
+            set_file_index(ops.dst, r);
+        }
+    }
+}
+
+/**
+ * One rolling pass: replaces the best run of a repeated body at every
+ * position by the body and a JUMP. Returns the new length.
+ */
+static int roll_pass(const Instruction *in, int count, Instruction *out) {
+    int length = 0;
+    int i = 0;
+
+    while (i < count) {
+        int best_period = 0;
+        int best_repeats = 0;
+        int best_saved = 0;
+
+        int max_period = min((count - i) / 2, MICROKERNEL_SLOTS - 1);
+
+        for (int period = 1; period <= max_period; period++) {
+            int repeats = 1;
+            bool self_contained = true;
+            int saved;
+
+            // Loops inside the body must not reach before it
+            for (int j = i; j < i + period; j++) {
+                if (in[j].type == EXIT ||
+                    (in[j].type == JUMP && j + in[j].jump.offset < i)) {
+                    self_contained = false;
+                    break;
+                }
+            }
+            if (!self_contained) {
+                continue;
+            }
+
+            while (i + (repeats + 1) * period <= count) {
+                int j;
+
+                for (j = 0; j < period; j++) {
+                    if (!instructions_equal(&in[i + j],
+                                            &in[i + repeats * period + j])) {
+                        break;
+                    }
+                }
+                if (j < period) {
+                    break;
+                }
+                repeats++;
+            }
+
+            saved = period * repeats - (period + 1);
+            if (repeats > 1 && saved > best_saved) {
+                best_period = period;
+                best_repeats = repeats;
+                best_saved = saved;
+            }
+        }
+
+        if (!best_period) {
+            out[length++] = in[i++];
+            continue;
+        }
+
+        memcpy(&out[length], &in[i], best_period * sizeof(Instruction));
+        length += best_period;
+        out[length].type = JUMP;
+        out[length].jump.offset = -best_period;
+        out[length].jump.count = best_repeats - 1;
+        length++;
+        i += best_period * best_repeats;
+    }
+    return length;
+}
+
+/**
+ * Rolls the straight line program into JUMP loops until no repeated body is
+ * left, which also produces nested loops. Returns the number of slots.
+ */
+static int roll_program(struct linear_program *prog) {
+    int count = prog->count;
+
+    for (int i = 0; i < count; i++) {
+        prog->rolled[i] = prog->code[i].instr;
+    }
+
+    for (;;) {
+        int rolled = roll_pass(prog->rolled, count, prog->pass);
+
+        if (rolled == count) {
+            return count;
+        }
+        memcpy(prog->rolled, prog->pass, rolled * sizeof(Instruction));
+        count = rolled;
+    }
+}
+
+int pim_opt_optimize(Microkernel *kernel, unsigned int flags,
+                     struct pim_opt_stats *stats,
+                     struct pim_opt_trigger_map *map) {
+    struct pim_opt_stats result = {0};
+    struct linear_program *prog;
+    int slots;
+    int ret;
+
+    prog = kvmalloc(sizeof(*prog), GFP_KERNEL);
+    if (!prog) {
+        return -ENOMEM;
+    }
+
+    ret = unroll_kernel(kernel, prog);
+    if (ret) {
+        goto cleanup;
+    }
+    result.slots_before = used_slots(kernel->kernel, MICROKERNEL_SLOTS);
+    result.triggers_before = prog->count;
+    result.registers_before = count_registers(prog);
+
+    if (flags & PIM_OPT_DEAD_MOV) {
+        result.movs_removed = remove_dead_movs(prog);
+    }
+    if (flags & PIM_OPT_FUSE_MAD) {
+        result.mads_fused = fuse_mads(prog);
+        // Fusing can leave the MOVs feeding a product without a reader
+        if (flags & PIM_OPT_DEAD_MOV) {
+            result.movs_removed += remove_dead_movs(prog);
+        }
+    }
+    if (flags & PIM_OPT_REUSE_GRF) {
+        reuse_registers(prog, GRF_A);
+        reuse_registers(prog, GRF_B);
+    }
+
+    result.triggers_after = prog->count;
+    result.registers_after = count_registers(prog);
+
+    slots = roll_program(prog);
+    if (slots > MICROKERNEL_SLOTS) {
+        ret = -ENOSPC;
+        goto cleanup;
+    }
+    result.slots_after = slots;
+
+    if (map) {
+        map->count = prog->count;
+        for (int i = 0; i < prog->count; i++) {
+            map->source[i] = prog->code[i].trigger;
+        }
+    }
+
+    // Keep the original if rolling could not recover its loops
+    if (slots > result.slots_before &&
+        result.triggers_after == result.triggers_before) {
+        if (map) {
+            for (int i = 0; i < map->count; i++) {
+                map->source[i] = i;
+            }
+        }
+        result.slots_after = result.slots_before;
+        result.registers_after = result.registers_before;
+        goto done;
+    }
+
+    memcpy(kernel->kernel, prog->rolled, slots * sizeof(Instruction));
+    for (int i = slots; i < MICROKERNEL_SLOTS; i++) {
+        kernel->kernel[i].type = NOP;
+    }
+
+done:
+    if (stats) {
+        *stats = result;
+    }
+cleanup:
+    kvfree(prog);
+    return ret;
+}
@@ -0,0 +1,120 @@
+#include "../include/microkernels/kernel_plan.h"
+#include "../include/microkernels/kernel_walk.h"
+
+static bool is_bank(const File *file) {
+    return file->type == BANK;
+}
+
+static enum kernel_stream classify_instruction(const Instruction *instr) {
+    switch (instr->type) {
+    case MOV:
+        if (!is_bank(&instr->mov.src)) {
+            return KERNEL_STREAM_DUMMY;
+        }
+        if (instr->mov.dst.type == GRF_A) {
+            return KERNEL_STREAM_A;
+        }
+        if (instr->mov.dst.type == GRF_B) {
+            return KERNEL_STREAM_C;
+        }
+        return KERNEL_STREAM_CONSTANT;
+    case FILL:
+        return KERNEL_STREAM_RESULT;
+    case ADD:
+        return is_bank(&instr->add.src0) || is_bank(&instr->add.src1)
+                   ? KERNEL_STREAM_B
+                   : KERNEL_STREAM_DUMMY;
+    case MUL:
+        return is_bank(&instr->mul.src0) || is_bank(&instr->mul.src1)
+                   ? KERNEL_STREAM_B
+                   : KERNEL_STREAM_DUMMY;
+    case MAC:
+        return is_bank(&instr->mac.src0) || is_bank(&instr->mac.src1) ||
+                       is_bank(&instr->mac.src2)
+                   ? KERNEL_STREAM_B
+                   : KERNEL_STREAM_DUMMY;
+    case MAD:
+        return is_bank(&instr->mad.src0) || is_bank(&instr->mad.src1) ||
+                       is_bank(&instr->mad.src2)
+                   ? KERNEL_STREAM_B
+                   : KERNEL_STREAM_DUMMY;
+    default:
+        return KERNEL_STREAM_DUMMY;
+    }
+}
+
+/**
+ * Barrier after trigger 'i' under the phase based policies: one after every
+ * run of the same opcode.
+ */
+static enum trigger_fence phase_fence(const InstructionType *types, int count,
+                                      int i, bool is_write) {
+    if (i + 1 < count && types[i + 1] == types[i]) {
+        return TRIGGER_FENCE_NONE;
+    }
+    if (types[i] == EXIT) {
+        return TRIGGER_FENCE_FULL;
+    }
+    return is_write ? TRIGGER_FENCE_WRITE : TRIGGER_FENCE_READ;
+}
+
+void kernel_plan_place_fences(struct kernel_plan_step *steps,
+                              const InstructionType *types, int count,
+                              enum pim_ordering ordering) {
+    // Batches are closed by the caller after the last invocation
+    for (int i = 0; i < count; i++) {
+        steps[i].fence = ordering == PIM_ORDER_BATCH
+                             ? TRIGGER_FENCE_NONE
+                             : phase_fence(types, count, i, steps[i].is_write);
+    }
+}
+
+int kernel_plan_build(const Microkernel *kernel, enum pim_ordering ordering,
+                      struct kernel_plan *plan) {
+    InstructionType types[KERNEL_PLAN_MAX_TRIGGERS];
+    struct kernel_walker walker;
+
+    memset(plan, 0, sizeof(*plan));
+    kernel_walker_reset(&walker);
+
+    for (;;) {
+        struct kernel_plan_step *step;
+        const Instruction *instr;
+        int pc = kernel_walker_resolve(&walker, kernel);
+
+        if (pc < 0) {
+            return pc;
+        }
+        if (plan->count == KERNEL_PLAN_MAX_TRIGGERS) {
+            pr_err("PIM: kernel needs more than %d triggers\n",
+                   KERNEL_PLAN_MAX_TRIGGERS);
+            return -E2BIG;
+        }
+
+        instr = &kernel->kernel[pc];
+        step = &plan->steps[plan->count];
+        types[plan->count] = instr->type;
+        plan->count++;
+
+        step->stream = classify_instruction(instr);
+        step->block = plan->stream_blocks[step->stream]++;
+        step->is_write = instr->type == FILL;
+
+        if (instr->type == EXIT) {
+            break;
+        }
+        walker.pc++;
+    }
+
+    kernel_plan_place_fences(plan->steps, types, plan->count, ordering);
+
+    plan->blocks = plan->stream_blocks[KERNEL_STREAM_RESULT];
+    if (!plan->blocks ||
+        plan->stream_blocks[KERNEL_STREAM_A] != plan->blocks ||
+        plan->stream_blocks[KERNEL_STREAM_B] != plan->blocks ||
+        (plan->stream_blocks[KERNEL_STREAM_C] &&
+         plan->stream_blocks[KERNEL_STREAM_C] != plan->blocks)) {
+        return -EINVAL;
+    }
+    return 0;
+}
@@ -1,6 +1,3 @@
-#include <linux/errno.h>
-#include <linux/kernel.h>
-
 #include "../include/microkernels/kernel_to_string.h"
 
 static int parse_file_to_string(char *buffer, size_t size, const File *file) {
@@ -335,3 +332,46 @@ int parse_instruction_to_string(char *buffer, size_t size,
 
     return total_written;
 }
+
+int parse_kernel_to_string(char *buffer, size_t size,
+                           const Microkernel *kernel) {
+    int written;
+    char *ptr = buffer;
+    size_t remaining = size;
+    int total_written = 0;
+
+    written = snprintf(ptr, remaining, "{\"bank_mode\":null,\"kernel\":[");
+    if (written < 0 || written >= remaining)
+        return -ENOMEM;
+    ptr += written;
+    remaining -= written;
+    total_written += written;
+
+    for (int i = 0; i < MICROKERNEL_SLOTS; ++i) {
+        if (i > 0) {
+            written = snprintf(ptr, remaining, ","); // for the comma
+            if (written < 0 || written >= remaining)
+                return -ENOMEM;
+            ptr += written;
+            remaining -= written;
+            total_written += written;
+        }
+
+        written =
+            parse_instruction_to_string(ptr, remaining, &kernel->kernel[i]);
+        if (written < 0)
+            return written;
+        if (written >= remaining)
+            return -ENOMEM;
+        ptr += written;
+        remaining -= written;
+        total_written += written;
+    }
+
+    written = snprintf(ptr, remaining, "]}");
+    if (written < 0 || written >= remaining)
+        return -ENOMEM;
+    total_written += written;
+
+    return total_written;
+}
@@ -1,1005 +1,367 @@
-#include <linux/errno.h>
-#include <linux/kernel.h>
-
 #include "../include/microkernels/kernel_datastructures.h"
 #include "../include/microkernels/kernels.h"
 
-int build_kernel_vadd_X1(Microkernel *kernel_vadd) {
+/*
+ * Variants the dispatcher can choose from, ordered by descending block count
+ * per opcode so that the first fitting entry is the best one.
+ */
+static const struct kernel_variant kernel_variants[] = {
+    {ADD, 8, false}, {ADD, 4, false}, {ADD, 2, false}, {ADD, 1, false},
+    {ADD, 8, true},  {ADD, 4, true},  {ADD, 2, true},  {ADD, 1, true},
+    {MUL, 8, false}, {MUL, 4, false}, {MUL, 2, false}, {MUL, 1, false},
+    {MAD, 4, false}, {MAD, 2, false}, {MAD, 1, false}, {MAC, 4, false},
+    {MAC, 2, false}, {MAC, 1, false},
+};
+
+static File bank_file(void) {
+    File file;
+
+    file.type = BANK;
+    return file;
+}
 
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
+static File grf_a_file(uint8_t index) {
+    File file;
 
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
+    file.type = GRF_A;
+    file.grfa.index = index;
+    return file;
+}
 
-    instr1.type = ADD;
-    instr1.add.src0.type = BANK;
-    instr1.add.src1.type = GRF_A;
-    instr1.add.src1.grfa.index = 0;
-    instr1.add.dst.type = GRF_B;
-    instr1.add.dst.grfb.index = 0;
-    instr1.add.aam = false;
+static File grf_b_file(uint8_t index) {
+    File file;
 
-    instr2.type = FILL;
-    instr2.fill.src.type = GRF_B;
-    instr2.fill.src.grfb.index = 0;
-    instr2.fill.dst.type = BANK;
+    file.type = GRF_B;
+    file.grfb.index = index;
+    return file;
+}
 
-    instr3.type = EXIT;
+static File srf_m_file(uint8_t index) {
+    File file;
 
-    instr4.type = NOP;
+    file.type = SRF_M;
+    file.srfm.index = index;
+    return file;
+}
 
-    kernel_vadd->kernel[0] = instr0;
-    kernel_vadd->kernel[1] = instr1;
-    kernel_vadd->kernel[2] = instr2;
-    kernel_vadd->kernel[3] = instr3;
-    kernel_vadd->kernel[4] = instr4;
-    kernel_vadd->kernel[5] = instr4;
-    kernel_vadd->kernel[6] = instr4;
-    kernel_vadd->kernel[7] = instr4;
-    kernel_vadd->kernel[8] = instr4;
-    kernel_vadd->kernel[9] = instr4;
-    kernel_vadd->kernel[10] = instr4;
-    kernel_vadd->kernel[11] = instr4;
-    kernel_vadd->kernel[12] = instr4;
-    kernel_vadd->kernel[13] = instr4;
-    kernel_vadd->kernel[14] = instr4;
-    kernel_vadd->kernel[15] = instr4;
-    kernel_vadd->kernel[16] = instr4;
-    kernel_vadd->kernel[17] = instr4;
-    kernel_vadd->kernel[18] = instr4;
-    kernel_vadd->kernel[19] = instr4;
-    kernel_vadd->kernel[20] = instr4;
-    kernel_vadd->kernel[21] = instr4;
-    kernel_vadd->kernel[22] = instr4;
-    kernel_vadd->kernel[23] = instr4;
-    kernel_vadd->kernel[24] = instr4;
-    kernel_vadd->kernel[25] = instr4;
-    kernel_vadd->kernel[26] = instr4;
-    kernel_vadd->kernel[27] = instr4;
-    kernel_vadd->kernel[28] = instr4;
-    kernel_vadd->kernel[29] = instr4;
-    kernel_vadd->kernel[30] = instr4;
-    kernel_vadd->kernel[31] = instr4;
+static Instruction mov_instruction(File src, File dst) {
+    Instruction instr;
 
-    kernel_vadd->blocks = 1;
-    return 0;
+    instr.type = MOV;
+    instr.mov.src = src;
+    instr.mov.dst = dst;
+    return instr;
 }
 
-int build_kernel_vadd_X2(Microkernel *kernel_vadd) {
+static Instruction fill_instruction(File src) {
+    Instruction instr;
 
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
-    Instruction instr5;
-    Instruction instr6;
-    Instruction instr7;
+    instr.type = FILL;
+    instr.fill.src = src;
+    instr.fill.dst = bank_file();
+    return instr;
+}
 
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
+/**
+ * Creates a two source arithmetic instruction (ADD or MUL) with the bank as
+ * first operand.
+ */
+static Instruction binary_instruction(InstructionType opcode, File src1,
+                                      File dst, bool aam) {
+    Instruction instr;
+
+    instr.type = opcode;
+    if (opcode == ADD) {
+        instr.add.src0 = bank_file();
+        instr.add.src1 = src1;
+        instr.add.dst = dst;
+        instr.add.aam = aam;
+    } else {
+        instr.mul.src0 = bank_file();
+        instr.mul.src1 = src1;
+        instr.mul.dst = dst;
+        instr.mul.aam = aam;
+    }
+    return instr;
+}
 
-    instr1.type = MOV;
-    instr1.mov.src.type = BANK;
-    instr1.mov.dst.type = GRF_A;
-    instr1.mov.dst.grfa.index = 1;
+/**
+ * Creates a three source arithmetic instruction (MAC or MAD) computing
+ * dst = BANK * src1 + src2.
+ */
+static Instruction ternary_instruction(InstructionType opcode, File src1,
+                                       File src2, File dst, bool aam) {
+    Instruction instr;
+
+    instr.type = opcode;
+    if (opcode == MAC) {
+        instr.mac.src0 = bank_file();
+        instr.mac.src1 = src1;
+        instr.mac.src2 = src2;
+        instr.mac.dst = dst;
+        instr.mac.aam = aam;
+    } else {
+        instr.mad.src0 = bank_file();
+        instr.mad.src1 = src1;
+        instr.mad.src2 = src2;
+        instr.mad.dst = dst;
+        instr.mad.aam = aam;
+    }
+    return instr;
+}
 
-    instr2.type = ADD;
-    instr2.add.src0.type = BANK;
-    instr2.add.src1.type = GRF_A;
-    instr2.add.src1.grfa.index = 0;
-    instr2.add.dst.type = GRF_B;
-    instr2.add.dst.grfb.index = 0;
-    instr2.add.aam = false;
+static Instruction jump_instruction(int offset, unsigned int count) {
+    Instruction instr;
 
-    instr3.type = ADD;
-    instr3.add.src0.type = BANK;
-    instr3.add.src1.type = GRF_A;
-    instr3.add.src1.grfa.index = 1;
-    instr3.add.dst.type = GRF_B;
-    instr3.add.dst.grfb.index = 1;
-    instr3.add.aam = false;
+    instr.type = JUMP;
+    instr.jump.offset = offset;
+    instr.jump.count = count;
+    return instr;
+}
 
-    instr4.type = FILL;
-    instr4.fill.src.type = GRF_B;
-    instr4.fill.src.grfb.index = 0;
-    instr4.fill.dst.type = BANK;
+static Instruction plain_instruction(InstructionType type) {
+    Instruction instr;
 
-    instr5.type = FILL;
-    instr5.fill.src.type = GRF_B;
-    instr5.fill.src.grfb.index = 1;
-    instr5.fill.dst.type = BANK;
+    memset(&instr, 0, sizeof(instr));
+    instr.type = type;
+    return instr;
+}
 
-    instr6.type = EXIT;
+/**
+ * Terminates a kernel with EXIT at slot 'pc' and pads the remaining slots
+ * with NOPs.
+ */
+static void finish_kernel(Microkernel *kernel, int pc) {
+    kernel->kernel[pc++] = plain_instruction(EXIT);
+    while (pc < MICROKERNEL_SLOTS) {
+        kernel->kernel[pc++] = plain_instruction(NOP);
+    }
+}
 
-    instr7.type = NOP;
+static bool is_ternary_opcode(InstructionType opcode) {
+    return opcode == MAC || opcode == MAD;
+}
 
-    kernel_vadd->kernel[0] = instr0;
-    kernel_vadd->kernel[1] = instr1;
-    kernel_vadd->kernel[2] = instr2;
-    kernel_vadd->kernel[3] = instr3;
-    kernel_vadd->kernel[4] = instr4;
-    kernel_vadd->kernel[5] = instr5;
-    kernel_vadd->kernel[6] = instr6;
-    kernel_vadd->kernel[7] = instr7;
-    kernel_vadd->kernel[8] = instr7;
-    kernel_vadd->kernel[9] = instr7;
-    kernel_vadd->kernel[10] = instr7;
-    kernel_vadd->kernel[11] = instr7;
-    kernel_vadd->kernel[12] = instr7;
-    kernel_vadd->kernel[13] = instr7;
-    kernel_vadd->kernel[14] = instr7;
-    kernel_vadd->kernel[15] = instr7;
-    kernel_vadd->kernel[16] = instr7;
-    kernel_vadd->kernel[17] = instr7;
-    kernel_vadd->kernel[18] = instr7;
-    kernel_vadd->kernel[19] = instr7;
-    kernel_vadd->kernel[20] = instr7;
-    kernel_vadd->kernel[21] = instr7;
-    kernel_vadd->kernel[22] = instr7;
-    kernel_vadd->kernel[23] = instr7;
-    kernel_vadd->kernel[24] = instr7;
-    kernel_vadd->kernel[25] = instr7;
-    kernel_vadd->kernel[26] = instr7;
-    kernel_vadd->kernel[27] = instr7;
-    kernel_vadd->kernel[28] = instr7;
-    kernel_vadd->kernel[29] = instr7;
-    kernel_vadd->kernel[30] = instr7;
-    kernel_vadd->kernel[31] = instr7;
+int kernel_elementwise_max_blocks(InstructionType opcode) {
+    int phases;
+
+    switch (opcode) {
+    case ADD:
+    case MUL:
+        phases = 3;
+        break;
+    case MAC:
+    case MAD:
+        phases = 4;
+        break;
+    default:
+        return 0;
+    }
+
+    // One slot is always taken by the EXIT instruction
+    return min(GRF_REGISTERS, (MICROKERNEL_SLOTS - 1) / phases);
+}
 
-    kernel_vadd->blocks = 2;
+int build_kernel_elementwise(Microkernel *kernel, InstructionType opcode,
+                             int blocks) {
+    int pc = 0;
+    int i;
+
+    if (blocks < 1 || blocks > kernel_elementwise_max_blocks(opcode)) {
+        pr_err("PIM: %d blocks do not fit an elementwise kernel for opcode "
+               "%d\n",
+               blocks, opcode);
+        return -EINVAL;
+    }
+
+    // Phase 1: first operand into GRF_A
+    for (i = 0; i < blocks; i++) {
+        kernel->kernel[pc++] = mov_instruction(bank_file(), grf_a_file(i));
+    }
+
+    // Phase 2 (MAC/MAD only): addend into GRF_B
+    if (is_ternary_opcode(opcode)) {
+        for (i = 0; i < blocks; i++) {
+            kernel->kernel[pc++] = mov_instruction(bank_file(), grf_b_file(i));
+        }
+    }
+
+    // Phase 3: combine the bank operand with the registers
+    for (i = 0; i < blocks; i++) {
+        if (is_ternary_opcode(opcode)) {
+            kernel->kernel[pc++] = ternary_instruction(
+                opcode, grf_a_file(i), grf_b_file(i), grf_b_file(i), false);
+        } else {
+            kernel->kernel[pc++] =
+                binary_instruction(opcode, grf_a_file(i), grf_b_file(i), false);
+        }
+    }
+
+    // Phase 4: write results back
+    for (i = 0; i < blocks; i++) {
+        kernel->kernel[pc++] = fill_instruction(grf_b_file(i));
+    }
+
+    finish_kernel(kernel, pc);
+    kernel->blocks = blocks;
     return 0;
 }
 
-int build_kernel_vadd_X3(Microkernel *kernel_vadd) {
-
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
-    Instruction instr5;
-    Instruction instr6;
-    Instruction instr7;
-    Instruction instr8;
-    Instruction instr9;
-    Instruction instr10;
-    Instruction instr11;
-    Instruction instr12;
-    Instruction instr13;
-
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
-
-    instr1.type = MOV;
-    instr1.mov.src.type = BANK;
-    instr1.mov.dst.type = GRF_A;
-    instr1.mov.dst.grfa.index = 1;
-
-    instr2.type = MOV;
-    instr2.mov.src.type = BANK;
-    instr2.mov.dst.type = GRF_A;
-    instr2.mov.dst.grfa.index = 2;
-
-    instr3.type = MOV;
-    instr3.mov.src.type = BANK;
-    instr3.mov.dst.type = GRF_A;
-    instr3.mov.dst.grfa.index = 3;
-
-    instr4.type = ADD;
-    instr4.add.src0.type = BANK;
-    instr4.add.src1.type = GRF_A;
-    instr4.add.src1.grfa.index = 0;
-    instr4.add.dst.type = GRF_B;
-    instr4.add.dst.grfb.index = 0;
-    instr4.add.aam = false;
-
-    instr5.type = ADD;
-    instr5.add.src0.type = BANK;
-    instr5.add.src1.type = GRF_A;
-    instr5.add.src1.grfa.index = 1;
-    instr5.add.dst.type = GRF_B;
-    instr5.add.dst.grfb.index = 1;
-    instr5.add.aam = false;
-
-    instr6.type = ADD;
-    instr6.add.src0.type = BANK;
-    instr6.add.src1.type = GRF_A;
-    instr6.add.src1.grfa.index = 2;
-    instr6.add.dst.type = GRF_B;
-    instr6.add.dst.grfb.index = 2;
-    instr6.add.aam = false;
-
-    instr7.type = ADD;
-    instr7.add.src0.type = BANK;
-    instr7.add.src1.type = GRF_A;
-    instr7.add.src1.grfa.index = 3;
-    instr7.add.dst.type = GRF_B;
-    instr7.add.dst.grfb.index = 3;
-    instr7.add.aam = false;
-
-    instr8.type = FILL;
-    instr8.fill.src.type = GRF_B;
-    instr8.fill.src.grfb.index = 0;
-    instr8.fill.dst.type = BANK;
-
-    instr9.type = FILL;
-    instr9.fill.src.type = GRF_B;
-    instr9.fill.src.grfb.index = 1;
-    instr9.fill.dst.type = BANK;
-
-    instr10.type = FILL;
-    instr10.fill.src.type = GRF_B;
-    instr10.fill.src.grfb.index = 2;
-    instr10.fill.dst.type = BANK;
-
-    instr11.type = FILL;
-    instr11.fill.src.type = GRF_B;
-    instr11.fill.src.grfb.index = 3;
-    instr11.fill.dst.type = BANK;
-
-    instr12.type = EXIT;
-
-    instr13.type = NOP;
-
-    kernel_vadd->kernel[0] = instr0;
-    kernel_vadd->kernel[1] = instr1;
-    kernel_vadd->kernel[2] = instr2;
-    kernel_vadd->kernel[3] = instr3;
-    kernel_vadd->kernel[4] = instr4;
-    kernel_vadd->kernel[5] = instr5;
-    kernel_vadd->kernel[6] = instr6;
-    kernel_vadd->kernel[7] = instr7;
-    kernel_vadd->kernel[8] = instr8;
-    kernel_vadd->kernel[9] = instr9;
-    kernel_vadd->kernel[10] = instr10;
-    kernel_vadd->kernel[11] = instr11;
-    kernel_vadd->kernel[12] = instr12;
-    kernel_vadd->kernel[13] = instr13;
-    kernel_vadd->kernel[14] = instr13;
-    kernel_vadd->kernel[15] = instr13;
-    kernel_vadd->kernel[16] = instr13;
-    kernel_vadd->kernel[17] = instr13;
-    kernel_vadd->kernel[18] = instr13;
-    kernel_vadd->kernel[19] = instr13;
-    kernel_vadd->kernel[20] = instr13;
-    kernel_vadd->kernel[21] = instr13;
-    kernel_vadd->kernel[22] = instr13;
-    kernel_vadd->kernel[23] = instr13;
-    kernel_vadd->kernel[24] = instr13;
-    kernel_vadd->kernel[25] = instr13;
-    kernel_vadd->kernel[26] = instr13;
-    kernel_vadd->kernel[27] = instr13;
-    kernel_vadd->kernel[28] = instr13;
-    kernel_vadd->kernel[29] = instr13;
-    kernel_vadd->kernel[30] = instr13;
-    kernel_vadd->kernel[31] = instr13;
-
-    kernel_vadd->blocks = 4;
+int build_kernel_elementwise_scaled(Microkernel *kernel, int blocks) {
+    int pc = 0;
+    int i;
+
+    // One slot each for the scalar load and the EXIT instruction
+    if (blocks < 1 ||
+        blocks > min(GRF_REGISTERS, (MICROKERNEL_SLOTS - 2) / 3)) {
+        pr_err("PIM: %d blocks do not fit a scaled elementwise kernel\n",
+               blocks);
+        return -EINVAL;
+    }
+
+    // Phase 1: scalar from lane 0 of the constant block
+    kernel->kernel[pc++] = mov_instruction(bank_file(), srf_m_file(0));
+
+    // Phase 2: first operand into GRF_A
+    for (i = 0; i < blocks; i++) {
+        kernel->kernel[pc++] = mov_instruction(bank_file(), grf_a_file(i));
+    }
+
+    // Phase 3: GRF_B = BANK * SRF_M + GRF_A
+    for (i = 0; i < blocks; i++) {
+        kernel->kernel[pc++] = ternary_instruction(
+            MAD, srf_m_file(0), grf_a_file(i), grf_b_file(i), false);
+    }
+
+    // Phase 4: write results back
+    for (i = 0; i < blocks; i++) {
+        kernel->kernel[pc++] = fill_instruction(grf_b_file(i));
+    }
+
+    finish_kernel(kernel, pc);
+    kernel->blocks = blocks;
     return 0;
 }
 
-int build_kernel_vadd_X4(Microkernel *kernel_vadd) {
-
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
-    Instruction instr5;
-    Instruction instr6;
-    Instruction instr7;
-    Instruction instr8;
-    Instruction instr9;
-    Instruction instr10;
-    Instruction instr11;
-    Instruction instr12;
-    Instruction instr13;
-    Instruction instr14;
-    Instruction instr15;
-    Instruction instr16;
-    Instruction instr17;
-    Instruction instr18;
-    Instruction instr19;
-    Instruction instr20;
-    Instruction instr21;
-    Instruction instr22;
-    Instruction instr23;
-    Instruction instr24;
-    Instruction instr25;
-
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
-
-    instr1.type = MOV;
-    instr1.mov.src.type = BANK;
-    instr1.mov.dst.type = GRF_A;
-    instr1.mov.dst.grfa.index = 1;
-
-    instr2.type = MOV;
-    instr2.mov.src.type = BANK;
-    instr2.mov.dst.type = GRF_A;
-    instr2.mov.dst.grfa.index = 2;
-
-    instr3.type = MOV;
-    instr3.mov.src.type = BANK;
-    instr3.mov.dst.type = GRF_A;
-    instr3.mov.dst.grfa.index = 3;
-
-    instr4.type = MOV;
-    instr4.mov.src.type = BANK;
-    instr4.mov.dst.type = GRF_A;
-    instr4.mov.dst.grfa.index = 4;
-
-    instr5.type = MOV;
-    instr5.mov.src.type = BANK;
-    instr5.mov.dst.type = GRF_A;
-    instr5.mov.dst.grfa.index = 5;
-
-    instr6.type = MOV;
-    instr6.mov.src.type = BANK;
-    instr6.mov.dst.type = GRF_A;
-    instr6.mov.dst.grfa.index = 6;
-
-    instr7.type = MOV;
-    instr7.mov.src.type = BANK;
-    instr7.mov.dst.type = GRF_A;
-    instr7.mov.dst.grfa.index = 7;
-
-    instr8.type = ADD;
-    instr8.add.src0.type = BANK;
-    instr8.add.src1.type = GRF_A;
-    instr8.add.src1.grfa.index = 0;
-    instr8.add.dst.type = GRF_B;
-    instr8.add.dst.grfb.index = 0;
-    instr8.add.aam = false;
-
-    instr9.type = ADD;
-    instr9.add.src0.type = BANK;
-    instr9.add.src1.type = GRF_A;
-    instr9.add.src1.grfa.index = 1;
-    instr9.add.dst.type = GRF_B;
-    instr9.add.dst.grfb.index = 1;
-    instr9.add.aam = false;
-
-    instr10.type = ADD;
-    instr10.add.src0.type = BANK;
-    instr10.add.src1.type = GRF_A;
-    instr10.add.src1.grfa.index = 2;
-    instr10.add.dst.type = GRF_B;
-    instr10.add.dst.grfb.index = 2;
-    instr10.add.aam = false;
-
-    instr11.type = ADD;
-    instr11.add.src0.type = BANK;
-    instr11.add.src1.type = GRF_A;
-    instr11.add.src1.grfa.index = 3;
-    instr11.add.dst.type = GRF_B;
-    instr11.add.dst.grfb.index = 3;
-    instr11.add.aam = false;
-
-    instr12.type = ADD;
-    instr12.add.src0.type = BANK;
-    instr12.add.src1.type = GRF_A;
-    instr12.add.src1.grfa.index = 4;
-    instr12.add.dst.type = GRF_B;
-    instr12.add.dst.grfb.index = 4;
-    instr12.add.aam = false;
-
-    instr13.type = ADD;
-    instr13.add.src0.type = BANK;
-    instr13.add.src1.type = GRF_A;
-    instr13.add.src1.grfa.index = 5;
-    instr13.add.dst.type = GRF_B;
-    instr13.add.dst.grfb.index = 5;
-    instr13.add.aam = false;
-
-    instr14.type = ADD;
-    instr14.add.src0.type = BANK;
-    instr14.add.src1.type = GRF_A;
-    instr14.add.src1.grfa.index = 6;
-    instr14.add.dst.type = GRF_B;
-    instr14.add.dst.grfb.index = 6;
-    instr14.add.aam = false;
-
-    instr15.type = ADD;
-    instr15.add.src0.type = BANK;
-    instr15.add.src1.type = GRF_A;
-    instr15.add.src1.grfa.index = 7;
-    instr15.add.dst.type = GRF_B;
-    instr15.add.dst.grfb.index = 7;
-    instr15.add.aam = false;
-
-    instr16.type = FILL;
-    instr16.fill.src.type = GRF_B;
-    instr16.fill.src.grfb.index = 0;
-    instr16.fill.dst.type = BANK;
-
-    instr17.type = FILL;
-    instr17.fill.src.type = GRF_B;
-    instr17.fill.src.grfb.index = 1;
-    instr17.fill.dst.type = BANK;
-
-    instr18.type = FILL;
-    instr18.fill.src.type = GRF_B;
-    instr18.fill.src.grfb.index = 2;
-    instr18.fill.dst.type = BANK;
-
-    instr19.type = FILL;
-    instr19.fill.src.type = GRF_B;
-    instr19.fill.src.grfb.index = 3;
-    instr19.fill.dst.type = BANK;
-
-    instr20.type = FILL;
-    instr20.fill.src.type = GRF_B;
-    instr20.fill.src.grfb.index = 4;
-    instr20.fill.dst.type = BANK;
-
-    instr21.type = FILL;
-    instr21.fill.src.type = GRF_B;
-    instr21.fill.src.grfb.index = 5;
-    instr21.fill.dst.type = BANK;
-
-    instr22.type = FILL;
-    instr22.fill.src.type = GRF_B;
-    instr22.fill.src.grfb.index = 6;
-    instr22.fill.dst.type = BANK;
-
-    instr23.type = FILL;
-    instr23.fill.src.type = GRF_B;
-    instr23.fill.src.grfb.index = 7;
-    instr23.fill.dst.type = BANK;
-
-    instr24.type = EXIT;
-
-    instr25.type = NOP;
-
-    kernel_vadd->kernel[0] = instr0;
-    kernel_vadd->kernel[1] = instr1;
-    kernel_vadd->kernel[2] = instr2;
-    kernel_vadd->kernel[3] = instr3;
-    kernel_vadd->kernel[4] = instr4;
-    kernel_vadd->kernel[5] = instr5;
-    kernel_vadd->kernel[6] = instr6;
-    kernel_vadd->kernel[7] = instr7;
-    kernel_vadd->kernel[8] = instr8;
-    kernel_vadd->kernel[9] = instr9;
-    kernel_vadd->kernel[10] = instr10;
-    kernel_vadd->kernel[11] = instr11;
-    kernel_vadd->kernel[12] = instr12;
-    kernel_vadd->kernel[13] = instr13;
-    kernel_vadd->kernel[14] = instr14;
-    kernel_vadd->kernel[15] = instr15;
-    kernel_vadd->kernel[16] = instr16;
-    kernel_vadd->kernel[17] = instr17;
-    kernel_vadd->kernel[18] = instr18;
-    kernel_vadd->kernel[19] = instr19;
-    kernel_vadd->kernel[20] = instr20;
-    kernel_vadd->kernel[21] = instr21;
-    kernel_vadd->kernel[22] = instr22;
-    kernel_vadd->kernel[23] = instr23;
-    kernel_vadd->kernel[24] = instr24;
-    kernel_vadd->kernel[25] = instr25;
-    kernel_vadd->kernel[26] = instr25;
-    kernel_vadd->kernel[27] = instr25;
-    kernel_vadd->kernel[28] = instr25;
-    kernel_vadd->kernel[29] = instr25;
-    kernel_vadd->kernel[30] = instr25;
-    kernel_vadd->kernel[31] = instr25;
-
-    kernel_vadd->blocks = 8;
+/**
+ * Builds the GEMV kernel of build_kernel_gemv_variant. With 'transposed' the
+ * register files swap their roles: GRF_B holds the input vector blocks of the
+ * 'row_blocks' block rows and GRF_A accumulates the 'column_blocks' block
+ * columns. The address aligned indices stay the same, so both kernels run on
+ * the same tile layout and trigger addresses.
+ */
+static int build_gemv(Microkernel *kernel, int row_blocks, int column_blocks,
+                      unsigned int chunks, bool transposed) {
+    int vector_blocks = transposed ? row_blocks : column_blocks;
+    int output_blocks = transposed ? column_blocks : row_blocks;
+    File (*vector_file)(uint8_t) = transposed ? grf_b_file : grf_a_file;
+    File (*accumulator_file)(uint8_t) = transposed ? grf_a_file : grf_b_file;
+    int pc = 0;
+    int i;
+
+    if (row_blocks < 1 || row_blocks > GRF_REGISTERS || column_blocks < 1 ||
+        column_blocks > GRF_REGISTERS) {
+        pr_err("PIM: GEMV variant %dx%d exceeds the GRF\n", row_blocks,
+               column_blocks);
+        return -EINVAL;
+    }
+    if (chunks < 1 || chunks > KERNEL_GEMV_MAX_CHUNKS) {
+        pr_err("PIM: GEMV variant with %u column chunks\n", chunks);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < vector_blocks; i++) {
+        kernel->kernel[pc++] = mov_instruction(bank_file(), vector_file(i));
+    }
+
+    // Address aligned mode selects GRF_A/GRF_B from the triggering address
+    kernel->kernel[pc++] = ternary_instruction(
+        MAC, vector_file(0), accumulator_file(0), accumulator_file(0), true);
+    if (row_blocks * column_blocks > 1) {
+        kernel->kernel[pc++] =
+            jump_instruction(-1, row_blocks * column_blocks - 1);
+    }
+
+    // The accumulators stay live while the next chunk reloads the vector
+    // registers, the inner loop counter is reloaded on every pass
+    if (chunks > 1) {
+        kernel->kernel[pc] = jump_instruction(-pc, chunks - 1);
+        pc++;
+    }
+
+    for (i = 0; i < output_blocks; i++) {
+        kernel->kernel[pc++] = fill_instruction(accumulator_file(i));
+    }
+
+    finish_kernel(kernel, pc);
+    kernel->blocks = output_blocks;
     return 0;
 }
 
-int build_kernel_vmul_X1(Microkernel *kernel_vmul) {
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
+int build_kernel_gemv_variant(Microkernel *kernel, int row_blocks,
+                              int column_blocks, unsigned int chunks) {
+    return build_gemv(kernel, row_blocks, column_blocks, chunks, false);
+}
 
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
+size_t get_kernel_variants(const struct kernel_variant **variants) {
+    *variants = kernel_variants;
+    return ARRAY_SIZE(kernel_variants);
+}
 
-    instr1.type = MUL;
-    instr1.mul.src0.type = BANK;
-    instr1.mul.src1.type = GRF_A;
-    instr1.mul.src1.grfa.index = 0;
-    instr1.mul.dst.type = GRF_B;
-    instr1.mul.dst.grfb.index = 0;
-    instr1.mul.aam = false;
+const struct kernel_variant *find_kernel_variant(InstructionType opcode,
+                                                 bool scale_bank,
+                                                 int vector_length) {
+    for (size_t i = 0; i < ARRAY_SIZE(kernel_variants); i++) {
+        const struct kernel_variant *variant = &kernel_variants[i];
+
+        if (variant->opcode != opcode || variant->scale_bank != scale_bank) {
+            continue;
+        }
+        if (variant->blocks * KERNEL_BLOCK_ELEMENTS <= vector_length) {
+            return variant;
+        }
+    }
+    return NULL;
+}
 
-    instr2.type = FILL;
-    instr2.fill.src.type = GRF_B;
-    instr2.fill.src.grfb.index = 0;
-    instr2.fill.dst.type = BANK;
+int build_kernel_variant(Microkernel *kernel,
+                         const struct kernel_variant *variant) {
+    if (variant->scale_bank) {
+        return build_kernel_elementwise_scaled(kernel, variant->blocks);
+    }
+    return build_kernel_elementwise(kernel, variant->opcode, variant->blocks);
+}
 
-    instr3.type = EXIT;
+int build_kernel_vadd_X1(Microkernel *kernel_vadd) {
+    return build_kernel_elementwise(kernel_vadd, ADD, 1);
+}
 
-    instr4.type = NOP;
+int build_kernel_vadd_X2(Microkernel *kernel_vadd) {
+    return build_kernel_elementwise(kernel_vadd, ADD, 2);
+}
 
-    kernel_vmul->kernel[0] = instr0;
-    kernel_vmul->kernel[1] = instr1;
-    kernel_vmul->kernel[2] = instr2;
-    kernel_vmul->kernel[3] = instr3;
-    kernel_vmul->kernel[4] = instr4;
-    kernel_vmul->kernel[5] = instr4;
-    kernel_vmul->kernel[6] = instr4;
-    kernel_vmul->kernel[7] = instr4;
-    kernel_vmul->kernel[8] = instr4;
-    kernel_vmul->kernel[9] = instr4;
-    kernel_vmul->kernel[10] = instr4;
-    kernel_vmul->kernel[11] = instr4;
-    kernel_vmul->kernel[12] = instr4;
-    kernel_vmul->kernel[13] = instr4;
-    kernel_vmul->kernel[14] = instr4;
-    kernel_vmul->kernel[15] = instr4;
-    kernel_vmul->kernel[16] = instr4;
-    kernel_vmul->kernel[17] = instr4;
-    kernel_vmul->kernel[18] = instr4;
-    kernel_vmul->kernel[19] = instr4;
-    kernel_vmul->kernel[20] = instr4;
-    kernel_vmul->kernel[21] = instr4;
-    kernel_vmul->kernel[22] = instr4;
-    kernel_vmul->kernel[23] = instr4;
-    kernel_vmul->kernel[24] = instr4;
-    kernel_vmul->kernel[25] = instr4;
-    kernel_vmul->kernel[26] = instr4;
-    kernel_vmul->kernel[27] = instr4;
-    kernel_vmul->kernel[28] = instr4;
-    kernel_vmul->kernel[29] = instr4;
-    kernel_vmul->kernel[30] = instr4;
-    kernel_vmul->kernel[31] = instr4;
+int build_kernel_vadd_X3(Microkernel *kernel_vadd) {
+    return build_kernel_elementwise(kernel_vadd, ADD, 4);
+}
 
-    kernel_vmul->blocks = 1;
+int build_kernel_vadd_X4(Microkernel *kernel_vadd) {
+    return build_kernel_elementwise(kernel_vadd, ADD, 8);
+}
 
-    return 0;
+int build_kernel_vmul_X1(Microkernel *kernel_vmul) {
+    return build_kernel_elementwise(kernel_vmul, MUL, 1);
 }
 
 int build_kernel_vmul_X2(Microkernel *kernel_vmul) {
-
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
-    Instruction instr5;
-    Instruction instr6;
-    Instruction instr7;
-
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
-
-    instr1.type = MOV;
-    instr1.mov.src.type = BANK;
-    instr1.mov.dst.type = GRF_A;
-    instr1.mov.dst.grfa.index = 1;
-
-    instr2.type = MUL;
-    instr2.mul.src0.type = BANK;
-    instr2.mul.src1.type = GRF_A;
-    instr2.mul.src1.grfa.index = 0;
-    instr2.mul.dst.type = GRF_B;
-    instr2.mul.dst.grfb.index = 0;
-    instr2.mul.aam = false;
-
-    instr3.type = MUL;
-    instr3.mul.src0.type = BANK;
-    instr3.mul.src1.type = GRF_A;
-    instr3.mul.src1.grfa.index = 1;
-    instr3.mul.dst.type = GRF_B;
-    instr3.mul.dst.grfb.index = 1;
-    instr3.mul.aam = false;
-
-    instr4.type = FILL;
-    instr4.fill.src.type = GRF_B;
-    instr4.fill.src.grfb.index = 0;
-    instr4.fill.dst.type = BANK;
-
-    instr5.type = FILL;
-    instr5.fill.src.type = GRF_B;
-    instr5.fill.src.grfb.index = 1;
-    instr5.fill.dst.type = BANK;
-
-    instr6.type = EXIT;
-
-    instr7.type = NOP;
-
-    kernel_vmul->kernel[0] = instr0;
-    kernel_vmul->kernel[1] = instr1;
-    kernel_vmul->kernel[2] = instr2;
-    kernel_vmul->kernel[3] = instr3;
-    kernel_vmul->kernel[4] = instr4;
-    kernel_vmul->kernel[5] = instr5;
-    kernel_vmul->kernel[6] = instr6;
-    kernel_vmul->kernel[7] = instr7;
-    kernel_vmul->kernel[8] = instr7;
-    kernel_vmul->kernel[9] = instr7;
-    kernel_vmul->kernel[10] = instr7;
-    kernel_vmul->kernel[11] = instr7;
-    kernel_vmul->kernel[12] = instr7;
-    kernel_vmul->kernel[13] = instr7;
-    kernel_vmul->kernel[14] = instr7;
-    kernel_vmul->kernel[15] = instr7;
-    kernel_vmul->kernel[16] = instr7;
-    kernel_vmul->kernel[17] = instr7;
-    kernel_vmul->kernel[18] = instr7;
-    kernel_vmul->kernel[19] = instr7;
-    kernel_vmul->kernel[20] = instr7;
-    kernel_vmul->kernel[21] = instr7;
-    kernel_vmul->kernel[22] = instr7;
-    kernel_vmul->kernel[23] = instr7;
-    kernel_vmul->kernel[24] = instr7;
-    kernel_vmul->kernel[25] = instr7;
-    kernel_vmul->kernel[26] = instr7;
-    kernel_vmul->kernel[27] = instr7;
-    kernel_vmul->kernel[28] = instr7;
-    kernel_vmul->kernel[29] = instr7;
-    kernel_vmul->kernel[30] = instr7;
-    kernel_vmul->kernel[31] = instr7;
-
-    kernel_vmul->blocks = 2;
-    return 0;
+    return build_kernel_elementwise(kernel_vmul, MUL, 2);
 }
 
 int build_kernel_vmul_X3(Microkernel *kernel_vmul) {
-
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
-    Instruction instr5;
-    Instruction instr6;
-    Instruction instr7;
-    Instruction instr8;
-    Instruction instr9;
-    Instruction instr10;
-    Instruction instr11;
-    Instruction instr12;
-    Instruction instr13;
-
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
-
-    instr1.type = MOV;
-    instr1.mov.src.type = BANK;
-    instr1.mov.dst.type = GRF_A;
-    instr1.mov.dst.grfa.index = 1;
-
-    instr2.type = MOV;
-    instr2.mov.src.type = BANK;
-    instr2.mov.dst.type = GRF_A;
-    instr2.mov.dst.grfa.index = 2;
-
-    instr3.type = MOV;
-    instr3.mov.src.type = BANK;
-    instr3.mov.dst.type = GRF_A;
-    instr3.mov.dst.grfa.index = 3;
-
-    instr4.type = MUL;
-    instr4.mul.src0.type = BANK;
-    instr4.mul.src1.type = GRF_A;
-    instr4.mul.src1.grfa.index = 0;
-    instr4.mul.dst.type = GRF_B;
-    instr4.mul.dst.grfb.index = 0;
-    instr4.mul.aam = false;
-
-    instr5.type = MUL;
-    instr5.mul.src0.type = BANK;
-    instr5.mul.src1.type = GRF_A;
-    instr5.mul.src1.grfa.index = 1;
-    instr5.mul.dst.type = GRF_B;
-    instr5.mul.dst.grfb.index = 1;
-    instr5.mul.aam = false;
-
-    instr6.type = MUL;
-    instr6.mul.src0.type = BANK;
-    instr6.mul.src1.type = GRF_A;
-    instr6.mul.src1.grfa.index = 2;
-    instr6.mul.dst.type = GRF_B;
-    instr6.mul.dst.grfb.index = 2;
-    instr6.mul.aam = false;
-
-    instr7.type = MUL;
-    instr7.mul.src0.type = BANK;
-    instr7.mul.src1.type = GRF_A;
-    instr7.mul.src1.grfa.index = 3;
-    instr7.mul.dst.type = GRF_B;
-    instr7.mul.dst.grfb.index = 3;
-    instr7.mul.aam = false;
-
-    instr8.type = FILL;
-    instr8.fill.src.type = GRF_B;
-    instr8.fill.src.grfb.index = 0;
-    instr8.fill.dst.type = BANK;
-
-    instr9.type = FILL;
-    instr9.fill.src.type = GRF_B;
-    instr9.fill.src.grfb.index = 1;
-    instr9.fill.dst.type = BANK;
-
-    instr10.type = FILL;
-    instr10.fill.src.type = GRF_B;
-    instr10.fill.src.grfb.index = 2;
-    instr10.fill.dst.type = BANK;
-
-    instr11.type = FILL;
-    instr11.fill.src.type = GRF_B;
-    instr11.fill.src.grfb.index = 3;
-    instr11.fill.dst.type = BANK;
-
-    instr12.type = EXIT;
-
-    instr13.type = NOP;
-
-    kernel_vmul->kernel[0] = instr0;
-    kernel_vmul->kernel[1] = instr1;
-    kernel_vmul->kernel[2] = instr2;
-    kernel_vmul->kernel[3] = instr3;
-    kernel_vmul->kernel[4] = instr4;
-    kernel_vmul->kernel[5] = instr5;
-    kernel_vmul->kernel[6] = instr6;
-    kernel_vmul->kernel[7] = instr7;
-    kernel_vmul->kernel[8] = instr8;
-    kernel_vmul->kernel[9] = instr9;
-    kernel_vmul->kernel[10] = instr10;
-    kernel_vmul->kernel[11] = instr11;
-    kernel_vmul->kernel[12] = instr12;
-    kernel_vmul->kernel[13] = instr13;
-    kernel_vmul->kernel[14] = instr13;
-    kernel_vmul->kernel[15] = instr13;
-    kernel_vmul->kernel[16] = instr13;
-    kernel_vmul->kernel[17] = instr13;
-    kernel_vmul->kernel[18] = instr13;
-    kernel_vmul->kernel[19] = instr13;
-    kernel_vmul->kernel[20] = instr13;
-    kernel_vmul->kernel[21] = instr13;
-    kernel_vmul->kernel[22] = instr13;
-    kernel_vmul->kernel[23] = instr13;
-    kernel_vmul->kernel[24] = instr13;
-    kernel_vmul->kernel[25] = instr13;
-    kernel_vmul->kernel[26] = instr13;
-    kernel_vmul->kernel[27] = instr13;
-    kernel_vmul->kernel[28] = instr13;
-    kernel_vmul->kernel[29] = instr13;
-    kernel_vmul->kernel[30] = instr13;
-    kernel_vmul->kernel[31] = instr13;
-
-    kernel_vmul->blocks = 4;
-    return 0;
+    return build_kernel_elementwise(kernel_vmul, MUL, 4);
 }
 
 int build_kernel_vmul_X4(Microkernel *kernel_vmul) {
-
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
-    Instruction instr5;
-    Instruction instr6;
-    Instruction instr7;
-    Instruction instr8;
-    Instruction instr9;
-    Instruction instr10;
-    Instruction instr11;
-    Instruction instr12;
-    Instruction instr13;
-    Instruction instr14;
-    Instruction instr15;
-    Instruction instr16;
-    Instruction instr17;
-    Instruction instr18;
-    Instruction instr19;
-    Instruction instr20;
-    Instruction instr21;
-    Instruction instr22;
-    Instruction instr23;
-    Instruction instr24;
-    Instruction instr25;
-
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
-
-    instr1.type = MOV;
-    instr1.mov.src.type = BANK;
-    instr1.mov.dst.type = GRF_A;
-    instr1.mov.dst.grfa.index = 1;
-
-    instr2.type = MOV;
-    instr2.mov.src.type = BANK;
-    instr2.mov.dst.type = GRF_A;
-    instr2.mov.dst.grfa.index = 2;
-
-    instr3.type = MOV;
-    instr3.mov.src.type = BANK;
-    instr3.mov.dst.type = GRF_A;
-    instr3.mov.dst.grfa.index = 3;
-
-    instr4.type = MOV;
-    instr4.mov.src.type = BANK;
-    instr4.mov.dst.type = GRF_A;
-    instr4.mov.dst.grfa.index = 4;
-
-    instr5.type = MOV;
-    instr5.mov.src.type = BANK;
-    instr5.mov.dst.type = GRF_A;
-    instr5.mov.dst.grfa.index = 5;
-
-    instr6.type = MOV;
-    instr6.mov.src.type = BANK;
-    instr6.mov.dst.type = GRF_A;
-    instr6.mov.dst.grfa.index = 6;
-
-    instr7.type = MOV;
-    instr7.mov.src.type = BANK;
-    instr7.mov.dst.type = GRF_A;
-    instr7.mov.dst.grfa.index = 7;
-
-    instr8.type = MUL;
-    instr8.mul.src0.type = BANK;
-    instr8.mul.src1.type = GRF_A;
-    instr8.mul.src1.grfa.index = 0;
-    instr8.mul.dst.type = GRF_B;
-    instr8.mul.dst.grfb.index = 0;
-    instr8.mul.aam = false;
-
-    instr9.type = MUL;
-    instr9.mul.src0.type = BANK;
-    instr9.mul.src1.type = GRF_A;
-    instr9.mul.src1.grfa.index = 1;
-    instr9.mul.dst.type = GRF_B;
-    instr9.mul.dst.grfb.index = 1;
-    instr9.mul.aam = false;
-
-    instr10.type = MUL;
-    instr10.mul.src0.type = BANK;
-    instr10.mul.src1.type = GRF_A;
-    instr10.mul.src1.grfa.index = 2;
-    instr10.mul.dst.type = GRF_B;
-    instr10.mul.dst.grfb.index = 2;
-    instr10.mul.aam = false;
-
-    instr11.type = MUL;
-    instr11.mul.src0.type = BANK;
-    instr11.mul.src1.type = GRF_A;
-    instr11.mul.src1.grfa.index = 3;
-    instr11.mul.dst.type = GRF_B;
-    instr11.mul.dst.grfb.index = 3;
-    instr11.mul.aam = false;
-
-    instr12.type = MUL;
-    instr12.mul.src0.type = BANK;
-    instr12.mul.src1.type = GRF_A;
-    instr12.mul.src1.grfa.index = 4;
-    instr12.mul.dst.type = GRF_B;
-    instr12.mul.dst.grfb.index = 4;
-    instr12.mul.aam = false;
-
-    instr13.type = MUL;
-    instr13.mul.src0.type = BANK;
-    instr13.mul.src1.type = GRF_A;
-    instr13.mul.src1.grfa.index = 5;
-    instr13.mul.dst.type = GRF_B;
-    instr13.mul.dst.grfb.index = 5;
-    instr13.mul.aam = false;
-
-    instr14.type = MUL;
-    instr14.mul.src0.type = BANK;
-    instr14.mul.src1.type = GRF_A;
-    instr14.mul.src1.grfa.index = 6;
-    instr14.mul.dst.type = GRF_B;
-    instr14.mul.dst.grfb.index = 6;
-    instr14.mul.aam = false;
-
-    instr15.type = MUL;
-    instr15.mul.src0.type = BANK;
-    instr15.mul.src1.type = GRF_A;
-    instr15.mul.src1.grfa.index = 7;
-    instr15.mul.dst.type = GRF_B;
-    instr15.mul.dst.grfb.index = 7;
-    instr15.mul.aam = false;
-
-    instr16.type = FILL;
-    instr16.fill.src.type = GRF_B;
-    instr16.fill.src.grfb.index = 0;
-    instr16.fill.dst.type = BANK;
-
-    instr17.type = FILL;
-    instr17.fill.src.type = GRF_B;
-    instr17.fill.src.grfb.index = 1;
-    instr17.fill.dst.type = BANK;
-
-    instr18.type = FILL;
-    instr18.fill.src.type = GRF_B;
-    instr18.fill.src.grfb.index = 2;
-    instr18.fill.dst.type = BANK;
-
-    instr19.type = FILL;
-    instr19.fill.src.type = GRF_B;
-    instr19.fill.src.grfb.index = 3;
-    instr19.fill.dst.type = BANK;
-
-    instr20.type = FILL;
-    instr20.fill.src.type = GRF_B;
-    instr20.fill.src.grfb.index = 4;
-    instr20.fill.dst.type = BANK;
-
-    instr21.type = FILL;
-    instr21.fill.src.type = GRF_B;
-    instr21.fill.src.grfb.index = 5;
-    instr21.fill.dst.type = BANK;
-
-    instr22.type = FILL;
-    instr22.fill.src.type = GRF_B;
-    instr22.fill.src.grfb.index = 6;
-    instr22.fill.dst.type = BANK;
-
-    instr23.type = FILL;
-    instr23.fill.src.type = GRF_B;
-    instr23.fill.src.grfb.index = 7;
-    instr23.fill.dst.type = BANK;
-
-    instr24.type = EXIT;
-
-    instr25.type = NOP;
-
-    kernel_vmul->kernel[0] = instr0;
-    kernel_vmul->kernel[1] = instr1;
-    kernel_vmul->kernel[2] = instr2;
-    kernel_vmul->kernel[3] = instr3;
-    kernel_vmul->kernel[4] = instr4;
-    kernel_vmul->kernel[5] = instr5;
-    kernel_vmul->kernel[6] = instr6;
-    kernel_vmul->kernel[7] = instr7;
-    kernel_vmul->kernel[8] = instr8;
-    kernel_vmul->kernel[9] = instr9;
-    kernel_vmul->kernel[10] = instr10;
-    kernel_vmul->kernel[11] = instr11;
-    kernel_vmul->kernel[12] = instr12;
-    kernel_vmul->kernel[13] = instr13;
-    kernel_vmul->kernel[14] = instr14;
-    kernel_vmul->kernel[15] = instr15;
-    kernel_vmul->kernel[16] = instr16;
-    kernel_vmul->kernel[17] = instr17;
-    kernel_vmul->kernel[18] = instr18;
-    kernel_vmul->kernel[19] = instr19;
-    kernel_vmul->kernel[20] = instr20;
-    kernel_vmul->kernel[21] = instr21;
-    kernel_vmul->kernel[22] = instr22;
-    kernel_vmul->kernel[23] = instr23;
-    kernel_vmul->kernel[24] = instr24;
-    kernel_vmul->kernel[25] = instr25;
-    kernel_vmul->kernel[26] = instr25;
-    kernel_vmul->kernel[27] = instr25;
-    kernel_vmul->kernel[28] = instr25;
-    kernel_vmul->kernel[29] = instr25;
-    kernel_vmul->kernel[30] = instr25;
-    kernel_vmul->kernel[31] = instr25;
-
-    kernel_vmul->blocks = 8;
-    return 0;
+    return build_kernel_elementwise(kernel_vmul, MUL, 8);
 }
 
 /*
@@ -1008,157 +370,17 @@ int build_kernel_vmul_X4(Microkernel *kernel_vmul) {
  * suitable for orchestrating the PIM-VM in its current state.
  */
 int build_kernel_gemv(Microkernel *kernel_gemv) {
-    Instruction instr0;
-    Instruction instr1;
-    Instruction instr2;
-    Instruction instr3;
-    Instruction instr4;
-    Instruction instr5;
-    Instruction instr6;
-    Instruction instr7;
-    Instruction instr8;
-    Instruction instr9;
-    Instruction instr10;
-    Instruction instr11;
-    Instruction instr12;
-    Instruction instr13;
-    Instruction instr14;
-    Instruction instr15;
-    Instruction instr16;
-    Instruction instr17;
-    Instruction instr18;
-    Instruction instr19;
-
-    instr0.type = MOV;
-    instr0.mov.src.type = BANK;
-    instr0.mov.dst.type = GRF_A;
-    instr0.mov.dst.grfa.index = 0;
-
-    instr1.type = MOV;
-    instr1.mov.src.type = BANK;
-    instr1.mov.dst.type = GRF_A;
-    instr1.mov.dst.grfa.index = 1;
-
-    instr2.type = MOV;
-    instr2.mov.src.type = BANK;
-    instr2.mov.dst.type = GRF_A;
-    instr2.mov.dst.grfa.index = 2;
-
-    instr3.type = MOV;
-    instr3.mov.src.type = BANK;
-    instr3.mov.dst.type = GRF_A;
-    instr3.mov.dst.grfa.index = 3;
-
-    instr4.type = MOV;
-    instr4.mov.src.type = BANK;
-    instr4.mov.dst.type = GRF_A;
-    instr4.mov.dst.grfa.index = 4;
-
-    instr5.type = MOV;
-    instr5.mov.src.type = BANK;
-    instr5.mov.dst.type = GRF_A;
-    instr5.mov.dst.grfa.index = 5;
-
-    instr6.type = MOV;
-    instr6.mov.src.type = BANK;
-    instr6.mov.dst.type = GRF_A;
-    instr6.mov.dst.grfa.index = 6;
-
-    instr7.type = MOV;
-    instr7.mov.src.type = BANK;
-    instr7.mov.dst.type = GRF_A;
-    instr7.mov.dst.grfa.index = 7;
-
-    instr8.type = MAC;
-    instr8.mac.src0.type = BANK;
-    instr8.mac.src1.type = GRF_A;
-    instr8.mac.src1.grfa.index = 0;
-    instr8.mac.src2.type = GRF_B;
-    instr8.mac.src2.grfb.index = 0;
-    instr8.mac.dst.type = GRF_B;
-    instr8.mac.dst.grfb.index = 0;
-    instr8.mac.aam = true;
-
-    instr9.type = JUMP;
-    instr9.jump.offset = -1;
-    instr9.jump.count = 63;
-
-    instr10.type = FILL;
-    instr10.fill.src.type = GRF_B;
-    instr10.fill.src.grfb.index = 0;
-    instr10.fill.dst.type = BANK;
-
-    instr11.type = FILL;
-    instr11.fill.src.type = GRF_B;
-    instr11.fill.src.grfb.index = 1;
-    instr11.fill.dst.type = BANK;
-
-    instr12.type = FILL;
-    instr12.fill.src.type = GRF_B;
-    instr12.fill.src.grfb.index = 2;
-    instr12.fill.dst.type = BANK;
-
-    instr13.type = FILL;
-    instr13.fill.src.type = GRF_B;
-    instr13.fill.src.grfb.index = 3;
-    instr13.fill.dst.type = BANK;
-
-    instr14.type = FILL;
-    instr14.fill.src.type = GRF_B;
-    instr14.fill.src.grfb.index = 4;
-    instr14.fill.dst.type = BANK;
-
-    instr15.type = FILL;
-    instr15.fill.src.type = GRF_B;
-    instr15.fill.src.grfb.index = 5;
-    instr15.fill.dst.type = BANK;
-
-    instr16.type = FILL;
-    instr16.fill.src.type = GRF_B;
-    instr16.fill.src.grfb.index = 6;
-    instr16.fill.dst.type = BANK;
-
-    instr17.type = FILL;
-    instr17.fill.src.type = GRF_B;
-    instr17.fill.src.grfb.index = 7;
-    instr17.fill.dst.type = BANK;
-
-    instr18.type = EXIT;
-
-    instr19.type = NOP;
+    return build_kernel_gemv_variant(kernel_gemv, GRF_REGISTERS,
+                                     GRF_REGISTERS, 1);
+}
 
-    kernel_gemv->kernel[0] = instr0;
-    kernel_gemv->kernel[1] = instr1;
-    kernel_gemv->kernel[2] = instr2;
-    kernel_gemv->kernel[3] = instr3;
-    kernel_gemv->kernel[4] = instr4;
-    kernel_gemv->kernel[5] = instr5;
-    kernel_gemv->kernel[6] = instr6;
-    kernel_gemv->kernel[7] = instr7;
-    kernel_gemv->kernel[8] = instr8;
-    kernel_gemv->kernel[9] = instr9;
-    kernel_gemv->kernel[10] = instr10;
-    kernel_gemv->kernel[11] = instr11;
-    kernel_gemv->kernel[12] = instr12;
-    kernel_gemv->kernel[13] = instr13;
-    kernel_gemv->kernel[14] = instr14;
-    kernel_gemv->kernel[15] = instr15;
-    kernel_gemv->kernel[16] = instr16;
-    kernel_gemv->kernel[17] = instr17;
-    kernel_gemv->kernel[18] = instr18;
-    kernel_gemv->kernel[19] = instr19;
-    kernel_gemv->kernel[20] = instr19;
-    kernel_gemv->kernel[21] = instr19;
-    kernel_gemv->kernel[22] = instr19;
-    kernel_gemv->kernel[23] = instr19;
-    kernel_gemv->kernel[24] = instr19;
-    kernel_gemv->kernel[25] = instr19;
-    kernel_gemv->kernel[26] = instr19;
-    kernel_gemv->kernel[27] = instr19;
-    kernel_gemv->kernel[28] = instr19;
-    kernel_gemv->kernel[29] = instr19;
-    kernel_gemv->kernel[30] = instr19;
-    kernel_gemv->kernel[31] = instr19;
+int build_kernel_gemv_chunks(Microkernel *kernel_gemv, unsigned int chunks) {
+    return build_kernel_gemv_variant(kernel_gemv, GRF_REGISTERS,
+                                     GRF_REGISTERS, chunks);
+}
 
-    return 0;
-}
\ No newline at end of file
+int build_kernel_gemv_transposed(Microkernel *kernel_gemv,
+                                 unsigned int chunks) {
+    return build_gemv(kernel_gemv, GRF_REGISTERS, GRF_REGISTERS, chunks,
+                      true);
+}
@@ -17,6 +17,7 @@
 #include "../include/bins.h"
 #include "../include/pim_data_allocator.h"
 #include "../include/pim_memory_region.h"
+#include "../include/pim_vm.h"
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Tom Kostler");
@@ -27,11 +28,27 @@ MODULE_DESCRIPTION("Kernel-Module acting as a driver for PIM-Functionality");
 #define IOCTL_VADD _IOWR(MAJOR_NUM, 2, struct pim_vectors)
 #define IOCTL_VMUL _IOWR(MAJOR_NUM, 3, struct pim_vectors)
 #define IOCTL_GEMV _IOWR(MAJOR_NUM, 4, struct pim_gemv)
+#define IOCTL_ELEMENTWISE _IOWR(MAJOR_NUM, 5, struct pim_elementwise)
+#define IOCTL_EXPRESSION _IOW(MAJOR_NUM, 6, struct pim_expression)
+#define IOCTL_ELEMENTWISE_VIEW _IOW(MAJOR_NUM, 7, struct pim_elementwise_view)
+#define IOCTL_GEMV_FUSED _IOW(MAJOR_NUM, 8, struct pim_gemv_fused)
+#define IOCTL_GEMV_TRANSPOSED _IOW(MAJOR_NUM, 9, struct pim_gemv_fused)
 
 #define MAX_VECTOR_ELEMENTS (1 << 21)
 
 volatile u32 __iomem *pim_data_virt_addr = NULL;
 volatile u8 __iomem *pim_config_virt_addr = NULL;
+size_t pim_data_region_size = PIM_DATA_MEMORY_REGION_SIZE;
+struct pim_vm *pim_emulator = NULL;
+
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Run kernels on the reference PIM-VM model instead "
+                          "of the device");
+
+static unsigned int emulate_size_mb = 64;
+module_param(emulate_size_mb, uint, 0444);
+MODULE_PARM_DESC(emulate_size_mb, "Size of the emulated data region in MiB");
 
 static int get_gemv_inputs(unsigned long arg, uint16_t **vector_out,
                            uint32_t *vector_len_out, uint16_t **matrix_out,
@@ -56,8 +73,8 @@ static int get_gemv_inputs(unsigned long arg, uint16_t **vector_out,
     }
 
     kernel_vector = vmalloc(descriptor.input_vector_len * sizeof(uint16_t));
-    kernel_matrix = vmalloc(descriptor.matrix_dim1 *
-                            descriptor.input_vector_len * sizeof(uint16_t));
+    kernel_matrix = vmalloc((size_t)descriptor.matrix_dim1 *
+                            descriptor.matrix_dim2 * sizeof(uint16_t));
 
     if (!kernel_vector || !kernel_matrix) {
         vfree(kernel_vector);
@@ -73,7 +90,7 @@ static int get_gemv_inputs(unsigned long arg, uint16_t **vector_out,
     }
     if (copy_from_user(kernel_matrix,
                        (void __user *)descriptor.matrix_user_addr,
-                       descriptor.matrix_dim1 * descriptor.input_vector_len *
+                       (size_t)descriptor.matrix_dim1 * descriptor.matrix_dim2 *
                            sizeof(uint16_t))) {
         goto error_cleanup;
     }
@@ -94,19 +111,19 @@ error_cleanup:
 
 static long pim_device_ioctl(struct file *file, unsigned int cmd,
                              unsigned long arg) {
-    uint16_t *kernel_vector_a = NULL;
-    uint16_t *kernel_vector_b = NULL;
-
     uint16_t *kernel_input_vector = NULL;
     uint16_t *kernel_matrix = NULL;
+    uint16_t *kernel_bias = NULL;
     uint32_t len_input_vector;
     uint32_t matrix_dim1;
     uint32_t matrix_dim2;
+    uint32_t outputs;
 
     struct pim_vectors vectors_descriptor;
-    struct pim_gemv gemv_descriptor;
-
-    size_t vector_size_bytes;
+    struct pim_elementwise elementwise_descriptor;
+    struct pim_expression expression_descriptor;
+    struct pim_elementwise_view view_descriptor;
+    struct pim_gemv_fused gemv_descriptor;
 
     int ret;
 
@@ -122,46 +139,144 @@ static long pim_device_ioctl(struct file *file, unsigned int cmd,
             return -EFAULT;
         }
 
-        vector_size_bytes = vectors_descriptor.len * sizeof(uint16_t);
         if (vectors_descriptor.len == 0 ||
             vectors_descriptor.len > MAX_VECTOR_ELEMENTS) {
             return -EINVAL;
         }
 
-        kernel_vector_a = (uint16_t *)((char *)pim_data_virt_addr +
-                                       vectors_descriptor.offset_a);
-        kernel_vector_b = (uint16_t *)((char *)pim_data_virt_addr +
-                                       vectors_descriptor.offset_b);
-
-        if (cmd == IOCTL_VADD) {
-            ret = vadd_from_userspace(kernel_vector_a, kernel_vector_b,
-                                      &vectors_descriptor);
-        } else {
-            ret = vmul_from_userspace(kernel_vector_a, kernel_vector_b,
-                                      &vectors_descriptor);
+        memset(&elementwise_descriptor, 0, sizeof(elementwise_descriptor));
+        elementwise_descriptor.offset_a = vectors_descriptor.offset_a;
+        elementwise_descriptor.offset_b = vectors_descriptor.offset_b;
+        elementwise_descriptor.result_offset = vectors_descriptor.result_offset;
+        elementwise_descriptor.len = vectors_descriptor.len;
+        elementwise_descriptor.op =
+            cmd == IOCTL_VADD ? PIM_OP_ADD : PIM_OP_MUL;
+
+        ret = elementwise_from_userspace(&elementwise_descriptor);
+        if (ret) {
+            return ret;
+        }
+
+        break;
+    }
+
+    case IOCTL_ELEMENTWISE: {
+        if (copy_from_user(&elementwise_descriptor,
+                           (struct pim_elementwise __user *)arg,
+                           sizeof(elementwise_descriptor))) {
+            return -EFAULT;
+        }
+
+        if (elementwise_descriptor.len == 0 ||
+            elementwise_descriptor.len > MAX_VECTOR_ELEMENTS) {
+            return -EINVAL;
+        }
+
+        ret = elementwise_from_userspace(&elementwise_descriptor);
+        if (ret) {
+            return ret;
+        }
+
+        if (copy_to_user((struct pim_elementwise __user *)arg,
+                         &elementwise_descriptor,
+                         sizeof(elementwise_descriptor))) {
+            return -EFAULT;
+        }
+
+        break;
+    }
+
+    case IOCTL_ELEMENTWISE_VIEW: {
+        if (copy_from_user(&view_descriptor,
+                           (struct pim_elementwise_view __user *)arg,
+                           sizeof(view_descriptor))) {
+            return -EFAULT;
+        }
+
+        if ((uint64_t)view_descriptor.rows * view_descriptor.cols == 0 ||
+            (uint64_t)view_descriptor.rows * view_descriptor.cols >
+                MAX_VECTOR_ELEMENTS) {
+            return -EINVAL;
+        }
+
+        ret = elementwise_view_from_userspace(&view_descriptor);
+        if (ret) {
+            return ret;
+        }
+
+        break;
+    }
+
+    case IOCTL_EXPRESSION: {
+        if (copy_from_user(&expression_descriptor,
+                           (struct pim_expression __user *)arg,
+                           sizeof(expression_descriptor))) {
+            return -EFAULT;
+        }
+
+        if (expression_descriptor.len == 0 ||
+            expression_descriptor.len > MAX_VECTOR_ELEMENTS) {
+            return -EINVAL;
+        }
+
+        ret = expression_from_userspace(&expression_descriptor);
+        if (ret) {
+            return ret;
         }
 
         break;
     }
 
-    case IOCTL_GEMV: {
-        if (copy_from_user(&gemv_descriptor, (struct pim_gemv __user *)arg,
-                           sizeof(gemv_descriptor))) {
+    case IOCTL_GEMV:
+    case IOCTL_GEMV_FUSED:
+    case IOCTL_GEMV_TRANSPOSED: {
+        // A plain GEMV runs with an empty epilogue
+        memset(&gemv_descriptor, 0, sizeof(gemv_descriptor));
+        if (copy_from_user(&gemv_descriptor, (void __user *)arg,
+                           cmd == IOCTL_GEMV ? sizeof(struct pim_gemv)
+                                             : sizeof(gemv_descriptor))) {
             return -EFAULT;
         }
 
+        if (gemv_descriptor.epilogue.flags & ~PIM_EPILOGUE_ALL) {
+            pr_err("PIM: Unknown GEMV epilogue flags\n");
+            return -EINVAL;
+        }
+
         ret = get_gemv_inputs(arg, &kernel_input_vector, &len_input_vector,
                               &kernel_matrix, &matrix_dim1, &matrix_dim2);
         if (ret) {
             return ret;
         }
 
-        ret = gemv_from_userspace(gemv_descriptor.result_vector_user_addr,
-                                  kernel_input_vector, kernel_matrix,
-                                  len_input_vector, matrix_dim1, matrix_dim2);
+        // A^T x has one result per column
+        outputs = cmd == IOCTL_GEMV_TRANSPOSED ? matrix_dim2 : matrix_dim1;
+
+        if (gemv_descriptor.epilogue.flags & PIM_EPILOGUE_BIAS) {
+            kernel_bias = vmalloc(outputs * sizeof(uint16_t));
+            if (!kernel_bias) {
+                ret = -ENOMEM;
+            } else if (copy_from_user(
+                           kernel_bias,
+                           (void __user *)gemv_descriptor.epilogue
+                               .bias_user_addr,
+                           outputs * sizeof(uint16_t))) {
+                pr_err("PIM: Failed to copy GEMV bias\n");
+                ret = -EFAULT;
+            }
+        }
+
+        if (!ret) {
+            ret = gemv_from_userspace(
+                gemv_descriptor.gemv.result_vector_user_addr,
+                kernel_input_vector, kernel_matrix, len_input_vector,
+                matrix_dim1, matrix_dim2, cmd == IOCTL_GEMV_TRANSPOSED,
+                &gemv_descriptor.epilogue, kernel_bias);
+        }
 
         vfree(kernel_input_vector);
         vfree(kernel_matrix);
+        vfree(kernel_bias);
 
         if (ret) {
             return ret;
@@ -180,11 +295,19 @@ static int pim_mmap(struct file *filp, struct vm_area_struct *vma) {
     unsigned long size = vma->vm_end - vma->vm_start;
     unsigned long pfn;
 
-    if (size > PIM_DATA_MEMORY_REGION_SIZE) {
+    if (size > pim_data_region_size) {
         pr_err("PIM: mmap requested size is too large.\n");
         return -EINVAL;
     }
 
+    if (pim_emulator) {
+        if (remap_vmalloc_range(vma, (void *)pim_data_virt_addr, 0)) {
+            pr_err("PIM: remap_vmalloc_range failed\n");
+            return -EAGAIN;
+        }
+        return 0;
+    }
+
     pfn = PIM_DATA_MEMORY_REGION_BASE >> PAGE_SHIFT;
 
     vma->vm_flags |= VM_IO | VM_DONTEXPAND | VM_DONTDUMP;
@@ -203,6 +326,48 @@ static int pim_mmap(struct file *filp, struct vm_area_struct *vma) {
 static struct file_operations fops = {
     .owner = THIS_MODULE, .unlocked_ioctl = pim_device_ioctl, .mmap = pim_mmap};
 
+/**
+ * Sets up the reference PIM-VM model with vmalloc'ed regions in place of the
+ * ioremapped device regions.
+ */
+static int pim_emulator_init(void) {
+    size_t data_size = (size_t)emulate_size_mb << 20;
+
+    if (data_size == 0 || data_size > PIM_DATA_MEMORY_REGION_SIZE) {
+        pr_err("PIM: invalid emulated region size %u MiB\n", emulate_size_mb);
+        return -EINVAL;
+    }
+
+    pim_emulator = vzalloc(sizeof(*pim_emulator));
+    pim_config_virt_addr = vzalloc(PIM_CONFIG_MEMORY_REGION_SIZE);
+    pim_data_virt_addr = vmalloc_user(data_size);
+    if (!pim_emulator || !pim_config_virt_addr || !pim_data_virt_addr) {
+        vfree(pim_emulator);
+        vfree((void *)pim_config_virt_addr);
+        vfree((void *)pim_data_virt_addr);
+        pim_emulator = NULL;
+        pim_config_virt_addr = NULL;
+        pim_data_virt_addr = NULL;
+        return -ENOMEM;
+    }
+
+    pim_vm_init(pim_emulator, (void *)pim_data_virt_addr, data_size,
+                PIM_DATA_MEMORY_REGION_BASE);
+    pim_data_region_size = data_size;
+
+    pr_info("PIM: Emulating a %u MiB data region\n", emulate_size_mb);
+    return 0;
+}
+
+static void pim_emulator_exit(void) {
+    vfree((void *)pim_data_virt_addr);
+    vfree((void *)pim_config_virt_addr);
+    vfree(pim_emulator);
+    pim_data_virt_addr = NULL;
+    pim_config_virt_addr = NULL;
+    pim_emulator = NULL;
+}
+
 static int __init pim_bridge_init(void) {
     int major_number;
     pr_warn("Loading PIM-Bridge kernel module\n");
@@ -215,6 +380,22 @@ static int __init pim_bridge_init(void) {
     pr_info("Module loaded. Create a device file with:\n");
     pr_info("mknod /dev/%s c %d 0\n", DEVICE_NAME, MAJOR_NUM);
 
+    if (emulate) {
+        int ret = pim_emulator_init();
+
+        if (!ret) {
+            ret = pim_scratch_init();
+            if (ret) {
+                pim_emulator_exit();
+            }
+        }
+        if (ret) {
+            unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
+            return ret;
+        }
+        return 0;
+    }
+
     pim_config_virt_addr =
         ioremap(PIM_CONFIG_MEMORY_REGION_BASE, PIM_CONFIG_MEMORY_REGION_SIZE);
     pim_data_virt_addr =
@@ -233,14 +414,21 @@ static int __init pim_bridge_init(void) {
         return -ENOMEM;
     }
 
+    if (pim_scratch_init()) {
+        iounmap(pim_data_virt_addr);
+        iounmap(pim_config_virt_addr);
+        unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
+        return -EINVAL;
+    }
+
     pr_info("Initialized PIM-Region starting at: %px\n", pim_data_virt_addr);
 
     // This code triggers the PIM-VM without needing a call from the User
     // Library (only works for the CPU Model O3 in gem5-Simulation)
     // current_start_free_mem_offset = 0;
-    // vadd_driver_code();
+    // elementwise_driver_code(PIM_OP_ADD);
     // current_start_free_mem_offset = 0;
-    // vmul_driver_code();
+    // elementwise_driver_code(PIM_OP_MUL);
     // current_start_free_mem_offset = 0;
     // gemv_driver_code();
 
@@ -249,6 +437,13 @@ static int __init pim_bridge_init(void) {
 
 static void __exit pim_bridge_exit(void) {
     unregister_chrdev(MAJOR_NUM, DEVICE_NAME);
+    elementwise_release_programs();
+
+    if (pim_emulator) {
+        pim_emulator_exit();
+        pr_info("Unloading PIM-Bridge kernel module\n");
+        return;
+    }
 
     if (pim_data_virt_addr)
         iounmap(pim_data_virt_addr);
@@ -2,6 +2,7 @@
 #include "../include/pim_memory_region.h"
 
 size_t current_start_free_mem_offset = 0;
+size_t pim_scratch_offset = 0;
 
 void __iomem *pim_data_region_alloc(size_t size, size_t alignment) {
     void __iomem *addr;
@@ -14,7 +15,7 @@ void __iomem *pim_data_region_alloc(size_t size, size_t alignment) {
 
     unsigned long offset = aligned_phys_addr - phys_base_addr;
 
-    if (offset + size > PIM_DATA_MEMORY_REGION_SIZE) {
+    if (current_start_free_mem_offset + offset + size > pim_scratch_offset) {
         pr_err("PIM allocator out of memory\n");
         return NULL;
     }
@@ -28,7 +29,34 @@ void __iomem *pim_data_region_alloc(size_t size, size_t alignment) {
 void __iomem *init_dummy_memory_region(void) {
     uint32_t __iomem *dummy_addr =
         pim_data_region_alloc(sizeof(uint16_t), PIM_VECTOR_ALIGNMENT);
+
+    if (!dummy_addr) {
+        return NULL;
+    }
     iowrite16(0x0000, dummy_addr);
 
     return dummy_addr;
-}
\ No newline at end of file
+}
+
+int pim_scratch_init(void) {
+    if (pim_data_region_size < 2 * PIM_SCRATCH_BYTES) {
+        pr_err("PIM: data region too small for the scratch area\n");
+        return -EINVAL;
+    }
+    pim_scratch_offset = pim_data_region_size - PIM_SCRATCH_BYTES;
+    memset_io((u8 __iomem *)pim_data_virt_addr + pim_scratch_offset, 0,
+              PIM_SCRATCH_BYTES);
+    return 0;
+}
+
+void __iomem *pim_scratch_block(enum pim_scratch_block block) {
+    return (u8 __iomem *)pim_data_virt_addr + pim_scratch_offset +
+           (size_t)block * PIM_VECTOR_ALIGNMENT;
+}
+
+void __iomem *pim_scratch_dummy(void) {
+    void __iomem *dummy_addr = pim_scratch_block(PIM_SCRATCH_DUMMY);
+
+    iowrite16(0x0000, dummy_addr);
+    return dummy_addr;
+}
@@ -0,0 +1,166 @@
+#include "../include/pim_f16.h"
+
+#define F16_MANTISSA_BITS 10
+#define F16_EXPONENT_BIAS 15
+// Exponent of the least significant bit of a subnormal f16
+#define F16_MIN_EXPONENT (-24)
+
+static bool f16_is_nan(uint16_t value) {
+    return (value & 0x7C00) == 0x7C00 && (value & 0x03FF);
+}
+
+static bool f16_is_inf(uint16_t value) {
+    return (value & 0x7FFF) == F16_INFINITY;
+}
+
+/**
+ * Splits a finite f16 into its integer significand and the exponent of its
+ * least significant bit, so that |value| = significand * 2^exponent.
+ */
+static uint32_t f16_unpack(uint16_t value, int *exponent) {
+    uint32_t biased = (value >> F16_MANTISSA_BITS) & 0x1F;
+    uint32_t mantissa = value & 0x03FF;
+
+    if (biased == 0) {
+        *exponent = F16_MIN_EXPONENT;
+        return mantissa;
+    }
+    *exponent = (int)biased - F16_EXPONENT_BIAS - F16_MANTISSA_BITS;
+    return mantissa | (1 << F16_MANTISSA_BITS);
+}
+
+static int msb_position(uint64_t value) {
+    int position = 0;
+
+    while (value >>= 1) {
+        position++;
+    }
+    return position;
+}
+
+/**
+ * Shifts right with round to nearest, ties to even.
+ */
+static uint64_t shift_right_round(uint64_t value, int shift) {
+    uint64_t halfway;
+    uint64_t remainder;
+    uint64_t result;
+
+    if (shift <= 0) {
+        return value << -shift;
+    }
+    if (shift > 63) {
+        return 0;
+    }
+
+    result = value >> shift;
+    remainder = value & ((1ULL << shift) - 1);
+    halfway = 1ULL << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (result & 1))) {
+        result++;
+    }
+    return result;
+}
+
+uint16_t f16_round(bool negative, uint64_t magnitude, int exponent) {
+    uint16_t sign = negative ? F16_SIGN_MASK : 0;
+    uint64_t significand;
+    int value_exponent;
+    int msb;
+
+    if (magnitude == 0) {
+        return sign;
+    }
+
+    msb = msb_position(magnitude);
+    value_exponent = msb + exponent;
+
+    if (value_exponent < 1 - F16_EXPONENT_BIAS) {
+        // Subnormal range, quantize to multiples of 2^-24
+        significand =
+            shift_right_round(magnitude, F16_MIN_EXPONENT - exponent);
+        // Rounding up may produce the smallest normal number, which has the
+        // same encoding as the carry into the exponent field
+        return sign | (uint16_t)significand;
+    }
+
+    significand = shift_right_round(magnitude, msb - F16_MANTISSA_BITS);
+    if (significand >> (F16_MANTISSA_BITS + 1)) {
+        significand >>= 1;
+        value_exponent++;
+    }
+    if (value_exponent > F16_EXPONENT_BIAS) {
+        return sign | F16_INFINITY;
+    }
+
+    return sign |
+           (uint16_t)((value_exponent + F16_EXPONENT_BIAS)
+                      << F16_MANTISSA_BITS) |
+           (uint16_t)(significand & 0x03FF);
+}
+
+uint16_t f16_add(uint16_t a, uint16_t b) {
+    int exponent_a;
+    int exponent_b;
+    int exponent;
+    int64_t value_a;
+    int64_t value_b;
+    int64_t sum;
+
+    if (f16_is_nan(a) || f16_is_nan(b)) {
+        return F16_QUIET_NAN;
+    }
+    if (f16_is_inf(a) || f16_is_inf(b)) {
+        if (f16_is_inf(a) && f16_is_inf(b) && ((a ^ b) & F16_SIGN_MASK)) {
+            return F16_QUIET_NAN;
+        }
+        return f16_is_inf(a) ? a : b;
+    }
+
+    // Both operands fit a common 2^-24 grid within 41 bits, so the sum is
+    // exact before the final rounding
+    value_a = f16_unpack(a, &exponent_a);
+    value_b = f16_unpack(b, &exponent_b);
+    value_a <<= exponent_a - F16_MIN_EXPONENT;
+    value_b <<= exponent_b - F16_MIN_EXPONENT;
+    exponent = F16_MIN_EXPONENT;
+
+    if (a & F16_SIGN_MASK) {
+        value_a = -value_a;
+    }
+    if (b & F16_SIGN_MASK) {
+        value_b = -value_b;
+    }
+
+    sum = value_a + value_b;
+    if (sum == 0) {
+        // -0 + -0 is the only sum that keeps the negative zero
+        return (a & b) & F16_SIGN_MASK;
+    }
+    return f16_round(sum < 0, sum < 0 ? -sum : sum, exponent);
+}
+
+uint16_t f16_mul(uint16_t a, uint16_t b) {
+    bool negative = (a ^ b) & F16_SIGN_MASK;
+    int exponent_a;
+    int exponent_b;
+    uint64_t product;
+
+    if (f16_is_nan(a) || f16_is_nan(b)) {
+        return F16_QUIET_NAN;
+    }
+    if (f16_is_inf(a) || f16_is_inf(b)) {
+        if (!(a & 0x7FFF) || !(b & 0x7FFF)) {
+            return F16_QUIET_NAN; // inf * 0
+        }
+        return (negative ? F16_SIGN_MASK : 0) | F16_INFINITY;
+    }
+
+    product = (uint64_t)f16_unpack(a, &exponent_a) *
+              f16_unpack(b, &exponent_b);
+    return f16_round(negative, product, exponent_a + exponent_b);
+}
+
+uint16_t f16_mul_add(uint16_t a, uint16_t b, uint16_t c) {
+    return f16_add(f16_mul(a, b), c);
+}
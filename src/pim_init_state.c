@@ -4,15 +4,29 @@
 #include "../include/microkernels/kernels.h"
 #include "../include/pim_init_state.h"
 #include "../include/pim_memory_region.h"
+#include "../include/pim_vm.h"
+#include "../include/trigger_program.h"
 
 int write_config_bytes(const char *data, size_t length) {
+    bool relaxed = pim_ordering_policy() != PIM_ORDER_CONSERVATIVE;
     size_t i;
+
+    // The dsb below orders the whole config write, the relaxed policies skip
+    // the barrier the ordered accessor adds to every byte
     for (i = 0; i < length; i++) {
-        iowrite8(data[i], pim_config_virt_addr + i);
+        if (relaxed) {
+            writeb_relaxed(data[i], pim_config_virt_addr + i);
+        } else {
+            iowrite8(data[i], pim_config_virt_addr + i);
+        }
     }
 
     iowrite8('\0', pim_config_virt_addr + i);
     dsb(SY);
+
+    if (pim_emulator) {
+        return pim_vm_write_config(pim_emulator, data, length);
+    }
     return 0;
 }
 
@@ -48,81 +62,36 @@ int set_bank_mode(pim_bank_mode_t bank_mode) {
 int set_kernel(kernel_builder_t builder) {
     Microkernel kernel;
     int ret;
-    char *buffer;
-    char *ptr;
-    size_t remaining;
-    int written;
-    int total_written;
-    int result;
 
     ret = builder(&kernel);
     if (ret != 0) {
         pr_err("PIM: Kernel builder function failed with error %d\n", ret);
         return ret;
     }
+
+    return set_microkernel(&kernel);
+}
+
+int set_microkernel(const Microkernel *kernel) {
+    char *buffer;
+    int written;
+
 #define BUFFER_SIZE 2048
     buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
     if (!buffer) {
         pr_err("Couldn't allocate memory\n");
         return -ENOMEM;
     }
-    ptr = buffer;
-    remaining = BUFFER_SIZE;
-    written = 0;
-    total_written = 0;
-    result = 0;
-
-    written = snprintf(ptr, remaining, "{\"bank_mode\":null,\"kernel\":[");
-    if (written < 0 || written >= remaining) {
-        result = -ENOMEM;
-        goto cleanup_error;
-    }
-    ptr += written;
-    remaining -= written;
-    total_written += written;
-
-    for (int i = 0; i < 32; ++i) {
-        if (i > 0) {
-            written = snprintf(ptr, remaining, ","); // for the comma
-            if (written < 0 || written >= remaining) {
-                result = -ENOMEM;
-                goto cleanup_error;
-            }
-            ptr += written;
-            remaining -= written;
-            total_written += written;
-        }
 
-        written =
-            parse_instruction_to_string(ptr, remaining, &kernel.kernel[i]);
-
-        if (written < 0) {
-            result = written;
-            goto cleanup_error;
-        }
-        if (written >= remaining) {
-            result = -ENOMEM;
-            goto cleanup_error;
-        }
-        ptr += written;
-        remaining -= written;
-        total_written += written;
-    }
-    written = snprintf(ptr, remaining, "]}");
-    if (written < 0 || written >= remaining) {
-        result = -ENOMEM;
-        goto cleanup_error;
+    written = parse_kernel_to_string(buffer, BUFFER_SIZE, kernel);
+    if (written < 0) {
+        pr_err("Error at parsing (Code: %d)\n", written);
+        kfree(buffer);
+        return written;
     }
-    ptr += written;
-    remaining -= written;
-    total_written += written;
 
-    write_config_bytes(buffer, strlen(buffer));
+    write_config_bytes(buffer, written);
 
-cleanup_error:
-    if (result != 0) {
-        pr_err("Error at parsing (Code: %d)\n", result);
-    }
     kfree(buffer);
-    return kernel.blocks;
-}
\ No newline at end of file
+    return kernel->blocks;
+}
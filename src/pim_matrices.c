@@ -1,59 +1,79 @@
 #include "../include/pim_matrices.h"
+#include "../include/pim_configs.h"
 #include "../include/pim_data_allocator.h"
+#include "../include/pim_f16.h"
 #include "../include/pim_memory_region.h"
 
-const int MATRIX_ROWS = 64;
+const int MATRIX_ROWS = 128;
 const int MATRIX_COLS = 128;
 
-const int X16_ROWS = (MATRIX_ROWS / 8);
+const int X16_ROWS = (MATRIX_ROWS / 16);
 const int X16_COLUMNS = (MATRIX_COLS / 16);
 const int ELEMENT_COUNT_SUBMATRIX = 16;
 
-void transform_matrix(const uint16_t *original_matrix,
-                      uint16_t *transformed_matrix) {
-    const int NUM_ELEMENTS_IN_BLOCK =
-        ELEMENT_COUNT_SUBMATRIX * X16_COLUMNS * ELEMENT_COUNT_SUBMATRIX;
-    const int NUM_ELEMENTS_IN_COL =
-        ELEMENT_COUNT_SUBMATRIX * ELEMENT_COUNT_SUBMATRIX;
-
-    for (int i = 0; i < X16_ROWS; ++i) {
-        for (int c = 0; c < X16_COLUMNS; ++c) {
-            for (int r = 0; r < ELEMENT_COUNT_SUBMATRIX; ++r) {
-                for (int k = 0; k < ELEMENT_COUNT_SUBMATRIX; ++k) {
-
-                    int src_row = i * ELEMENT_COUNT_SUBMATRIX + r;
-                    int src_col = c * ELEMENT_COUNT_SUBMATRIX + k;
-                    int src_index = src_row * MATRIX_COLS + src_col;
+uint64_t matrix_tile_block_mask(const uint16_t *tile_origin, size_t stride,
+                                int valid_rows, int valid_cols) {
+    uint64_t mask = 0;
 
-                    int dest_index = (i * NUM_ELEMENTS_IN_BLOCK) +
-                                     (c * NUM_ELEMENTS_IN_COL) +
-                                     (r * ELEMENT_COUNT_SUBMATRIX) + k;
+    for (int r = 0; r < valid_rows; ++r) {
+        const uint16_t *row = tile_origin + r * stride;
+        int i = r / ELEMENT_COUNT_SUBMATRIX;
 
-                    transformed_matrix[dest_index] = original_matrix[src_index];
-                }
+        for (int col = 0; col < valid_cols; ++col) {
+            // Both signed zeros count as zero
+            if (row[col] & ~F16_SIGN_MASK) {
+                mask |= 1ULL << (i * X16_COLUMNS +
+                                 col / ELEMENT_COUNT_SUBMATRIX);
             }
         }
     }
+    return mask;
 }
 
-void __iomem *init_matrix_flat(uint16_t *flat_data_arr,
-                               size_t matrix_logical_size) {
-    uint16_t __iomem *current_addr;
-    size_t total_size_bytes = matrix_logical_size * sizeof(uint16_t);
-    uint16_t __iomem *matrix_start_addr =
-        pim_data_region_alloc(total_size_bytes, PIM_MATRIX_ALIGNMENT);
+void __iomem *init_matrix_tiled(const uint16_t *tile_origin, size_t stride,
+                                int valid_rows, int valid_cols,
+                                uint64_t block_mask) {
+    const int NUM_ELEMENTS_IN_COL =
+        ELEMENT_COUNT_SUBMATRIX * ELEMENT_COUNT_SUBMATRIX;
+    uint16_t block[NUM_BANKS * ELEMENTS_PER_BANK];
+    uint16_t __iomem *block_addr;
+    uint16_t __iomem *matrix_start_addr = pim_data_region_alloc(
+        MATRIX_ROWS * MATRIX_COLS * sizeof(uint16_t), PIM_MATRIX_ALIGNMENT);
 
     if (!matrix_start_addr) {
-        pr_err("PIM allocator failed in init_matrix_flat\n");
+        pr_err("PIM allocator failed in init_matrix_tiled\n");
         return NULL;
     }
 
-    current_addr = matrix_start_addr;
+    // The blocks are written in address order, every block is gathered on
+    // the stack and stored with a single wide copy
+    block_addr = matrix_start_addr;
+    for (int i = 0; i < X16_ROWS; ++i) {
+        for (int c = 0; c < X16_COLUMNS; ++c) {
+            if (!(block_mask & (1ULL << (i * X16_COLUMNS + c)))) {
+                block_addr += NUM_ELEMENTS_IN_COL;
+                continue;
+            }
+
+            for (int r = 0; r < ELEMENT_COUNT_SUBMATRIX; ++r) {
+                int src_row = i * ELEMENT_COUNT_SUBMATRIX + r;
+                int src_col = c * ELEMENT_COUNT_SUBMATRIX;
+                uint16_t *dest = block + r * ELEMENT_COUNT_SUBMATRIX;
+                int valid = 0;
 
-    // Write elements sequentially
-    for (size_t i = 0; i < matrix_logical_size; i++) {
-        iowrite16(flat_data_arr[i], current_addr);
-        current_addr++;
+                // Rows and columns past the edge of the matrix are zero
+                if (src_row < valid_rows && src_col < valid_cols) {
+                    valid = min(valid_cols - src_col, ELEMENT_COUNT_SUBMATRIX);
+                    memcpy(dest, tile_origin + src_row * stride + src_col,
+                           valid * sizeof(uint16_t));
+                }
+                memset(dest + valid, 0,
+                       (ELEMENT_COUNT_SUBMATRIX - valid) * sizeof(uint16_t));
+            }
+
+            memcpy_toio(block_addr, block, sizeof(block));
+            block_addr += NUM_ELEMENTS_IN_COL;
+        }
     }
     dsb(SY);
 
@@ -37,39 +37,79 @@ void __iomem *init_vector_result(size_t length) {
     return vector_start_addr;
 }
 
+void __iomem *alloc_vector_result(size_t length) {
+    void __iomem *vector_start_addr = pim_data_region_alloc(
+        length * sizeof(uint16_t), PIM_VECTOR_ALIGNMENT);
+
+    if (!vector_start_addr) {
+        pr_err("PIM allocator failed in alloc_vector_result\n");
+    }
+    return vector_start_addr;
+}
+
 void __iomem *init_vector_interleaved(uint16_t *logical_elements_data,
                                       size_t num_logical_elements) {
+    uint16_t block[NUM_BANKS * ELEMENT_COUNT_SUBMATRIX];
     uint16_t __iomem *vector_start_addr;
     uint16_t __iomem *write_ptr;
 
-    const size_t ELEMENTS_PER_BLOCK =
-        (size_t)NUM_BANKS * ELEMENT_COUNT_SUBMATRIX; // 16 * 16 = 256
+    vector_start_addr = pim_data_region_alloc(
+        num_logical_elements * sizeof(block), PIM_VECTOR_ALIGNMENT);
+    if (!vector_start_addr) {
+        pr_err("PIM: pim_data_region_alloc failed for interleaved vector\n");
+        return NULL;
+    }
 
-    size_t total_elements_in_pim = num_logical_elements * ELEMENTS_PER_BLOCK;
-    size_t total_size_bytes = total_elements_in_pim * sizeof(uint16_t);
+    write_ptr = vector_start_addr;
 
-    vector_start_addr =
-        pim_data_region_alloc(total_size_bytes, PIM_VECTOR_ALIGNMENT);
+    // Every bank of a block gets the same 16 values, the block is staged on
+    // the stack and written with one memcpy_toio
+    for (size_t i = 0; i < num_logical_elements; ++i) {
+        const uint16_t *src =
+            logical_elements_data + i * ELEMENT_COUNT_SUBMATRIX;
+
+        for (int bank_idx = 0; bank_idx < NUM_BANKS; ++bank_idx) {
+            memcpy(block + bank_idx * ELEMENT_COUNT_SUBMATRIX, src,
+                   ELEMENT_COUNT_SUBMATRIX * sizeof(uint16_t));
+        }
+
+        memcpy_toio(write_ptr, block, sizeof(block));
+        write_ptr += ARRAY_SIZE(block);
+    }
+
+    dsb(SY);
+    return vector_start_addr;
+}
+
+void __iomem *init_vector_broadcast(const uint16_t *logical_elements_data,
+                                    size_t num_logical_elements) {
+    uint16_t block[NUM_BANKS * ELEMENTS_PER_BANK];
+    uint16_t __iomem *vector_start_addr;
+    uint16_t __iomem *write_ptr;
+
+    vector_start_addr = pim_data_region_alloc(
+        num_logical_elements * sizeof(block), PIM_VECTOR_ALIGNMENT);
     if (!vector_start_addr) {
-        pr_err("PIM: pim_data_region_alloc failed for interleaved vector\n");
+        pr_err("PIM: pim_data_region_alloc failed for broadcast vector\n");
         return NULL;
     }
 
     write_ptr = vector_start_addr;
 
     for (size_t i = 0; i < num_logical_elements; ++i) {
-        uint16_t *current_logical_element_src_ptr =
+        const uint16_t *src =
             logical_elements_data + i * ELEMENT_COUNT_SUBMATRIX;
 
         for (int bank_idx = 0; bank_idx < NUM_BANKS; ++bank_idx) {
-            for (int val_idx = 0; val_idx < ELEMENT_COUNT_SUBMATRIX;
-                 ++val_idx) {
-                iowrite16(current_logical_element_src_ptr[val_idx], write_ptr);
-                write_ptr++;
+            for (int val_idx = 0; val_idx < ELEMENTS_PER_BANK; ++val_idx) {
+                block[bank_idx * ELEMENTS_PER_BANK + val_idx] = src[bank_idx];
             }
         }
+
+        memcpy_toio(write_ptr, block, sizeof(block));
+        write_ptr += ARRAY_SIZE(block);
     }
 
     dsb(SY);
     return vector_start_addr;
-}
\ No newline at end of file
+}
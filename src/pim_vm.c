@@ -0,0 +1,251 @@
+#include "../include/pim_vm.h"
+#include "../include/microkernels/kernel_asm.h"
+#include "../include/microkernels/kernel_operands.h"
+#include "../include/pim_f16.h"
+
+struct bank_mode_name {
+    const char *name;
+    enum pim_vm_bank_mode mode;
+};
+
+static const struct bank_mode_name bank_mode_names[] = {
+    {"SingleBank", PIM_VM_SINGLE_BANK},
+    {"AllBank", PIM_VM_ALL_BANK},
+    {"PimAllBank", PIM_VM_PIM_ALL_BANK},
+};
+
+void pim_vm_init(struct pim_vm *vm, void *data, size_t data_size,
+                 uint64_t phys_base) {
+    memset(vm, 0, sizeof(*vm));
+    vm->data = data;
+    vm->data_size = data_size;
+    vm->phys_base = phys_base;
+    vm->bank_mode = PIM_VM_SINGLE_BANK;
+}
+
+void pim_vm_reset(struct pim_vm *vm) {
+    kernel_walker_reset(&vm->walker);
+    memset(vm->units, 0, sizeof(vm->units));
+}
+
+void pim_vm_load_kernel(struct pim_vm *vm, const Microkernel *kernel) {
+    vm->kernel = *kernel;
+    vm->kernel_loaded = true;
+    pim_vm_reset(vm);
+}
+
+int pim_vm_write_config(struct pim_vm *vm, const char *config, size_t length) {
+    char bank_mode[16];
+    int flags;
+
+    if (length >= sizeof(vm->config)) {
+        return -EINVAL;
+    }
+    memcpy(vm->config, config, length);
+    vm->config[length] = '\0';
+
+    flags = pim_asm_parse_config(vm->config, bank_mode, sizeof(bank_mode),
+                                 &vm->staged_kernel);
+    if (flags < 0) {
+        return flags;
+    }
+    vm->stats.config_writes++;
+
+    if (flags & PIM_CONFIG_HAS_KERNEL) {
+        pim_vm_load_kernel(vm, &vm->staged_kernel);
+    }
+
+    if (flags & PIM_CONFIG_HAS_BANK_MODE) {
+        size_t i;
+
+        for (i = 0; i < ARRAY_SIZE(bank_mode_names); i++) {
+            if (!strcmp(bank_mode_names[i].name, bank_mode)) {
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(bank_mode_names)) {
+            pr_err("PIM-VM: unknown bank mode %s\n", bank_mode);
+            return -EINVAL;
+        }
+        vm->bank_mode = bank_mode_names[i].mode;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the 16 lanes of a register file operand of one unit. Scalar
+ * register files are broadcast into 'scratch'.
+ */
+static const uint16_t *operand_lanes(struct pim_vm_unit *unit,
+                                     const uint16_t *bank, const File *file,
+                                     uint16_t *scratch) {
+    uint16_t value;
+
+    switch (file->type) {
+    case BANK:
+        return bank;
+    case GRF_A:
+        return unit->grf_a[file_index(file)];
+    case GRF_B:
+        return unit->grf_b[file_index(file)];
+    case SRF_M:
+        value = unit->srf_m[file_index(file)];
+        break;
+    default:
+        value = unit->srf_a[file_index(file)];
+        break;
+    }
+
+    for (int lane = 0; lane < PIM_VM_LANES; lane++) {
+        scratch[lane] = value;
+    }
+    return scratch;
+}
+
+static void store_lanes(struct pim_vm_unit *unit, uint16_t *bank,
+                        const File *file, const uint16_t *lanes) {
+    switch (file->type) {
+    case BANK:
+        memcpy(bank, lanes, PIM_VM_LANES * sizeof(uint16_t));
+        break;
+    case GRF_A:
+        memcpy(unit->grf_a[file_index(file)], lanes,
+               PIM_VM_LANES * sizeof(uint16_t));
+        break;
+    case GRF_B:
+        memcpy(unit->grf_b[file_index(file)], lanes,
+               PIM_VM_LANES * sizeof(uint16_t));
+        break;
+    case SRF_M:
+        unit->srf_m[file_index(file)] = lanes[0];
+        break;
+    case SRF_A:
+        unit->srf_a[file_index(file)] = lanes[0];
+        break;
+    }
+}
+
+/**
+ * Executes one instruction on all units for the block at 'block_offset'.
+ */
+static void execute_instruction(struct pim_vm *vm, const Instruction *instr,
+                                size_t block_offset) {
+    uint64_t block_number =
+        (vm->phys_base + block_offset) / PIM_VM_BLOCK_BYTES;
+    Instruction resolved = *instr;
+    struct instruction_operands ops;
+
+    get_instruction_operands(&resolved, &ops);
+
+    // Address aligned mode replaces the register indices
+    if (ops.aam && *ops.aam) {
+        File *files[4] = {ops.dst, ops.src[0], ops.src[1], ops.src[2]};
+
+        for (int i = 0; i < 4; i++) {
+            if (files[i] && files[i]->type == GRF_A) {
+                set_file_index(files[i], block_number % GRF_REGISTERS);
+            } else if (files[i] && files[i]->type == GRF_B) {
+                set_file_index(files[i],
+                               (block_number / GRF_REGISTERS) % GRF_REGISTERS);
+            }
+        }
+    }
+
+    for (int b = 0; b < PIM_VM_BANKS; b++) {
+        struct pim_vm_unit *unit = &vm->units[b];
+        uint16_t *bank = (uint16_t *)(vm->data + block_offset +
+                                      b * PIM_VM_LANES * sizeof(uint16_t));
+        uint16_t scratch[3][PIM_VM_LANES];
+        uint16_t result[PIM_VM_LANES];
+        const uint16_t *src[3];
+
+        for (int i = 0; i < ops.num_src; i++) {
+            src[i] = operand_lanes(unit, bank, ops.src[i], scratch[i]);
+        }
+
+        for (int lane = 0; lane < PIM_VM_LANES; lane++) {
+            switch (resolved.type) {
+            case MOV:
+            case FILL:
+                result[lane] = src[0][lane];
+                break;
+            case ADD:
+                result[lane] = f16_add(src[0][lane], src[1][lane]);
+                break;
+            case MUL:
+                result[lane] = f16_mul(src[0][lane], src[1][lane]);
+                break;
+            case MAC:
+            case MAD:
+                result[lane] =
+                    f16_mul_add(src[0][lane], src[1][lane], src[2][lane]);
+                break;
+            default:
+                return;
+            }
+        }
+
+        store_lanes(unit, bank, ops.dst, result);
+    }
+}
+
+int pim_vm_trigger(struct pim_vm *vm, size_t offset, bool is_write) {
+    Instruction *instr;
+    size_t block_offset;
+    bool writes_bank;
+    int pc;
+
+    if (offset >= vm->data_size) {
+        pr_err("PIM-VM: trigger at 0x%zx outside of the data region\n",
+               offset);
+        return -EINVAL;
+    }
+
+    vm->stats.triggers++;
+    if (vm->bank_mode != PIM_VM_PIM_ALL_BANK) {
+        return 0;
+    }
+    vm->stats.pim_triggers++;
+
+    if (!vm->kernel_loaded) {
+        vm->stats.protocol_errors++;
+        return -EINVAL;
+    }
+
+    pc = kernel_walker_resolve(&vm->walker, &vm->kernel);
+    if (pc < 0) {
+        pr_err("PIM-VM: kernel left the instruction memory\n");
+        vm->stats.protocol_errors++;
+        pim_vm_reset(vm);
+        return pc;
+    }
+
+    instr = &vm->kernel.kernel[pc];
+    vm->stats.instructions[instr->type]++;
+
+    if (instr->type == EXIT) {
+        vm->stats.exits++;
+        pim_vm_reset(vm);
+        return 0;
+    }
+
+    block_offset = offset & ~(size_t)(PIM_VM_BLOCK_BYTES - 1);
+    if (block_offset + PIM_VM_BLOCK_BYTES > vm->data_size) {
+        vm->stats.protocol_errors++;
+        return -EINVAL;
+    }
+
+    // FILL stores into the bank and expects a write, all other instructions
+    // that touch the bank expect a read
+    if (instruction_uses_bank(instr)) {
+        writes_bank = instr->type == FILL;
+        if (writes_bank != is_write) {
+            vm->stats.protocol_errors++;
+        }
+    }
+
+    execute_instruction(vm, instr, block_offset);
+    vm->walker.pc++;
+    return 0;
+}
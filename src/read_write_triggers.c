@@ -1,14 +1,35 @@
 #include "../include/read_write_triggers.h"
+#include "../include/pim_memory_region.h"
+#include "../include/pim_vm.h"
 #include <linux/io.h>
 
+/**
+ * Forwards a trigger to the reference model when the module runs on the
+ * emulated backend.
+ */
+static int trigger_emulated(void __iomem *address, bool is_write) {
+    size_t offset =
+        (char __iomem *)address - (char __iomem *)pim_data_virt_addr;
+
+    return pim_vm_trigger(pim_emulator, offset, is_write);
+}
+
 int trigger_write(void __iomem *address) {
+    if (pim_emulator) {
+        return trigger_emulated(address, true);
+    }
     iowrite8(0, address);
     // wmb();
     return 0;
 }
 
 int trigger_read(void __iomem *address) {
-    volatile uint8_t val = ioread8(address);
+    volatile uint8_t val;
+
+    if (pim_emulator) {
+        return trigger_emulated(address, false);
+    }
+    val = ioread8(address);
     (void)val;
     // rmb();
     return 0;
@@ -0,0 +1,68 @@
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+
+#include "../include/pim_vm.h"
+#include "../include/trigger_program.h"
+
+static unsigned int ordering_policy;
+module_param_named(ordering, ordering_policy, uint, 0644);
+MODULE_PARM_DESC(ordering, "Trigger ordering: 0 conservative, 1 barrier per "
+                           "phase, 2 single barrier per batch");
+
+enum pim_ordering pim_ordering_policy(void) {
+    unsigned int policy = READ_ONCE(ordering_policy);
+
+    return policy < PIM_ORDER_COUNT ? policy : PIM_ORDER_CONSERVATIVE;
+}
+
+int trigger_program_init(struct trigger_program *program, uint32_t capacity,
+                         enum pim_ordering ordering) {
+    program->entries =
+        kvmalloc_array(capacity, sizeof(*program->entries), GFP_KERNEL);
+    program->count = 0;
+    program->capacity = program->entries ? capacity : 0;
+    program->ordering = ordering;
+
+    return program->entries ? 0 : -ENOMEM;
+}
+
+void trigger_program_free(struct trigger_program *program) {
+    kvfree(program->entries);
+    program->entries = NULL;
+    program->count = 0;
+    program->capacity = 0;
+}
+
+int trigger_program_append(struct trigger_program *program,
+                           const void __iomem *address, bool is_write,
+                           enum trigger_fence fence) {
+    struct trigger_entry *entry;
+
+    if (program->count == program->capacity) {
+        return -ENOSPC;
+    }
+
+    entry = &program->entries[program->count++];
+    entry->offset =
+        (const u8 __iomem *)address - (const u8 __iomem *)pim_data_virt_addr;
+    entry->is_write = is_write;
+    entry->fence = fence;
+    return 0;
+}
+
+void trigger_program_fence(struct trigger_program *program,
+                           enum trigger_fence fence) {
+    if (program->count) {
+        program->entries[program->count - 1].fence = fence;
+    }
+}
+
+void trigger_program_replay_emulated(const struct trigger_program *program) {
+    for (uint32_t i = 0; i < program->count; i++) {
+        const struct trigger_entry *entry = &program->entries[i];
+
+        pim_vm_trigger(pim_emulator, entry->offset, entry->is_write);
+    }
+}
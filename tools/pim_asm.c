@@ -0,0 +1,220 @@
+/*
+ * Command line front end of the microkernel assembler.
+ *
+ *   pim_asm kernel.s           assemble and print the set_kernel config JSON
+ *   pim_asm -b kernel.s        assemble into a binary blob on stdout
+ *   pim_asm -d config.json     disassemble a config JSON or binary blob
+ *   pim_asm -c 4096 kernel.s   predict the cost of an elementwise op
+ *   pim_asm -c 256x512 gemv.s  predict the cost of a GEMV
+ *   pim_asm -O kernel.s        run the peephole optimizer before the output
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/microkernels/kernel_asm.h"
+#include "../include/microkernels/kernel_cost.h"
+#include "../include/microkernels/kernel_opt.h"
+#include "../include/microkernels/kernel_to_string.h"
+
+#define MAX_INPUT_SIZE (64 * 1024)
+#define OUTPUT_BUFFER_SIZE 4096
+
+static char *read_input(const char *path, size_t *size_out) {
+    FILE *file = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+    char *data;
+    size_t size;
+
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+
+    data = malloc(MAX_INPUT_SIZE + 1);
+    if (!data) {
+        perror("malloc");
+        return NULL;
+    }
+    size = fread(data, 1, MAX_INPUT_SIZE, file);
+    data[size] = '\0';
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    *size_out = size;
+    return data;
+}
+
+static int optimize_kernel(Microkernel *kernel) {
+    struct pim_opt_stats stats;
+
+    if (pim_opt_optimize(kernel, PIM_OPT_ALL, &stats, NULL)) {
+        fprintf(stderr, "pim_asm: optimizer failed\n");
+        return -1;
+    }
+    fprintf(stderr,
+            "pim_asm: %d -> %d slots, %d -> %d triggers, %d -> %d registers "
+            "(%d MOVs removed, %d MADs fused)\n",
+            stats.slots_before, stats.slots_after, stats.triggers_before,
+            stats.triggers_after, stats.registers_before,
+            stats.registers_after, stats.movs_removed, stats.mads_fused);
+    return 0;
+}
+
+static int disassemble(const char *input, size_t size, int optimize) {
+    Microkernel kernel;
+    char output[OUTPUT_BUFFER_SIZE];
+    int ret;
+
+    if (size >= 4 && !memcmp(input, "PIMK", 4)) {
+        ret = pim_asm_from_blob((const uint8_t *)input, size, &kernel);
+    } else {
+        ret = pim_asm_parse_json(input, &kernel);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "pim_asm: input is neither a kernel config nor a "
+                        "blob\n");
+        return 1;
+    }
+    if (optimize && optimize_kernel(&kernel)) {
+        return 1;
+    }
+
+    ret = pim_asm_disassemble(&kernel, output, sizeof(output));
+    if (ret < 0) {
+        return 1;
+    }
+    fputs(output, stdout);
+    return 0;
+}
+
+static int assemble(const char *input, int binary, int optimize) {
+    Microkernel kernel;
+    char output[OUTPUT_BUFFER_SIZE];
+    uint8_t blob[PIM_ASM_BLOB_MAX_SIZE];
+    int ret;
+
+    if (pim_asm_assemble(input, &kernel) < 0) {
+        return 1;
+    }
+    if (optimize && optimize_kernel(&kernel)) {
+        return 1;
+    }
+
+    if (binary) {
+        ret = pim_asm_to_blob(&kernel, blob, sizeof(blob));
+        if (ret < 0) {
+            return 1;
+        }
+        fwrite(blob, 1, ret, stdout);
+        return 0;
+    }
+
+    ret = parse_kernel_to_string(output, sizeof(output), &kernel);
+    if (ret < 0) {
+        return 1;
+    }
+    printf("%s\n", output);
+    return 0;
+}
+
+static int parse_shape(const char *text, struct pim_op_shape *shape) {
+    char *end;
+
+    memset(shape, 0, sizeof(*shape));
+    shape->len = strtoul(text, &end, 0);
+    if (*end == '\0') {
+        shape->kind = PIM_SHAPE_ELEMENTWISE;
+        return shape->len ? 0 : -1;
+    }
+    if (*end != 'x') {
+        return -1;
+    }
+
+    shape->kind = PIM_SHAPE_GEMV;
+    shape->rows = shape->len;
+    shape->cols = strtoul(end + 1, &end, 0);
+    shape->len = 0;
+    return (*end == '\0' && shape->rows && shape->cols) ? 0 : -1;
+}
+
+static int print_cost(const char *input, const struct pim_op_shape *shape,
+                      int optimize) {
+    Microkernel kernel;
+    struct pim_cost cost;
+
+    if (pim_asm_assemble(input, &kernel) < 0) {
+        return 1;
+    }
+    if (optimize && optimize_kernel(&kernel)) {
+        return 1;
+    }
+    if (pim_cost_analyze(&kernel, shape, &pim_cost_calibration, &cost)) {
+        return 1;
+    }
+
+    printf("per launch:    %u reads, %u writes, %u barriers\n",
+           cost.launch_reads, cost.launch_writes, cost.launch_barriers);
+    printf("launches:      %llu\n", (unsigned long long)cost.launches);
+    printf("triggers:      %llu reads, %llu writes\n",
+           (unsigned long long)cost.trigger_reads,
+           (unsigned long long)cost.trigger_writes);
+    printf("barriers:      %llu\n", (unsigned long long)cost.barriers);
+    printf("config bytes:  %llu\n", (unsigned long long)cost.config_bytes);
+    printf("mmio bytes:    %llu written, %llu read\n",
+           (unsigned long long)cost.mmio_write_bytes,
+           (unsigned long long)cost.mmio_read_bytes);
+    printf("estimate:      %llu ns (cpu %llu ns)\n",
+           (unsigned long long)cost.estimated_ns,
+           (unsigned long long)pim_cost_estimate_cpu(
+               shape, &pim_cost_calibration));
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int binary = 0;
+    int reverse = 0;
+    int optimize = 0;
+    const char *shape_text = NULL;
+    struct pim_op_shape shape;
+    const char *path = NULL;
+    char *input;
+    size_t size;
+    int ret;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-b")) {
+            binary = 1;
+        } else if (!strcmp(argv[i], "-d")) {
+            reverse = 1;
+        } else if (!strcmp(argv[i], "-O")) {
+            optimize = 1;
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            shape_text = argv[++i];
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path || (shape_text && parse_shape(shape_text, &shape))) {
+        fprintf(stderr, "usage: %s [-O] [-b | -d | -c len | -c rowsxcols] "
+                        "<file | ->\n",
+                argv[0]);
+        return 2;
+    }
+
+    input = read_input(path, &size);
+    if (!input) {
+        return 1;
+    }
+
+    if (shape_text) {
+        ret = print_cost(input, &shape, optimize);
+    } else if (reverse) {
+        ret = disassemble(input, size, optimize);
+    } else {
+        ret = assemble(input, binary, optimize);
+    }
+    free(input);
+    return ret;
+}
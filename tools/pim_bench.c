@@ -0,0 +1,233 @@
+/*
+ * Compares the elementwise kernel variants of an opcode over vector lengths
+ * from 2^8 to 2^21 elements.
+ *
+ *   pim_bench [-o add|mul|mad] [-m min_log2] [-M max_log2]
+ *
+ * For every length and variant the trigger stream of the whole op is built
+ * the way the driver compiles it (every invocation advances all operand
+ * streams by the number of blocks of the variant), replayed against the
+ * reference PIM-VM and checked against the host result. The table lists the
+ * predicted device time of the cost model, the speedup over the single block
+ * variant and the time the model needed for the replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/microkernels/kernel_cost.h"
+#include "../include/microkernels/kernel_plan.h"
+#include "../include/microkernels/kernels.h"
+#include "../include/pim_f16.h"
+#include "../include/pim_vm.h"
+
+#define DEFAULT_MIN_LOG2 8
+#define DEFAULT_MAX_LOG2 21
+
+static const char all_bank_config[] =
+    "{\"bank_mode\":\"PimAllBank\",\"kernel\":null}";
+
+struct bench_opcode {
+    const char *name;
+    InstructionType opcode;
+};
+
+static const struct bench_opcode bench_opcodes[] = {
+    {"add", ADD},
+    {"mul", MUL},
+    {"mad", MAD},
+};
+
+static double elapsed(const struct timespec *start,
+                      const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * Same operand order as the kernels: b op a resp. b * a + c.
+ */
+static uint16_t reference(InstructionType opcode, uint16_t a, uint16_t b,
+                          uint16_t c) {
+    switch (opcode) {
+    case ADD:
+        return f16_add(b, a);
+    case MUL:
+        return f16_mul(b, a);
+    default:
+        return f16_mul_add(b, a, c);
+    }
+}
+
+/**
+ * Replays all invocations of the variant for 'len' elements. Returns the
+ * number of wrong results or -1 if the kernel cannot be built.
+ */
+static long run_variant(struct pim_vm *vm, const struct kernel_variant *variant,
+                        uint32_t len, const size_t *offsets,
+                        double *seconds) {
+    const uint16_t *data = (const uint16_t *)vm->data;
+    struct timespec start, end;
+    struct kernel_plan plan;
+    Microkernel kernel;
+    uint32_t launches;
+    long wrong = 0;
+
+    if (build_kernel_variant(&kernel, variant) ||
+        kernel_plan_build(&kernel, PIM_ORDER_CONSERVATIVE, &plan)) {
+        return -1;
+    }
+    launches = len / KERNEL_BLOCK_ELEMENTS / plan.blocks;
+
+    memset(vm->data + offsets[KERNEL_STREAM_RESULT], 0,
+           (size_t)len * sizeof(uint16_t));
+    pim_vm_load_kernel(vm, &kernel);
+    pim_vm_write_config(vm, all_bank_config, strlen(all_bank_config));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t l = 0; l < launches; l++) {
+        for (int i = 0; i < plan.count; i++) {
+            const struct kernel_plan_step *step = &plan.steps[i];
+            size_t offset = offsets[step->stream];
+
+            if (kernel_stream_steps(step->stream)) {
+                offset += (size_t)(l * plan.blocks + step->block) *
+                          PIM_VM_BLOCK_BYTES;
+            }
+            pim_vm_trigger(vm, offset, step->is_write);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *seconds = elapsed(&start, &end);
+
+    for (uint32_t i = 0; i < launches * plan.blocks * KERNEL_BLOCK_ELEMENTS;
+         i++) {
+        uint16_t a = data[offsets[KERNEL_STREAM_A] / 2 + i];
+        uint16_t b = data[offsets[KERNEL_STREAM_B] / 2 + i];
+        uint16_t c = data[offsets[KERNEL_STREAM_C] / 2 + i];
+
+        if (data[offsets[KERNEL_STREAM_RESULT] / 2 + i] !=
+            reference(variant->opcode, a, b, c)) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+int main(int argc, char **argv) {
+    const struct bench_opcode *op = &bench_opcodes[0];
+    const struct kernel_variant *variants;
+    size_t num_variants = get_kernel_variants(&variants);
+    size_t offsets[KERNEL_STREAM_COUNT];
+    int min_log2 = DEFAULT_MIN_LOG2;
+    int max_log2 = DEFAULT_MAX_LOG2;
+    size_t stream_bytes;
+    size_t region_bytes;
+    struct pim_vm *vm;
+    int failed = 0;
+
+    for (int arg = 1; arg + 1 < argc; arg += 2) {
+        if (!strcmp(argv[arg], "-o")) {
+            op = NULL;
+            for (size_t i = 0; i < ARRAY_SIZE(bench_opcodes); i++) {
+                if (!strcmp(argv[arg + 1], bench_opcodes[i].name)) {
+                    op = &bench_opcodes[i];
+                }
+            }
+        } else if (!strcmp(argv[arg], "-m")) {
+            min_log2 = atoi(argv[arg + 1]);
+        } else if (!strcmp(argv[arg], "-M")) {
+            max_log2 = atoi(argv[arg + 1]);
+        }
+    }
+    if (!op || min_log2 < DEFAULT_MIN_LOG2 || max_log2 > 24 ||
+        min_log2 > max_log2) {
+        fprintf(stderr, "usage: pim_bench [-o add|mul|mad] [-m min_log2] "
+                        "[-M max_log2]\n");
+        return 2;
+    }
+
+    // One region per stream, the scratch blocks behind them
+    stream_bytes = ((size_t)1 << max_log2) * sizeof(uint16_t);
+    for (int s = 0; s < KERNEL_STREAM_COUNT; s++) {
+        offsets[s] = s * stream_bytes;
+    }
+    region_bytes = KERNEL_STREAM_CONSTANT * stream_bytes +
+                   2 * PIM_VM_BLOCK_BYTES;
+    offsets[KERNEL_STREAM_DUMMY] = offsets[KERNEL_STREAM_CONSTANT] +
+                                   PIM_VM_BLOCK_BYTES;
+
+    vm = malloc(sizeof(*vm));
+    if (!vm) {
+        perror("malloc");
+        return 1;
+    }
+    pim_vm_init(vm, malloc(region_bytes), region_bytes, PIM_VM_DATA_PHYS_BASE);
+    if (!vm->data) {
+        perror("malloc");
+        return 1;
+    }
+
+    // Modest normal f16 values so that no result overflows
+    srand(1);
+    for (size_t i = 0; i < region_bytes / sizeof(uint16_t); i++) {
+        ((uint16_t *)vm->data)[i] = 0x3000 | (rand() & 0x0FFF);
+    }
+
+    printf("%-9s %-7s %9s %10s %9s %12s %8s %10s %6s\n", "elements",
+           "variant", "launches", "triggers", "barriers", "estimated us",
+           "speedup", "replay ms", "check");
+
+    for (int log2 = min_log2; log2 <= max_log2; log2++) {
+        uint32_t len = (uint32_t)1 << log2;
+        struct pim_op_shape shape = {
+            .kind = PIM_SHAPE_ELEMENTWISE,
+            .len = len,
+        };
+        uint64_t single_block_ns = 0;
+
+        // Backwards through the table, the single block variant comes first
+        for (size_t v = num_variants; v-- > 0;) {
+            const struct kernel_variant *variant = &variants[v];
+            struct pim_cost cost;
+            Microkernel kernel;
+            double seconds = 0;
+            long wrong;
+
+            if (variant->opcode != op->opcode || variant->scale_bank ||
+                (uint32_t)variant->blocks * KERNEL_BLOCK_ELEMENTS > len) {
+                continue;
+            }
+            if (build_kernel_variant(&kernel, variant) ||
+                pim_cost_analyze(&kernel, &shape, &pim_cost_calibration,
+                                 &cost)) {
+                continue;
+            }
+            if (variant->blocks == 1) {
+                single_block_ns = cost.estimated_ns;
+            }
+
+            wrong = run_variant(vm, variant, len, offsets, &seconds);
+            failed |= wrong != 0;
+
+            printf("%-9u %-4s x%-2d %9llu %10llu %9llu %12.1f %7.2fx %10.3f "
+                   "%6s\n",
+                   len, op->name, variant->blocks,
+                   (unsigned long long)cost.launches,
+                   (unsigned long long)(cost.trigger_reads +
+                                        cost.trigger_writes),
+                   (unsigned long long)cost.barriers,
+                   cost.estimated_ns / 1e3,
+                   single_block_ns ? (double)single_block_ns /
+                                         cost.estimated_ns
+                                   : 1.0,
+                   seconds * 1e3, wrong ? "FAIL" : "ok");
+        }
+    }
+
+    free(vm->data);
+    free(vm);
+    return failed;
+}
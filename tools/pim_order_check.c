@@ -0,0 +1,263 @@
+/*
+ * Checks which barriers the trigger protocol needs by replaying the trigger
+ * programs of all elementwise kernel variants against the reference PIM-VM
+ * in every order a weakly ordered memory system could deliver them.
+ *
+ *   pim_order_check [-n orders] [-s seed]
+ *
+ * The triggers of one op (two invocations per variant) are placed the way
+ * the driver places them under each ordering policy. Two accesses keep their
+ * program order only if a barrier orders them:
+ *   - mb() orders everything before it against everything after it
+ *   - rmb() resp. wmb() (dsb ld/st) order earlier reads resp. writes
+ *   - ordered accessors: ioread8 orders its read against everything after
+ *     it, iowrite8 orders earlier writes against itself
+ * Random orders respecting these constraints are replayed and the data
+ * region is compared with an in order replay. A device mapping that keeps
+ * accesses in program order (Device-nR) always matches the in order replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/microkernels/kernel_plan.h"
+#include "../include/microkernels/kernels.h"
+#include "../include/pim_vm.h"
+
+#define DEFAULT_ORDERS 32
+#define LAUNCHES 2
+#define REGION_BYTES (1024 * 1024)
+#define MAX_TRIGGERS (LAUNCHES * KERNEL_PLAN_MAX_TRIGGERS)
+
+static const char *const opcode_names[] = {
+    "NOP", "EXIT", "JUMP", "MOV", "FILL", "ADD", "MUL", "MAC", "MAD",
+};
+
+static const char *const policy_names[PIM_ORDER_COUNT] = {
+    [PIM_ORDER_CONSERVATIVE] = "conservative",
+    [PIM_ORDER_PHASE] = "phase",
+    [PIM_ORDER_BATCH] = "batch",
+};
+
+static const char all_bank_config[] =
+    "{\"bank_mode\":\"PimAllBank\",\"kernel\":null}";
+
+struct trigger {
+    size_t offset;
+    bool is_write;
+    enum trigger_fence fence;
+};
+
+static int build_triggers(const struct kernel_plan *plan,
+                          enum pim_ordering ordering,
+                          struct trigger *triggers) {
+    // One region per stream, large enough for all blocks of the op
+    const size_t stride = 64 * PIM_VM_BLOCK_BYTES;
+    int count = 0;
+
+    for (int l = 0; l < LAUNCHES; l++) {
+        for (int i = 0; i < plan->count; i++) {
+            const struct kernel_plan_step *step = &plan->steps[i];
+            struct trigger *trigger = &triggers[count++];
+
+            trigger->offset = step->stream * stride;
+            if (kernel_stream_steps(step->stream)) {
+                trigger->offset +=
+                    (size_t)(l * plan->blocks + step->block) *
+                    PIM_VM_BLOCK_BYTES;
+            }
+            trigger->is_write = step->is_write;
+            trigger->fence = step->fence;
+        }
+    }
+    if (ordering == PIM_ORDER_BATCH) {
+        triggers[count - 1].fence = TRIGGER_FENCE_FULL;
+    }
+    return count;
+}
+
+/**
+ * Returns true if trigger i has to be delivered before trigger j (i < j).
+ */
+static bool ordered(const struct trigger *triggers, int i, int j,
+                    enum pim_ordering ordering) {
+    const struct trigger *first = &triggers[i];
+
+    if (ordering == PIM_ORDER_CONSERVATIVE &&
+        (!first->is_write || triggers[j].is_write)) {
+        return true;
+    }
+
+    for (int k = i; k < j; k++) {
+        switch (triggers[k].fence) {
+        case TRIGGER_FENCE_FULL:
+            return true;
+        case TRIGGER_FENCE_READ:
+            if (!first->is_write) {
+                return true;
+            }
+            break;
+        case TRIGGER_FENCE_WRITE:
+            if (first->is_write) {
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+/**
+ * Writes a random order of the triggers that respects all ordering
+ * constraints into 'order'.
+ */
+static void random_order(const struct trigger *triggers, int count,
+                         enum pim_ordering ordering, int *order) {
+    static bool before[MAX_TRIGGERS][MAX_TRIGGERS];
+    int pending[MAX_TRIGGERS];
+    bool done[MAX_TRIGGERS] = {false};
+
+    for (int j = 0; j < count; j++) {
+        pending[j] = 0;
+        for (int i = 0; i < j; i++) {
+            before[i][j] = ordered(triggers, i, j, ordering);
+            pending[j] += before[i][j];
+        }
+    }
+
+    for (int n = 0; n < count; n++) {
+        int ready[MAX_TRIGGERS];
+        int num_ready = 0;
+        int pick;
+
+        for (int j = 0; j < count; j++) {
+            if (!done[j] && !pending[j]) {
+                ready[num_ready++] = j;
+            }
+        }
+        pick = ready[rand() % num_ready];
+        order[n] = pick;
+        done[pick] = true;
+        for (int j = pick + 1; j < count; j++) {
+            pending[j] -= before[pick][j];
+        }
+    }
+}
+
+/**
+ * Replays the triggers in the given order on a fresh copy of 'initial'.
+ * Returns the number of protocol errors.
+ */
+static uint64_t replay(const Microkernel *kernel, const uint8_t *initial,
+                       uint8_t *data, const struct trigger *triggers,
+                       const int *order, int count) {
+    static struct pim_vm vm;
+
+    memcpy(data, initial, REGION_BYTES);
+    pim_vm_init(&vm, data, REGION_BYTES, PIM_VM_DATA_PHYS_BASE);
+    pim_vm_load_kernel(&vm, kernel);
+    pim_vm_write_config(&vm, all_bank_config, strlen(all_bank_config));
+
+    for (int n = 0; n < count; n++) {
+        const struct trigger *trigger = &triggers[order[n]];
+
+        pim_vm_trigger(&vm, trigger->offset, trigger->is_write);
+    }
+    return vm.stats.protocol_errors;
+}
+
+int main(int argc, char **argv) {
+    const struct kernel_variant *variants;
+    size_t num_variants = get_kernel_variants(&variants);
+    unsigned int seed = 1;
+    int orders = DEFAULT_ORDERS;
+    uint8_t *initial = malloc(REGION_BYTES);
+    uint8_t *expected = malloc(REGION_BYTES);
+    uint8_t *data = malloc(REGION_BYTES);
+    int unsafe[PIM_ORDER_COUNT] = {0};
+
+    for (int arg = 1; arg + 1 < argc; arg += 2) {
+        if (!strcmp(argv[arg], "-n")) {
+            orders = atoi(argv[arg + 1]);
+        } else if (!strcmp(argv[arg], "-s")) {
+            seed = strtoul(argv[arg + 1], NULL, 0);
+        }
+    }
+    if (!initial || !expected || !data || orders < 1) {
+        fprintf(stderr, "usage: pim_order_check [-n orders] [-s seed]\n");
+        return 2;
+    }
+    srand(seed);
+
+    // Modest normal f16 values so that no result overflows
+    for (size_t i = 0; i < REGION_BYTES / sizeof(uint16_t); i++) {
+        ((uint16_t *)initial)[i] = 0x3000 | (rand() & 0x0FFF);
+    }
+
+    printf("%-12s", "variant");
+    for (int p = 0; p < PIM_ORDER_COUNT; p++) {
+        printf(" %14s", policy_names[p]);
+    }
+    printf("\n");
+
+    for (size_t v = 0; v < num_variants; v++) {
+        Microkernel kernel;
+
+        if (build_kernel_variant(&kernel, &variants[v])) {
+            continue;
+        }
+        printf("%-4s x%d%-5s", opcode_names[variants[v].opcode],
+               variants[v].blocks, variants[v].scale_bank ? " scal" : "");
+
+        for (int p = 0; p < PIM_ORDER_COUNT; p++) {
+            static struct trigger triggers[MAX_TRIGGERS];
+            static int order[MAX_TRIGGERS];
+            struct kernel_plan plan;
+            int wrong = 0;
+            int count;
+
+            if (kernel_plan_build(&kernel, p, &plan)) {
+                printf(" %14s", "no plan");
+                continue;
+            }
+            count = build_triggers(&plan, p, triggers);
+
+            for (int n = 0; n < count; n++) {
+                order[n] = n;
+            }
+            replay(&kernel, initial, expected, triggers, order, count);
+
+            for (int o = 0; o < orders; o++) {
+                random_order(triggers, count, p, order);
+                if (replay(&kernel, initial, data, triggers, order, count) ||
+                    memcmp(data, expected, REGION_BYTES)) {
+                    wrong++;
+                }
+            }
+
+            if (wrong) {
+                unsafe[p]++;
+                printf(" %8d/%-5d", wrong, orders);
+            } else {
+                printf(" %14s", "ok");
+            }
+        }
+        printf("\n");
+    }
+
+    printf("\nwrong results out of %d weakly ordered replays per cell\n",
+           orders);
+    for (int p = 0; p < PIM_ORDER_COUNT; p++) {
+        printf("%-12s %s\n", policy_names[p],
+               unsafe[p] ? "needs a device mapping that keeps program order"
+                         : "safe under weak ordering");
+    }
+
+    free(initial);
+    free(expected);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * Replays a trigger trace against the reference PIM-VM model.
+ *
+ *   pim_vm_run [-s size_kb] trace.txt
+ *
+ * One command per line, offsets are relative to the data region and values
+ * are raw f16 bit patterns in hex:
+ *
+ *   config {"bank_mode":"PimAllBank","kernel":null}
+ *   kernel add.s | add.bin     load assembly or a binary blob
+ *   load 0x400 3c00 4000 ...   store values into the data region
+ *   read 0x400                 trigger read
+ *   write 0x800                trigger write
+ *   dump 0x800 16              print values of the data region
+ *
+ * Statistics and the replay time are printed at the end, which makes the
+ * tool usable for measuring host side overhead of trigger streams.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/microkernels/kernel_asm.h"
+#include "../include/pim_vm.h"
+
+#define DEFAULT_REGION_KB 1024
+#define MAX_LINE_SIZE 8192
+#define MAX_KERNEL_FILE_SIZE (64 * 1024)
+
+static const char *const instruction_names[] = {
+    "NOP", "EXIT", "JUMP", "MOV", "FILL", "ADD", "MUL", "MAC", "MAD",
+};
+
+static int load_kernel_file(struct pim_vm *vm, const char *path) {
+    Microkernel kernel;
+    char *data;
+    size_t size;
+    FILE *file;
+    int ret;
+
+    file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    data = malloc(MAX_KERNEL_FILE_SIZE + 1);
+    if (!data) {
+        fclose(file);
+        return -1;
+    }
+    size = fread(data, 1, MAX_KERNEL_FILE_SIZE, file);
+    data[size] = '\0';
+    fclose(file);
+
+    if (size >= 4 && !memcmp(data, "PIMK", 4)) {
+        ret = pim_asm_from_blob((const uint8_t *)data, size, &kernel);
+    } else {
+        ret = pim_asm_assemble(data, &kernel);
+    }
+    free(data);
+
+    if (ret < 0) {
+        return ret;
+    }
+    pim_vm_load_kernel(vm, &kernel);
+    return 0;
+}
+
+static int load_values(struct pim_vm *vm, size_t offset, char *values) {
+    char *token;
+    char *end;
+
+    for (token = strtok(values, " \t\n"); token;
+         token = strtok(NULL, " \t\n")) {
+        unsigned long value = strtoul(token, &end, 16);
+
+        if (*end || value > 0xFFFF || offset + 2 > vm->data_size) {
+            return -1;
+        }
+        *(uint16_t *)(vm->data + offset) = (uint16_t)value;
+        offset += sizeof(uint16_t);
+    }
+    return 0;
+}
+
+static int dump_values(struct pim_vm *vm, size_t offset, char *args) {
+    unsigned long count = strtoul(args, NULL, 0);
+
+    if (offset + count * sizeof(uint16_t) > vm->data_size) {
+        return -1;
+    }
+    printf("0x%zx:", offset);
+    for (unsigned long i = 0; i < count; i++) {
+        printf(" %04x", *(uint16_t *)(vm->data + offset + 2 * i));
+    }
+    printf("\n");
+    return 0;
+}
+
+static int run_command(struct pim_vm *vm, char *line) {
+    char *command;
+    char *args;
+    size_t offset;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    command = line + strspn(line, " \t");
+    if (*command == '\0' || *command == '#') {
+        return 0;
+    }
+    args = command + strcspn(command, " \t");
+    if (*args) {
+        *args++ = '\0';
+        args += strspn(args, " \t");
+    }
+
+    if (!strcmp(command, "config")) {
+        return pim_vm_write_config(vm, args, strlen(args));
+    }
+    if (!strcmp(command, "kernel")) {
+        return load_kernel_file(vm, args);
+    }
+
+    offset = strtoul(args, &args, 0);
+    if (!strcmp(command, "read")) {
+        return pim_vm_trigger(vm, offset, false);
+    }
+    if (!strcmp(command, "write")) {
+        return pim_vm_trigger(vm, offset, true);
+    }
+    if (!strcmp(command, "load")) {
+        return load_values(vm, offset, args);
+    }
+    if (!strcmp(command, "dump")) {
+        return dump_values(vm, offset, args);
+    }
+
+    fprintf(stderr, "pim_vm_run: unknown command %s\n", command);
+    return -1;
+}
+
+static void print_stats(const struct pim_vm *vm, double seconds) {
+    const struct pim_vm_stats *stats = &vm->stats;
+
+    printf("config writes:   %llu\n",
+           (unsigned long long)stats->config_writes);
+    printf("triggers:        %llu (%llu in PimAllBank)\n",
+           (unsigned long long)stats->triggers,
+           (unsigned long long)stats->pim_triggers);
+    for (int i = 0; i <= MAD; i++) {
+        if (stats->instructions[i]) {
+            printf("  %-4s           %llu\n", instruction_names[i],
+                   (unsigned long long)stats->instructions[i]);
+        }
+    }
+    printf("protocol errors: %llu\n",
+           (unsigned long long)stats->protocol_errors);
+    printf("replay time:     %.3f ms\n", seconds * 1e3);
+}
+
+int main(int argc, char **argv) {
+    size_t region_kb = DEFAULT_REGION_KB;
+    struct timespec start, end;
+    struct pim_vm *vm;
+    char *line;
+    FILE *trace;
+    int line_number = 0;
+    int ret = 0;
+    int arg = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-s")) {
+        region_kb = strtoul(argv[2], NULL, 0);
+        arg = 3;
+    }
+    if (arg != argc - 1 || region_kb == 0) {
+        fprintf(stderr, "usage: pim_vm_run [-s size_kb] trace.txt\n");
+        return 2;
+    }
+
+    trace = strcmp(argv[arg], "-") ? fopen(argv[arg], "r") : stdin;
+    if (!trace) {
+        perror(argv[arg]);
+        return 1;
+    }
+
+    vm = malloc(sizeof(*vm));
+    line = malloc(MAX_LINE_SIZE);
+    if (!vm || !line) {
+        perror("malloc");
+        return 1;
+    }
+    pim_vm_init(vm, calloc(region_kb, 1024), region_kb * 1024,
+                PIM_VM_DATA_PHYS_BASE);
+    if (!vm->data) {
+        perror("calloc");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (fgets(line, MAX_LINE_SIZE, trace)) {
+        line_number++;
+        if (run_command(vm, line) < 0) {
+            fprintf(stderr, "pim_vm_run: line %d failed\n", line_number);
+            ret = 1;
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    print_stats(vm, (end.tv_sec - start.tv_sec) +
+                        (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    free(vm->data);
+    free(vm);
+    free(line);
+    return ret;
+}